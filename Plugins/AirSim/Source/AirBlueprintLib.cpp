@@ -39,6 +39,7 @@ bool UAirBlueprintLib::log_messages_hidden_ = false;
 msr::airlib::AirSimSettings::SegmentationSetting::MeshNamingMethodType UAirBlueprintLib::mesh_naming_method_ =
     msr::airlib::AirSimSettings::SegmentationSetting::MeshNamingMethodType::OwnerName;
 IImageWrapperModule* UAirBlueprintLib::image_wrapper_module_ = nullptr;
+std::atomic<uint32> UAirBlueprintLib::stencil_id_generation_(0);
 
 void UAirBlueprintLib::InitilizeAirSimSettings()
 {
@@ -49,6 +50,19 @@ void UAirBlueprintLib::InitilizeAirSimSettings()
 		msr::airlib::AirSimSettings::createDefaultSettingsFile();
 
 	msr::airlib::AirSimSettings::singleton().load();
+
+	//shards run from one settings file, each on its own API port
+	auto& sharding_setting = msr::airlib::AirSimSettings::singleton().sharding_setting;
+	uint32 shard_index = 0;
+	if (FParse::Value(FCommandLine::Get(), TEXT("AirSimShard="), shard_index)) {
+		if (shard_index >= sharding_setting.shard_count)
+			msr::airlib::AirSimSettings::singleton().error_messages.push_back("-AirSimShard is not below Sharding ShardCount");
+		else {
+			sharding_setting.shard_index = shard_index;
+			msr::airlib::AirSimSettings::singleton().api_port += shard_index;
+		}
+	}
+
 	for (const auto& warning : msr::airlib::AirSimSettings::singleton().warning_messages) {
 		LogMessageString(warning, "", LogDebugLevel::Failure);
 	}
@@ -156,7 +170,7 @@ void UAirBlueprintLib::enableWorldRendering(AActor* context, bool enable)
         UGameViewportClient* viewport_client = player->ViewportClient;
         if (viewport_client)
         {
-            viewport_client->bDisableWorldRendering = enable;
+            viewport_client->bDisableWorldRendering = !enable;
         }
     }
 }
@@ -509,6 +523,11 @@ bool UAirBlueprintLib::SetMeshStencilID(const std::string& mesh_name, int object
     return changes > 0;
 }
 
+uint32 UAirBlueprintLib::GetStencilIDGeneration()
+{
+    return stencil_id_generation_;
+}
+
 int UAirBlueprintLib::GetMeshStencilID(const std::string& mesh_name)
 {
     // Takes a UStaticMeshComponent, USkinnedMeshComponent or ALandscapeProxy and returns their custom stencil ID if 
@@ -562,11 +581,8 @@ std::vector<std::string> UAirBlueprintLib::ListMatchingActors(const UObject *con
 std::vector<msr::airlib::MeshPositionVertexBuffersResponse> UAirBlueprintLib::GetStaticMeshComponents()
 {
     std::vector<msr::airlib::MeshPositionVertexBuffersResponse> meshes;
-    int num_meshes = 0;
     for (TObjectIterator<UStaticMeshComponent> comp; comp; ++comp)
     {
-        *comp;
-
         std::string name = common_utils::Utils::toLower(GetMeshName(*comp));
         //The skybox is ignored here as it is huge, and really is of no use to the end user typically. Also the associated meshes with the cameras
         if (name == "" || common_utils::Utils::startsWith(name, "default_")
@@ -576,108 +592,115 @@ std::vector<msr::airlib::MeshPositionVertexBuffersResponse> UAirBlueprintLib::Ge
             continue;
         }
 
-        //Various checks if there is even a valid mesh
-        if (!comp->GetStaticMesh()) continue;
-        if (!comp->GetStaticMesh()->RenderData) continue;
-        if (comp->GetStaticMesh()->RenderData->LODResources.Num() == 0) continue;
-
         msr::airlib::MeshPositionVertexBuffersResponse mesh;
         mesh.name = name;
+        if (GetStaticMeshComponentBuffers(*comp, comp->GetComponentTransform(), mesh))
+            meshes.push_back(mesh);
+    }
 
-        FVector pos = comp->GetComponentLocation();
-        FQuat att = comp->GetComponentQuat();
-        mesh.position[0] = pos.X;
-        mesh.position[1] = pos.Y;
-        mesh.position[2] = pos.Z;
-        mesh.orientation.w() = att.W;
-        mesh.orientation.x() = att.X;
-        mesh.orientation.y() = att.Y;
-        mesh.orientation.z() = att.Z;
-
-        FPositionVertexBuffer* vertex_buffer = &comp->GetStaticMesh()->RenderData->LODResources[0].VertexBuffers.PositionVertexBuffer;
-        if (vertex_buffer)
-        {
-            const int32 vertex_count = vertex_buffer->VertexBufferRHI->GetSize();
-            TArray<FVector> vertices;
-            vertices.SetNum(vertex_count);
-            FVector* data = vertices.GetData();
+    return meshes;
+}
 
-            ENQUEUE_RENDER_COMMAND(GetVertexBuffer)(
-                [vertex_buffer, data](FRHICommandListImmediate& RHICmdList)
-                {
-                    FVector* indices = (FVector*)RHILockVertexBuffer(vertex_buffer->VertexBufferRHI, 0, vertex_buffer->VertexBufferRHI->GetSize(), RLM_ReadOnly);
-                    memcpy(data, indices, vertex_buffer->VertexBufferRHI->GetSize());
-                    RHIUnlockVertexBuffer(vertex_buffer->VertexBufferRHI);
-                });
+//Reads the vertex and index buffers of LOD 0, vertices are transformed by the given transform
+bool UAirBlueprintLib::GetStaticMeshComponentBuffers(UStaticMeshComponent* comp, const FTransform& transform,
+    msr::airlib::MeshPositionVertexBuffersResponse& mesh)
+{
+    //Various checks if there is even a valid mesh
+    if (!comp->GetStaticMesh()) return false;
+    if (!comp->GetStaticMesh()->RenderData) return false;
+    if (comp->GetStaticMesh()->RenderData->LODResources.Num() == 0) return false;
 
-            FStaticMeshLODResources& lod = comp->GetStaticMesh()->RenderData->LODResources[0];
-            FRawStaticIndexBuffer* IndexBuffer = &lod.IndexBuffer;
-            int num_indices = IndexBuffer->IndexBufferRHI->GetSize() / IndexBuffer->IndexBufferRHI->GetStride();
+    FVector pos = comp->GetComponentLocation();
+    FQuat att = comp->GetComponentQuat();
+    mesh.position[0] = pos.X;
+    mesh.position[1] = pos.Y;
+    mesh.position[2] = pos.Z;
+    mesh.orientation.w() = att.W;
+    mesh.orientation.x() = att.X;
+    mesh.orientation.y() = att.Y;
+    mesh.orientation.z() = att.Z;
 
-            if (IndexBuffer->IndexBufferRHI->GetStride() == 2) {
-                TArray<uint16_t> indices_vec;
-                indices_vec.SetNum(num_indices);
+    FPositionVertexBuffer* vertex_buffer = &comp->GetStaticMesh()->RenderData->LODResources[0].VertexBuffers.PositionVertexBuffer;
+    if (vertex_buffer)
+    {
+        const int32 vertex_count = vertex_buffer->VertexBufferRHI->GetSize();
+        TArray<FVector> vertices;
+        vertices.SetNum(vertex_count);
+        FVector* data = vertices.GetData();
 
-                uint16_t* data_ptr = indices_vec.GetData();
+        ENQUEUE_RENDER_COMMAND(GetVertexBuffer)(
+            [vertex_buffer, data](FRHICommandListImmediate& RHICmdList)
+            {
+                FVector* indices = (FVector*)RHILockVertexBuffer(vertex_buffer->VertexBufferRHI, 0, vertex_buffer->VertexBufferRHI->GetSize(), RLM_ReadOnly);
+                memcpy(data, indices, vertex_buffer->VertexBufferRHI->GetSize());
+                RHIUnlockVertexBuffer(vertex_buffer->VertexBufferRHI);
+            });
 
-                ENQUEUE_RENDER_COMMAND(GetIndexBuffer)(
-                    [IndexBuffer, data_ptr](FRHICommandListImmediate& RHICmdList)
-                    {
-                        uint16_t* indices = (uint16_t*)RHILockIndexBuffer(IndexBuffer->IndexBufferRHI, 0, IndexBuffer->IndexBufferRHI->GetSize(), RLM_ReadOnly);
-                        memcpy(data_ptr, indices, IndexBuffer->IndexBufferRHI->GetSize());
-                        RHIUnlockIndexBuffer(IndexBuffer->IndexBufferRHI);
-                    });
+        FStaticMeshLODResources& lod = comp->GetStaticMesh()->RenderData->LODResources[0];
+        FRawStaticIndexBuffer* IndexBuffer = &lod.IndexBuffer;
+        int num_indices = IndexBuffer->IndexBufferRHI->GetSize() / IndexBuffer->IndexBufferRHI->GetStride();
 
-                //Need to force the render command to go through cause on the next iteration the buffer no longer exists
-                FlushRenderingCommands();
+        if (IndexBuffer->IndexBufferRHI->GetStride() == 2) {
+            TArray<uint16_t> indices_vec;
+            indices_vec.SetNum(num_indices);
 
-                mesh.indices.resize(num_indices);
-                for (int idx = 0; idx < num_indices; ++idx) {
-                    mesh.indices[idx] = indices_vec[idx];
-                }
-            }
+            uint16_t* data_ptr = indices_vec.GetData();
 
-            else { //stride ==4
-                TArray<uint32_t> indices_vec;
-                indices_vec.SetNum(num_indices);
+            ENQUEUE_RENDER_COMMAND(GetIndexBuffer)(
+                [IndexBuffer, data_ptr](FRHICommandListImmediate& RHICmdList)
+                {
+                    uint16_t* indices = (uint16_t*)RHILockIndexBuffer(IndexBuffer->IndexBufferRHI, 0, IndexBuffer->IndexBufferRHI->GetSize(), RLM_ReadOnly);
+                    memcpy(data_ptr, indices, IndexBuffer->IndexBufferRHI->GetSize());
+                    RHIUnlockIndexBuffer(IndexBuffer->IndexBufferRHI);
+                });
 
-                uint32_t* data_ptr = indices_vec.GetData();
+            //Need to force the render command to go through cause on the next iteration the buffer no longer exists
+            FlushRenderingCommands();
 
-                ENQUEUE_RENDER_COMMAND(GetIndexBuffer)(
-                    [IndexBuffer, data_ptr](FRHICommandListImmediate& RHICmdList)
-                    {
-                        uint32_t* indices = (uint32_t*)RHILockIndexBuffer(IndexBuffer->IndexBufferRHI, 0, IndexBuffer->IndexBufferRHI->GetSize(), RLM_ReadOnly);
-                        memcpy(data_ptr, indices, IndexBuffer->IndexBufferRHI->GetSize());
-                        RHIUnlockIndexBuffer(IndexBuffer->IndexBufferRHI);
-                    });
+            mesh.indices.resize(num_indices);
+            for (int idx = 0; idx < num_indices; ++idx) {
+                mesh.indices[idx] = indices_vec[idx];
+            }
+        }
 
-                FlushRenderingCommands();
+        else { //stride ==4
+            TArray<uint32_t> indices_vec;
+            indices_vec.SetNum(num_indices);
 
-                mesh.indices.resize(num_indices);
-                for (int idx = 0; idx < num_indices; ++idx) {
-                    mesh.indices[idx] = indices_vec[idx];
-                }
-            }
+            uint32_t* data_ptr = indices_vec.GetData();
+
+            ENQUEUE_RENDER_COMMAND(GetIndexBuffer)(
+                [IndexBuffer, data_ptr](FRHICommandListImmediate& RHICmdList)
+                {
+                    uint32_t* indices = (uint32_t*)RHILockIndexBuffer(IndexBuffer->IndexBufferRHI, 0, IndexBuffer->IndexBufferRHI->GetSize(), RLM_ReadOnly);
+                    memcpy(data_ptr, indices, IndexBuffer->IndexBufferRHI->GetSize());
+                    RHIUnlockIndexBuffer(IndexBuffer->IndexBufferRHI);
+                });
 
-            //Unreal stores more vertices than triangles. So here we find the highest referenced vertex and ignore any after that
-            auto result_iter = std::max_element(mesh.indices.begin(), mesh.indices.end());
-            auto max_triangle_index = std::distance(mesh.indices.begin(), result_iter);
-
-            mesh.vertices.resize(max_triangle_index * 3);
-            int aligned_index = 0;
-            FTransform transform = comp->GetComponentTransform();
-            for(int vertex_idx=0;vertex_idx<max_triangle_index;++vertex_idx){
-                FVector transformed_vec = pos + transform.TransformVector(vertices[vertex_idx]);
-                mesh.vertices[aligned_index++] = transformed_vec.X;
-                mesh.vertices[aligned_index++] = transformed_vec.Y;
-                mesh.vertices[aligned_index++] = transformed_vec.Z;
+            FlushRenderingCommands();
+
+            mesh.indices.resize(num_indices);
+            for (int idx = 0; idx < num_indices; ++idx) {
+                mesh.indices[idx] = indices_vec[idx];
             }
         }
 
-        meshes.push_back(mesh);
+        //Unreal stores more vertices than triangles. So here we find the highest referenced vertex and ignore any after that
+        if (mesh.indices.size() == 0)
+            return false;
+        int vertex_count_used = static_cast<int>(*std::max_element(mesh.indices.begin(), mesh.indices.end())) + 1;
+
+        mesh.vertices.resize(vertex_count_used * 3);
+        int aligned_index = 0;
+        for(int vertex_idx=0;vertex_idx<vertex_count_used;++vertex_idx){
+            FVector transformed_vec = transform.TransformPosition(vertices[vertex_idx]);
+            mesh.vertices[aligned_index++] = transformed_vec.X;
+            mesh.vertices[aligned_index++] = transformed_vec.Y;
+            mesh.vertices[aligned_index++] = transformed_vec.Z;
+        }
     }
 
-    return meshes;
+    return true;
 }
 
 
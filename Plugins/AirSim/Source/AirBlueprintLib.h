@@ -24,6 +24,7 @@
 #include "common/AirSimSettings.hpp"
 #include <string>
 #include <regex>
+#include <atomic>
 #include "AirBlueprintLib.generated.h"
 
 class ULevelStreamingDynamic;
@@ -112,6 +113,8 @@ public:
         bool is_name_regex = false);
     static int GetMeshStencilID(const std::string& mesh_name);
     static void InitializeMeshStencilIDs(bool ignore_existing);
+    //changes every time a stencil ID is set, so caches of stencil IDs know when to refresh
+    static uint32 GetStencilIDGeneration();
 
     static bool IsInGameThread();
 
@@ -191,6 +194,8 @@ public:
     static IImageWrapperModule* getImageWrapperModule();
     static void CompressImageArray(int32 width, int32 height, const TArray<FColor> &src, TArray<uint8> &dest);
     static std::vector<msr::airlib::MeshPositionVertexBuffersResponse> GetStaticMeshComponents();
+    static bool GetStaticMeshComponentBuffers(UStaticMeshComponent* comp, const FTransform& transform,
+        msr::airlib::MeshPositionVertexBuffersResponse& mesh);
 private:
     template<typename T>
     static void InitializeObjectStencilID(T* mesh, bool ignore_existing = true)
@@ -233,6 +238,7 @@ private:
     template<typename T>
     static void SetObjectStencilID(T* mesh, int object_id)
     {
+        ++stencil_id_generation_;
         if (object_id < 0)
         {
             mesh->SetRenderCustomDepth(false);
@@ -248,6 +254,7 @@ private:
 
     static void SetObjectStencilID(ALandscapeProxy* mesh, int object_id)
     {
+        ++stencil_id_generation_;
         if (object_id < 0)
         {
             mesh->bRenderCustomDepth = false;
@@ -282,6 +289,7 @@ private:
     //FViewPort doesn't expose this field so we are doing dirty work around by maintaining count by ourselves
     static uint32_t flush_on_draw_count_;
     static msr::airlib::AirSimSettings::SegmentationSetting::MeshNamingMethodType mesh_naming_method_;
+    static std::atomic<uint32> stencil_id_generation_;
 
     static IImageWrapperModule* image_wrapper_module_;
 };
@@ -35,6 +35,13 @@ public: //types
     static constexpr char const * kVehicleInertialFrame = "VehicleInertialFrame";
     static constexpr char const * kSensorLocalFrame = "SensorLocalFrame";
 
+    static constexpr char const * kLidarPointFormatXYZ = "XYZ";
+    static constexpr char const * kLidarPointFormatPacked = "Packed";
+    static constexpr char const * kLidarPointFormatPackedQuantized = "PackedQuantized";
+
+    static constexpr char const * kLidarSimulationModeRayTrace = "RayTrace";
+    static constexpr char const * kLidarSimulationModeDepthBuffer = "DepthBuffer";
+
     static constexpr char const * kSimModeTypeMultirotor = "Multirotor";
     static constexpr char const * kSimModeTypeCar = "Car";
     static constexpr char const * kSimModeTypeComputerVision = "ComputerVision";
@@ -59,6 +66,35 @@ public: //types
         float record_interval = 0.05f;
         std::string folder = "";
         bool enabled = false;
+        //write rows as typed binary columns instead of tab separated text
+        bool binary_format = false;
+        //WallClock samples every record_interval real seconds,
+        //SimTime every record_interval simulated seconds and
+        //PhysicsSteps every record_every_n_steps simulation steps; with the last two the
+        //images are rendered after the step the row was taken in and are named after the
+        //simulated time of their own frame, which can be some steps later than the row
+        std::string trigger = "WallClock";
+        unsigned int record_every_n_steps = 1;
+        //staging buffer of the log writer and how often it is handed to the OS, in seconds
+        unsigned int write_buffer_size_kb = 4096;
+        float flush_interval = 1.0f;
+        //disk space reserved up front for the log file, 0 to disable
+        unsigned int preallocate_mb = 0;
+        //None, OnFlush or OnClose
+        std::string sync_policy = "OnClose";
+        //bypass the page cache where the platform supports it
+        bool direct_io = false;
+
+        //black box mode keeps the last pre_trigger_secs of samples in memory and only
+        //writes them out, followed by post_trigger_secs of live recording, when triggered
+        //by a collision, the API or linear acceleration above accel_threshold (0 disables);
+        //samples hold the row, the images and the IMU, barometer, magnetometer, GPS and
+        //distance outputs, plus lidar clouds unless trigger is WallClock (airsim_sensors.txt)
+        bool black_box_enabled = false;
+        float black_box_pre_trigger_secs = 10.0f;
+        float black_box_post_trigger_secs = 5.0f;
+        unsigned int black_box_memory_mb = 512;
+        float black_box_accel_threshold = 0.0f;
 
         std::map<std::string, std::vector<ImageCaptureBase::ImageRequest> > requests;
 
@@ -209,12 +245,23 @@ public: //types
     };
 
     struct DistanceSetting : SensorSetting {
+        // direction of one beam of a rangefinder array, relative to the sensor rotation
+        struct Beam {
+            float yaw = 0;                                // degrees
+            float pitch = 0;                              // degrees
+        };
+
         // shared defaults
         real_T min_distance = 20.0f / 100; //m
         real_T max_distance = 4000.0f / 100; //m
         Vector3r position = VectorMath::nanVector();
         Rotation rotation = Rotation::nanRotation();
         bool draw_debug_points = false;
+
+        // when not empty the sensor is an array measuring along every beam, see UnrealDistanceArraySensor
+        std::vector<Beam> beams;
+        float cone_angle = 0;                             // full cone width of each beam in degrees
+        uint cone_samples = 1;                            // rays per beam, the axis and the rest on the cone edge
     };
 
     struct LidarSetting : SensorSetting {
@@ -234,7 +281,28 @@ public: //types
         Rotation rotation = Rotation::nanRotation();
 
         bool draw_debug_points = false;
+        int draw_debug_points_decimation = 1;             // draw every Nth point of a scan
         std::string data_frame = AirSimSettings::kVehicleInertialFrame;
+
+        // LidarData is always filled, Packed and PackedQuantized also fill the packed cloud of UnrealLidarSensor
+        std::string point_format = AirSimSettings::kLidarPointFormatXYZ;
+        float quantization_resolution = 0.005f;           // meters per unit for PackedQuantized
+
+        // RayTrace traces every point, DepthBuffer samples depth images rendered around the lidar
+        std::string simulation_mode = AirSimSettings::kLidarSimulationModeRayTrace;
+        int depth_views = 4;                              // captures around the lidar in DepthBuffer mode
+        int depth_resolution = 1024;                      // width of each capture in pixels
+
+        // more than 1 also reports geometry that overlaps the Visibility channel in front of the blocking hit
+        int max_returns = 1;
+        // intensity = reflectivity * cos(incidence) * exp(-attenuation * range)
+        float default_reflectivity = 0.5f;
+        float atmospheric_attenuation = 0.001f;           // 1/meters
+        std::map<std::string, float> material_reflectivity; // physical material name -> reflectivity
+
+        // shoot every azimuth from the pose the lidar had at that point of the scan, so points of a
+        // moving lidar are skewed like on a real spinning one
+        bool continuous_sweep = false;
     };
 
     struct VehicleSetting {
@@ -251,6 +319,8 @@ public: //types
         bool enable_trace = false;
         bool enable_collisions = true;
         bool is_fpv_vehicle = false;
+        //process that simulates the vehicle when sharded, -1 spreads vehicles over the shards by name
+        int shard = -1;
 
         //nan means use player start
         Vector3r position = VectorMath::nanVector(); //in global NED
@@ -340,6 +410,26 @@ public: //types
         bool move_sun = true;
     };
 
+    //Each process only simulates, renders and senses its own vehicles; vehicle API calls
+    //go to the process of the vehicle, whose port simGetVehicleApiPort on shard 0 reports
+    struct ShardingSetting {
+        //processes the vehicles are split over, 1 simulates all of them in this process
+        unsigned int shard_count = 1;
+        //this process, from -AirSimShard=<index> on the command line; shard 0 coordinates the others
+        unsigned int shard_index = 0;
+        //Unix socket the shards connect to the coordinator on
+        std::string socket_path = "/tmp/airsim_shards.sock";
+    };
+
+    struct DeterministicSetting {
+        //runs with the same settings and inputs take the same steps
+        bool enabled = false;
+        //random generators are seeded with this instead of an arbitrary value
+        unsigned int seed = 0;
+        //hash of the world state in every physics step is appended to this file, none if empty
+        std::string state_hash_file = "";
+    };
+
 private: //fields
     float settings_version_actual;
     float settings_version_minimum = 1.2f;
@@ -352,6 +442,8 @@ public: //fields
     RecordingSetting recording_setting;
     SegmentationSetting segmentation_setting;
     TimeOfDaySetting tod_setting;
+    ShardingSetting sharding_setting;
+    DeterministicSetting deterministic_setting;
 
     std::vector<std::string> warning_messages;
     std::vector<std::string> error_messages;
@@ -359,6 +451,10 @@ public: //fields
     bool is_record_ui_visible = false;
     int initial_view_mode = 2; //ECameraDirectorMode::CAMERA_DIRECTOR_MODE_FLY_WITH_ME
     bool enable_rpc = true;
+    bool sensor_static_bvh = false; //lidar and distance sensors trace static meshes on their own BVH
+    bool lockstep = false; //simulation only advances on lockstep step calls from the client
+    bool adaptive_clock_speed = false; //ScalableClock is slowed down while the physics loop cannot keep its period
+    bool headless = false; //world is only rendered for image captures, no HUD, messages or debug drawing
     std::string api_server_address = "";
     int api_port = RpcLibPort;
     std::string physics_engine_name = "";
@@ -411,6 +507,8 @@ public: //methods
         loadOtherSettings(settings_json);
         loadDefaultSensorSettings(simmode_name, settings_json, sensor_defaults);
         loadVehicleSettings(simmode_name, settings_json, vehicles);
+        loadShardingSetting(settings_json);
+        loadDeterministicSetting(settings_json);
 
         //this should be done last because it depends on vehicles (and/or their type) we have
         loadRecordingSetting(settings_json);
@@ -624,6 +722,56 @@ private:
         }
     }
 
+    void loadShardingSetting(const Settings& settings_json)
+    {
+        Settings sharding_json;
+        if (settings_json.getChild("Sharding", sharding_json)) {
+            sharding_setting.shard_count = sharding_json.getInt("ShardCount", sharding_setting.shard_count);
+            sharding_setting.socket_path = sharding_json.getString("Socket", sharding_setting.socket_path);
+        }
+
+        if (sharding_setting.shard_count == 0) {
+            error_messages.push_back("Sharding ShardCount must be at least 1");
+            sharding_setting.shard_count = 1;
+        }
+        for (const auto& vehicle : vehicles) {
+            if (vehicle.second->shard >= static_cast<int>(sharding_setting.shard_count))
+                error_messages.push_back("Shard of vehicle " + vehicle.first + " is not below Sharding ShardCount");
+        }
+    }
+
+    void loadDeterministicSetting(const Settings& settings_json)
+    {
+        Settings deterministic_json;
+        if (settings_json.getChild("Deterministic", deterministic_json)) {
+            deterministic_setting.enabled = deterministic_json.getBool("Enabled", deterministic_setting.enabled);
+            deterministic_setting.seed = deterministic_json.getInt("Seed", deterministic_setting.seed);
+            deterministic_setting.state_hash_file = deterministic_json.getString("StateHashFile", deterministic_setting.state_hash_file);
+        }
+
+        if (deterministic_setting.enabled && !lockstep)
+            warning_messages.push_back("Deterministic without Lockstep: API calls and collisions reach physics in steps that depend on timing");
+    }
+
+    //true if the vehicle is simulated by this process; vehicles without a Shard
+    //go round robin in name order, so every shard comes to the same split
+    bool isVehicleInShard(const VehicleSetting& vehicle_setting) const
+    {
+        if (sharding_setting.shard_count <= 1)
+            return true;
+        if (vehicle_setting.shard >= 0)
+            return static_cast<unsigned int>(vehicle_setting.shard) == sharding_setting.shard_index;
+
+        unsigned int position = 0;
+        for (const auto& vehicle : vehicles) {
+            if (vehicle.second.get() == &vehicle_setting)
+                break;
+            if (vehicle.second->shard < 0)
+                ++position;
+        }
+        return position % sharding_setting.shard_count == sharding_setting.shard_index;
+    }
+
     void loadRecordingSetting(const Settings& settings_json)
     {
         loadDefaultRecordingSettings();
@@ -634,6 +782,27 @@ private:
             recording_setting.record_interval = recording_json.getFloat("RecordInterval", recording_setting.record_interval);
             recording_setting.folder = recording_json.getString("Folder", recording_setting.folder);
             recording_setting.enabled = recording_json.getBool("Enabled", recording_setting.enabled);
+            recording_setting.binary_format = recording_json.getBool("BinaryFormat", recording_setting.binary_format);
+            recording_setting.trigger = recording_json.getString("Trigger", recording_setting.trigger);
+            recording_setting.record_every_n_steps = recording_json.getInt("RecordEveryNSteps", recording_setting.record_every_n_steps);
+            recording_setting.write_buffer_size_kb = recording_json.getInt("WriteBufferSizeKB", recording_setting.write_buffer_size_kb);
+            recording_setting.flush_interval = recording_json.getFloat("FlushInterval", recording_setting.flush_interval);
+            recording_setting.preallocate_mb = recording_json.getInt("PreallocateMB", recording_setting.preallocate_mb);
+            recording_setting.sync_policy = recording_json.getString("SyncPolicy", recording_setting.sync_policy);
+            recording_setting.direct_io = recording_json.getBool("DirectIO", recording_setting.direct_io);
+
+            Settings black_box_json;
+            if (recording_json.getChild("BlackBox", black_box_json)) {
+                recording_setting.black_box_enabled = black_box_json.getBool("Enabled", true);
+                recording_setting.black_box_pre_trigger_secs = black_box_json.getFloat("PreTriggerSeconds",
+                    recording_setting.black_box_pre_trigger_secs);
+                recording_setting.black_box_post_trigger_secs = black_box_json.getFloat("PostTriggerSeconds",
+                    recording_setting.black_box_post_trigger_secs);
+                recording_setting.black_box_memory_mb = black_box_json.getInt("MemoryBudgetMB",
+                    recording_setting.black_box_memory_mb);
+                recording_setting.black_box_accel_threshold = black_box_json.getFloat("AccelerationThreshold",
+                    recording_setting.black_box_accel_threshold);
+            }
 
             Settings req_cameras_settings;
             if (recording_json.getChild("Cameras", req_cameras_settings)) {
@@ -805,6 +974,7 @@ private:
             vehicle_setting->enable_collisions);
         vehicle_setting->is_fpv_vehicle = settings_json.getBool("IsFpvVehicle",
             vehicle_setting->is_fpv_vehicle);
+        vehicle_setting->shard = settings_json.getInt("Shard", vehicle_setting->shard);
 
         loadRCSetting(simmode_name, settings_json, vehicle_setting->rc);
 
@@ -1099,10 +1269,23 @@ private:
         is_record_ui_visible = settings_json.getBool("RecordUIVisible", true);
         engine_sound = settings_json.getBool("EngineSound", false);
         enable_rpc = settings_json.getBool("EnableRpc", enable_rpc);
+        sensor_static_bvh = settings_json.getBool("SensorStaticBVH", sensor_static_bvh);
+        lockstep = settings_json.getBool("Lockstep", lockstep);
+        adaptive_clock_speed = settings_json.getBool("AdaptiveClockSpeed", adaptive_clock_speed);
         speed_unit_factor = settings_json.getFloat("SpeedUnitFactor", 1.0f);
         speed_unit_label = settings_json.getString("SpeedUnitLabel", "m\\s");
         log_messages_visible = settings_json.getBool("LogMessagesVisible", true);
 
+        //view mode and subwindows are loaded before, headless overrides them
+        headless = settings_json.getBool("Headless", headless);
+        if (headless) {
+            initial_view_mode = 6; // ECameraDirectorMode::CAMREA_DIRECTOR_MODE_NODISPLAY;
+            log_messages_visible = false;
+            is_record_ui_visible = false;
+            for (auto& subwindow_setting : subwindow_settings)
+                subwindow_setting.visible = false;
+        }
+
         {   //load origin geopoint
             Settings origin_geopoint_json;
             if (settings_json.getChild("OriginGeopoint", origin_geopoint_json)) {
@@ -1177,7 +1360,17 @@ private:
     {
         clock_type = settings_json.getString("ClockType", "");
 
-        if (clock_type == "") {
+        if (deterministic_setting.enabled && clock_type != "SteppableClock") {
+            //a clock following wall time would advance by different steps in every run
+            if (clock_type != "")
+                warning_messages.push_back("Deterministic runs with SteppableClock instead of " + clock_type);
+            clock_type = "SteppableClock";
+        }
+        else if (clock_type == "" && lockstep) {
+            //every lockstep tick advances the clock by the same fixed step
+            clock_type = "SteppableClock";
+        }
+        else if (clock_type == "") {
             //default value
             clock_type = "ScalableClock";
 
@@ -1200,6 +1393,9 @@ private:
         }
 
         clock_speed = settings_json.getFloat("ClockSpeed", 1.0f);
+
+        if (lockstep && clock_type != "SteppableClock")
+            warning_messages.push_back("Lockstep with " + clock_type + " does not advance the same simulated time on every step");
     }
 
     static void initializeBarometerSetting(BarometerSetting& barometer_setting, const Settings& settings_json)
@@ -1239,6 +1435,24 @@ private:
         distance_setting.min_distance = settings_json.getFloat("MinDistance", distance_setting.min_distance);
         distance_setting.max_distance = settings_json.getFloat("MaxDistance", distance_setting.max_distance);
         distance_setting.draw_debug_points = settings_json.getBool("DrawDebugPoints", distance_setting.draw_debug_points);
+        distance_setting.cone_angle = settings_json.getFloat("ConeAngle", distance_setting.cone_angle);
+        const int cone_samples = settings_json.getInt("ConeSamples", static_cast<int>(distance_setting.cone_samples));
+        if (cone_samples < 1)
+            throw std::invalid_argument(Utils::stringf("ConeSamples must be at least 1 in settings_json, got %d", cone_samples));
+        distance_setting.cone_samples = static_cast<uint>(cone_samples);
+
+        Settings beams_json;
+        if (settings_json.getChild("Beams", beams_json)) {
+            for (size_t child_index = 0; child_index < beams_json.size(); ++child_index) {
+                Settings beam_json;
+                if (beams_json.getChild(child_index, beam_json)) {
+                    DistanceSetting::Beam beam;
+                    beam.yaw = beam_json.getFloat("Yaw", beam.yaw);
+                    beam.pitch = beam_json.getFloat("Pitch", beam.pitch);
+                    distance_setting.beams.push_back(beam);
+                }
+            }
+        }
 
         distance_setting.position = createVectorSetting(settings_json, distance_setting.position);
         distance_setting.rotation = createRotationSetting(settings_json, distance_setting.rotation);
@@ -1251,7 +1465,25 @@ private:
         lidar_setting.points_per_second = settings_json.getInt("PointsPerSecond", lidar_setting.points_per_second);
         lidar_setting.horizontal_rotation_frequency = settings_json.getInt("RotationsPerSecond", lidar_setting.horizontal_rotation_frequency);
         lidar_setting.draw_debug_points = settings_json.getBool("DrawDebugPoints", lidar_setting.draw_debug_points);
+        lidar_setting.draw_debug_points_decimation = settings_json.getInt("DrawDebugPointsDecimation", lidar_setting.draw_debug_points_decimation);
         lidar_setting.data_frame = settings_json.getString("DataFrame", lidar_setting.data_frame);
+        lidar_setting.point_format = settings_json.getString("PointFormat", lidar_setting.point_format);
+        lidar_setting.quantization_resolution = settings_json.getFloat("QuantizationResolution", lidar_setting.quantization_resolution);
+        lidar_setting.simulation_mode = settings_json.getString("SimulationMode", lidar_setting.simulation_mode);
+        lidar_setting.depth_views = settings_json.getInt("DepthViews", lidar_setting.depth_views);
+        lidar_setting.depth_resolution = settings_json.getInt("DepthResolution", lidar_setting.depth_resolution);
+        lidar_setting.max_returns = settings_json.getInt("MaxReturns", lidar_setting.max_returns);
+        lidar_setting.continuous_sweep = settings_json.getBool("ContinuousSweep", lidar_setting.continuous_sweep);
+        lidar_setting.default_reflectivity = settings_json.getFloat("DefaultReflectivity", lidar_setting.default_reflectivity);
+        lidar_setting.atmospheric_attenuation = settings_json.getFloat("AtmosphericAttenuation", lidar_setting.atmospheric_attenuation);
+
+        Settings reflectivity_json;
+        if (settings_json.getChild("MaterialReflectivity", reflectivity_json)) {
+            std::vector<std::string> material_names;
+            reflectivity_json.getChildNames(material_names);
+            for (const auto& material_name : material_names)
+                lidar_setting.material_reflectivity[material_name] = reflectivity_json.getFloat(material_name, lidar_setting.default_reflectivity);
+        }
 
         lidar_setting.vertical_FOV_upper = settings_json.getFloat("VerticalFOVUpper", lidar_setting.vertical_FOV_upper);
         lidar_setting.vertical_FOV_lower = settings_json.getFloat("VerticalFOVLower", lidar_setting.vertical_FOV_lower);
@@ -0,0 +1,131 @@
+#include "CoreMinimal.h"
+#include "HAL/IConsoleManager.h"
+#include "HAL/PlatformTime.h"
+#include "Async/Async.h"
+#include "EngineUtils.h"
+#include "Engine/World.h"
+#include "AirBlueprintLib.h"
+#include "GameThreadCommandQueue.h"
+#include "SimMode/SimModeBase.h"
+#include "WorldSimApi.h"
+#include <atomic>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+//Console command measuring how many setter calls per second the API threads get through
+//to the game thread. Client threads set the pose of one scene object to the pose it has,
+//through a task graph task per call as the setters did before, through WorldSimApi::setObjectPose,
+//which queues on GameThreadCommandQueue, and through WorldSimApi::setObjectPoses in batches.
+//It runs on its own threads while the simulation keeps going; keep the simulation running
+//until the results are logged.
+//  AirSim.Bench.SetterCalls [object name] [calls per thread] [threads] [batch size]
+
+namespace {
+    const int32 kDefaultCallsPerThread = 2000;
+    const int32 kDefaultThreads = 4;
+    const int32 kDefaultBatchSize = 50;
+
+    std::atomic<bool> is_running{ false };
+
+    struct SetterRun {
+        WorldSimApi* world_sim_api = nullptr;
+        std::string object_name;
+        WorldSimApi::Pose pose;
+        int32 calls_per_thread = 0;
+        int32 threads = 0;
+        int32 batch_size = 0;
+    };
+
+    //runs call on every client thread calls_per_thread times and logs the calls/s of all of them
+    void timeCalls(const TCHAR* name, const SetterRun& run, const std::function<void(int32 calls)>& call)
+    {
+        const uint64 start = FPlatformTime::Cycles64();
+        std::vector<std::thread> clients;
+        for (int32 i = 0; i < run.threads; ++i)
+            clients.emplace_back(call, run.calls_per_thread);
+        for (std::thread& client : clients)
+            client.join();
+
+        const double seconds = FPlatformTime::ToSeconds64(FPlatformTime::Cycles64() - start);
+        const int64 calls = static_cast<int64>(run.calls_per_thread) * run.threads;
+        UE_LOG(LogTemp, Display, TEXT("AirSim.Bench.SetterCalls %s: %lld calls from %d threads in %.3f s, %.0f calls/s"),
+            name, calls, run.threads, seconds, seconds > 0 ? calls / seconds : 0.0);
+    }
+
+    void runSetterCalls(const SetterRun run)
+    {
+        //a task per call, waited for, as UAirBlueprintLib::RunCommandOnGameThread dispatched each setter;
+        //setObjectPose runs right away on the game thread
+        timeCalls(TEXT("task per call"), run, [&run](int32 calls) {
+            for (int32 i = 0; i < calls; ++i) {
+                UAirBlueprintLib::RunCommandOnGameThread([&run]() {
+                    run.world_sim_api->setObjectPose(run.object_name, run.pose, true);
+                }, true);
+            }
+        });
+
+        timeCalls(TEXT("setObjectPose"), run, [&run](int32 calls) {
+            for (int32 i = 0; i < calls; ++i)
+                run.world_sim_api->setObjectPose(run.object_name, run.pose, true);
+        });
+
+        timeCalls(TEXT("setObjectPoses"), run, [&run](int32 calls) {
+            const std::vector<std::string> names(run.batch_size, run.object_name);
+            const std::vector<WorldSimApi::Pose> poses(run.batch_size, run.pose);
+            for (int32 i = 0; i < calls; i += run.batch_size)
+                run.world_sim_api->setObjectPoses(names, poses, true);
+        });
+
+        is_running = false;
+    }
+
+    void benchSetterCalls(const TArray<FString>& args, UWorld* world)
+    {
+        ASimModeBase* sim_mode = nullptr;
+        if (world != nullptr) {
+            for (TActorIterator<ASimModeBase> it(world); it; ++it) {
+                if (it->HasActorBegunPlay()) {
+                    sim_mode = *it;
+                    break;
+                }
+            }
+        }
+        if (sim_mode == nullptr || sim_mode->GetApiProvider() == nullptr) {
+            UE_LOG(LogTemp, Warning, TEXT("AirSim.Bench.SetterCalls needs a running simulation"));
+            return;
+        }
+
+        SetterRun run;
+        run.world_sim_api = static_cast<WorldSimApi*>(sim_mode->GetApiProvider()->getWorldSimApi());
+        if (args.Num() > 0)
+            run.object_name = TCHAR_TO_UTF8(*args[0]);
+        else if (sim_mode->SceneObjectMap.Num() > 0)
+            run.object_name = TCHAR_TO_UTF8(*sim_mode->SceneObjectMap.CreateConstIterator().Key());
+        run.calls_per_thread = args.Num() > 1 ? FMath::Max(1, FCString::Atoi(*args[1])) : kDefaultCallsPerThread;
+        run.threads = args.Num() > 2 ? FMath::Clamp(FCString::Atoi(*args[2]), 1, 64) : kDefaultThreads;
+        run.batch_size = args.Num() > 3 ? FMath::Max(1, FCString::Atoi(*args[3])) : kDefaultBatchSize;
+
+        //on the game thread getObjectPose runs right away
+        run.pose = run.world_sim_api->getObjectPose(run.object_name);
+        if (run.object_name.empty() || run.pose.position.hasNaN()) {
+            UE_LOG(LogTemp, Warning, TEXT("AirSim.Bench.SetterCalls: no scene object %s"), UTF8_TO_TCHAR(run.object_name.c_str()));
+            return;
+        }
+
+        if (is_running.exchange(true)) {
+            UE_LOG(LogTemp, Warning, TEXT("AirSim.Bench.SetterCalls is already running"));
+            return;
+        }
+
+        //the client threads wait on the game thread, which must keep ticking meanwhile
+        Async(EAsyncExecution::Thread, [run]() { runSetterCalls(run); });
+    }
+
+    FAutoConsoleCommand bench_setter_calls_command(
+        TEXT("AirSim.Bench.SetterCalls"),
+        TEXT("Sets the pose of a scene object from API like threads with a task per call, with setObjectPose and with ")
+        TEXT("setObjectPoses batches, logging calls/s. Args: [object name] [calls per thread] [threads] [batch size]"),
+        FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&benchSetterCalls));
+}
@@ -0,0 +1,157 @@
+#include "GameThreadCommandQueue.h"
+#include "AirBlueprintLib.h"
+#include "Misc/CoreDelegates.h"
+#include "HAL/PlatformTime.h"
+
+std::mutex GameThreadCommandQueue::mutex_;
+std::vector<GameThreadCommandQueue::Command> GameThreadCommandQueue::pending_;
+std::vector<std::shared_ptr<std::promise<void>>> GameThreadCommandQueue::pending_fences_;
+bool GameThreadCommandQueue::is_running_ = false;
+FDelegateHandle GameThreadCommandQueue::begin_frame_handle_;
+double GameThreadCommandQueue::window_start_ = 0;
+uint64_t GameThreadCommandQueue::window_commands_ = 0;
+uint64_t GameThreadCommandQueue::window_drains_ = 0;
+std::mutex GameThreadCommandQueue::stats_mutex_;
+GameThreadCommandQueue::Stats GameThreadCommandQueue::stats_;
+
+void GameThreadCommandQueue::initialize()
+{
+    check(IsInGameThread());
+
+    {
+        std::lock_guard<std::mutex> lock(stats_mutex_);
+        stats_ = Stats();
+    }
+    window_start_ = FPlatformTime::Seconds();
+    window_commands_ = 0;
+    window_drains_ = 0;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!is_running_) {
+        begin_frame_handle_ = FCoreDelegates::OnBeginFrame.AddStatic(&GameThreadCommandQueue::drain);
+        is_running_ = true;
+    }
+}
+
+void GameThreadCommandQueue::shutdown()
+{
+    check(IsInGameThread());
+
+    std::vector<Command> dropped;
+    std::vector<std::shared_ptr<std::promise<void>>> fences;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (is_running_) {
+            FCoreDelegates::OnBeginFrame.Remove(begin_frame_handle_);
+            is_running_ = false;
+        }
+        dropped.swap(pending_);
+        fences.swap(pending_fences_);
+    }
+
+    //the fence commands will never run, their waiters are released here
+    for (const auto& fence : fences)
+        fence->set_value();
+}
+
+void GameThreadCommandQueue::push(Command command)
+{
+    if (IsInGameThread()) {
+        //after what other threads queued, to keep the order
+        drain();
+        command();
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (is_running_)
+        pending_.push_back(MoveTemp(command));
+    else {
+        //no frames to run it in, e.g. before BeginPlay
+        lock.unlock();
+        UAirBlueprintLib::RunCommandOnGameThread(MoveTemp(command), false);
+    }
+}
+
+void GameThreadCommandQueue::run(std::vector<Command>&& commands)
+{
+    if (IsInGameThread()) {
+        drain();
+        for (Command& command : commands)
+            command();
+        return;
+    }
+
+    std::shared_ptr<std::promise<void>> done = std::make_shared<std::promise<void>>();
+    std::future<void> done_future = done->get_future();
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (!is_running_) {
+            lock.unlock();
+            UAirBlueprintLib::RunCommandOnGameThread([&commands]() {
+                for (Command& command : commands)
+                    command();
+            }, true);
+            return;
+        }
+
+        for (Command& command : commands)
+            pending_.push_back(MoveTemp(command));
+        pending_.push_back([done]() { done->set_value(); });
+        pending_fences_.push_back(done);
+    }
+
+    //also returns when shutdown drops the commands
+    done_future.wait();
+}
+
+void GameThreadCommandQueue::run(Command command)
+{
+    std::vector<Command> commands;
+    commands.push_back(MoveTemp(command));
+    run(MoveTemp(commands));
+}
+
+void GameThreadCommandQueue::fence()
+{
+    run(std::vector<Command>());
+}
+
+GameThreadCommandQueue::Stats GameThreadCommandQueue::getStats()
+{
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    return stats_;
+}
+
+void GameThreadCommandQueue::drain()
+{
+    std::vector<Command> commands;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        commands.swap(pending_);
+        //the fences among the commands release their waiters when they run
+        pending_fences_.clear();
+    }
+
+    for (Command& command : commands)
+        command();
+
+    const double now = FPlatformTime::Seconds();
+    const double window_seconds = now - window_start_;
+    window_commands_ += commands.size();
+    if (commands.size() > 0)
+        ++window_drains_;
+
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    stats_.commands += commands.size();
+    if (commands.size() > 0)
+        ++stats_.drains;
+
+    if (window_seconds >= WindowSeconds) {
+        stats_.commands_per_second = window_commands_ / window_seconds;
+        stats_.commands_per_drain = window_drains_ > 0 ? static_cast<double>(window_commands_) / window_drains_ : 0;
+        window_start_ = now;
+        window_commands_ = 0;
+        window_drains_ = 0;
+    }
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+//Commands for the game thread from the API threads, run together once per frame.
+//UAirBlueprintLib::RunCommandOnGameThread dispatches a task graph task for every
+//call and the caller waits for each one, so setting the poses of 50 objects takes
+//50 round trips to the game thread. Here commands are only appended to a list
+//that the game thread runs through at the start of the next frame; a caller that
+//needs the result waits once, on a fence, after queuing all of its commands.
+//Commands run in the order they were queued.
+class GameThreadCommandQueue {
+public:
+    typedef TFunction<void()> Command;
+
+    struct Stats {
+        uint64_t commands = 0;              //commands run since initialize, fences included
+        uint64_t drains = 0;                //frames that ran at least one command
+        double commands_per_second = 0;     //in the last window
+        double commands_per_drain = 0;      //in the last window
+    };
+
+public:
+    //game thread: starts running commands every frame, until shutdown
+    static void initialize();
+    //game thread: commands not run yet are dropped and their waiters released
+    static void shutdown();
+
+    //any thread: runs the command at the start of the next frame without waiting for it;
+    //runs it right away on the game thread
+    static void push(Command command);
+    //any thread: runs the commands at the start of the next frame and returns once
+    //they did, one round trip for all of them
+    static void run(std::vector<Command>&& commands);
+    static void run(Command command);
+    //any thread: returns once everything queued before has run
+    static void fence();
+
+    static Stats getStats();
+
+private:
+    static void drain();
+
+private:
+    //stats are taken over windows this long
+    static constexpr double WindowSeconds = 1.0;
+
+    static std::mutex mutex_;
+    static std::vector<Command> pending_;
+    //promises of the waiters in run whose fence is in pending_, released by shutdown
+    static std::vector<std::shared_ptr<std::promise<void>>> pending_fences_;
+    static bool is_running_;
+    static FDelegateHandle begin_frame_handle_;
+
+    //game thread only
+    static double window_start_;
+    static uint64_t window_commands_;
+    static uint64_t window_drains_;
+
+    static std::mutex stats_mutex_;
+    static Stats stats_;
+};
@@ -5,6 +5,8 @@
 #include "Camera/CameraComponent.h"
 
 #include "AirBlueprintLib.h"
+#include "GameThreadCommandQueue.h"
+#include "Recording/RecordingThread.h"
 #include "common/ClockFactory.hpp"
 #include "PIPCamera.h"
 #include "NedTransform.h"
@@ -13,6 +15,11 @@
 #include "Materials/MaterialParameterCollectionInstance.h"
 #include "DrawDebugHelpers.h"
 
+namespace {
+    //a gap between hits longer than this means the vehicle separated from what it hit
+    constexpr msr::airlib::TTimeDelta kCollisionSeparationSecs = 0.5;
+}
+
 PawnSimApi::PawnSimApi(const Params& params)
     : params_(params), ned_transform_(params.pawn, *params.global_transform)
 {
@@ -152,17 +159,27 @@ void PawnSimApi::onCollision(class UPrimitiveComponent* MyComp, class AActor* Ot
 
     UPrimitiveComponent* comp = Cast<class UPrimitiveComponent>(Other ? (Other->GetRootComponent() ? Other->GetRootComponent() : nullptr) : nullptr);
 
+    //hits are reported every frame while in contact, a new collision is the first hit with
+    //another object or the first after the vehicle has been clear for a while
+    const msr::airlib::TTimePoint time_stamp = msr::airlib::ClockFactory::get()->nowNanos();
+    const std::string object_name = std::string(Other ? TCHAR_TO_UTF8(*(Other->GetName())) : "(null)");
+    const bool is_new_collision = !state_.collision_info.has_collided
+        || object_name != state_.collision_info.object_name
+        || msr::airlib::ClockFactory::get()->elapsedBetween(time_stamp, state_.collision_info.time_stamp) > kCollisionSeparationSecs;
+
     state_.collision_info.has_collided = true;
     state_.collision_info.normal = Vector3r(Hit.ImpactNormal.X, Hit.ImpactNormal.Y, - Hit.ImpactNormal.Z);
     state_.collision_info.impact_point = ned_transform_.toLocalNed(Hit.ImpactPoint);
     state_.collision_info.position = ned_transform_.toLocalNed(getUUPosition());
     state_.collision_info.penetration_depth = ned_transform_.toNed(Hit.PenetrationDepth);
-    state_.collision_info.time_stamp = msr::airlib::ClockFactory::get()->nowNanos();
-    state_.collision_info.object_name = std::string(Other ? TCHAR_TO_UTF8(*(Other->GetName())) : "(null)");
+    state_.collision_info.time_stamp = time_stamp;
+    state_.collision_info.object_name = object_name;
     state_.collision_info.object_id = comp ? comp->CustomDepthStencilValue : -1;
 
     ++state_.collision_info.collision_count;
 
+    if (is_new_collision && FRecordingThread::isBlackBoxEnabled())
+        FRecordingThread::triggerBlackBox("collision of " + getVehicleName() + " with " + object_name);
 
     UAirBlueprintLib::LogMessageString("Collision", Utils::stringf("#%d with %s - ObjID %d", 
         state_.collision_info.collision_count, 
@@ -318,25 +335,6 @@ void PawnSimApi::reportState(msr::airlib::StateReporter& reporter)
     reporter.writeValue("unreal pos", Vector3r(unrealPosition.X, unrealPosition.Y, unrealPosition.Z));
 }
 
-//void playBack()
-//{
-    //if (params_.pawn->GetRootPrimitiveComponent()->IsAnySimulatingPhysics()) {
-    //    params_.pawn->GetRootPrimitiveComponent()->SetSimulatePhysics(false);
-    //    params_.pawn->GetRootPrimitiveComponent()->SetSimulatePhysics(true);
-    //}
-    //TODO: refactor below code used for playback
-    //std::ifstream sim_log("C:\\temp\\mavlogs\\circle\\sim_cmd_006_orbit 5 1.txt.pos.txt");
-    //plot(sim_log, FColor::Purple, Vector3r(0, 0, -3));
-    //std::ifstream real_log("C:\\temp\\mavlogs\\circle\\real_cmd_006_orbit 5 1.txt.pos.txt");
-    //plot(real_log, FColor::Yellow, Vector3r(0, 0, -3));
-
-    //std::ifstream sim_log("C:\\temp\\mavlogs\\square\\sim_cmd_005_square 5 1.txt.pos.txt");
-    //plot(sim_log, FColor::Purple, Vector3r(0, 0, -3));
-    //std::ifstream real_log("C:\\temp\\mavlogs\\square\\real_cmd_012_square 5 1.txt.pos.txt");
-    //plot(real_log, FColor::Yellow, Vector3r(0, 0, -3));
-//}
-
-
 PawnSimApi::CollisionInfo PawnSimApi::getCollisionInfo() const
 {
     return state_.collision_info;
@@ -412,27 +410,41 @@ msr::airlib::CameraInfo PawnSimApi::getCameraInfo(const std::string& camera_name
 
 void PawnSimApi::setCameraPose(const std::string& camera_name, const msr::airlib::Pose& pose)
 {
-    UAirBlueprintLib::RunCommandOnGameThread([this, camera_name, pose]() {
+    GameThreadCommandQueue::run([this, &camera_name, &pose]() {
         APIPCamera* camera = getCamera(camera_name);
         FTransform pose_unreal = ned_transform_.fromRelativeNed(pose);
         camera->setCameraPose(pose_unreal);
-    }, true);
+    });
+}
+
+void PawnSimApi::setCameraPoses(const std::vector<std::string>& camera_names, const std::vector<Pose>& poses)
+{
+    if (camera_names.size() != poses.size())
+        throw std::invalid_argument("setCameraPoses needs one pose for every camera");
+
+    GameThreadCommandQueue::run([this, &camera_names, &poses]() {
+        for (size_t i = 0; i < camera_names.size(); ++i) {
+            APIPCamera* camera = getCamera(camera_names[i]);
+            if (camera)
+                camera->setCameraPose(ned_transform_.fromRelativeNed(poses[i]));
+        }
+    });
 }
 
 void PawnSimApi::setCameraFoV(const std::string& camera_name, float fov_degrees)
 {
-    UAirBlueprintLib::RunCommandOnGameThread([this, camera_name, fov_degrees]() {
+    GameThreadCommandQueue::run([this, &camera_name, fov_degrees]() {
         APIPCamera* camera = getCamera(camera_name);
         camera->setCameraFoV(fov_degrees);
-    }, true);
+    });
 }
 
 void PawnSimApi::setDistortionParam(const std::string& camera_name, const std::string& param_name, float value)
 {
-    UAirBlueprintLib::RunCommandOnGameThread([this, camera_name, param_name, value]() {
+    GameThreadCommandQueue::run([this, &camera_name, &param_name, value]() {
         APIPCamera* camera = getCamera(camera_name);
         camera->distortion_param_instance_->SetScalarParameterValue(FName(param_name.c_str()), value);
-    }, true);
+    });
 }
 
 std::vector<float> PawnSimApi::getDistortionParams(const std::string& camera_name)
@@ -465,9 +477,9 @@ PawnSimApi::Pose PawnSimApi::toPose(const FVector& u_position, const FQuat& u_qu
 
 void PawnSimApi::setPose(const Pose& pose, bool ignore_collision)
 {
-    UAirBlueprintLib::RunCommandOnGameThread([this, pose, ignore_collision]() {
+    GameThreadCommandQueue::run([this, &pose, ignore_collision]() {
         setPoseInternal(pose, ignore_collision);
-    }, true);
+    });
 }
 
 void PawnSimApi::setPoseInternal(const Pose& pose, bool ignore_collision)
@@ -558,6 +570,17 @@ void PawnSimApi::updateRendering(float dt)
     //no default action in this base class
 }
 
+bool PawnSimApi::isRenderedStatePublished() const
+{
+    //kinematics are read from the pawn in updateRenderedState
+    return false;
+}
+
+void PawnSimApi::publishRenderedState()
+{
+    //nothing published by default
+}
+
 const msr::airlib::Kinematics::State* PawnSimApi::getGroundTruthKinematics() const
 {
     return & kinematics_->getState();
@@ -581,17 +604,27 @@ std::string PawnSimApi::getRecordFileLine(bool is_header_line) const
         return "VehicleName\tTimeStamp\tPOS_X\tPOS_Y\tPOS_Z\tQ_W\tQ_X\tQ_Y\tQ_Z\t";
     }
 
+    RecordLineBuffer& buffer = RecordLineBuffer::threadLocal();
+    buffer.reset(RecordLineBuffer::Format::Text);
+    appendRecordFileLine(buffer);
+
+    return buffer.str();
+}
+
+void PawnSimApi::appendRecordFileLine(RecordLineBuffer& buffer) const
+{
     const auto* kinematics = getGroundTruthKinematics();
     const uint64_t timestamp_millis = static_cast<uint64_t>(clock()->nowNanos() / 1.0E6);
 
-    std::ostringstream ss;
-    ss << getVehicleName() << "\t";
-    ss << timestamp_millis << "\t";
-    ss << kinematics->pose.position.x() << "\t" << kinematics->pose.position.y() << "\t" << kinematics->pose.position.z() << "\t";
-    ss << kinematics->pose.orientation.w() << "\t" << kinematics->pose.orientation.x() << "\t"
-        << kinematics->pose.orientation.y() << "\t" << kinematics->pose.orientation.z() << "\t";
-
-    return ss.str();
+    buffer.appendColumn(getVehicleName());
+    buffer.appendColumn(timestamp_millis);
+    buffer.appendColumn(kinematics->pose.position.x());
+    buffer.appendColumn(kinematics->pose.position.y());
+    buffer.appendColumn(kinematics->pose.position.z());
+    buffer.appendColumn(kinematics->pose.orientation.w());
+    buffer.appendColumn(kinematics->pose.orientation.x());
+    buffer.appendColumn(kinematics->pose.orientation.y());
+    buffer.appendColumn(kinematics->pose.orientation.z());
 }
 
 msr::airlib::VehicleApiBase* PawnSimApi::getVehicleApiBase() const
@@ -18,6 +18,7 @@
 #include "api/VehicleApiBase.hpp"
 #include "api/VehicleSimApiBase.hpp"
 #include "common/common_utils/UniqueValueMap.hpp"
+#include "Recording/RecordLineBuffer.h"
 
 
 #include "PawnEvents.h"
@@ -78,6 +79,8 @@ public: //implementation of VehicleSimApiBase
     virtual void setPose(const Pose& pose, bool ignore_collision) override;
     virtual msr::airlib::CameraInfo getCameraInfo(const std::string& camera_name) const override;
     virtual void setCameraPose(const std::string& camera_name, const Pose& pose) override;
+    //one round trip to the game thread for all cameras, see GameThreadCommandQueue
+    void setCameraPoses(const std::vector<std::string>& camera_names, const std::vector<Pose>& poses);
     virtual void setCameraFoV(const std::string& camera_name, float fov_degrees) override;
     virtual void setDistortionParam(const std::string& camera_name, const std::string& param_name, float value) override;
     virtual std::vector<float> getDistortionParams(const std::string& camera_name) override;
@@ -101,6 +104,16 @@ public: //implementation of VehicleSimApiBase
 
 	virtual msr::airlib::VehicleApiBase* getVehicleApiBase() const;
 
+    //appends the columns of getRecordFileLine(false) to buffer without building intermediate strings
+    virtual void appendRecordFileLine(RecordLineBuffer& buffer) const;
+
+    //true if updateRenderedState only reads what the physics thread published after its
+    //last step, so the game thread does not have to lock the physics world for it
+    virtual bool isRenderedStatePublished() const;
+    //publishes the state outside of a physics step, e.g. once physics is paused;
+    //the physics world must be locked
+    virtual void publishRenderedState();
+
 protected: //additional interface for derived class
     virtual void pawnTick(float dt);
     void setPoseInternal(const Pose& pose, bool ignore_collision);
@@ -0,0 +1,190 @@
+#include "RecordLineBuffer.h"
+#include <cstdio>
+#include <cstring>
+
+namespace {
+    //enough for the longest %g output of a double plus terminator
+    constexpr size_t kMaxNumberChars = 32;
+    constexpr size_t kRowLengthPrefixSize = sizeof(uint32_t);
+    constexpr size_t kInitialCapacity = 512;
+}
+
+RecordLineBuffer& RecordLineBuffer::threadLocal()
+{
+    static thread_local RecordLineBuffer buffer;
+    return buffer;
+}
+
+void RecordLineBuffer::reset(Format format)
+{
+    if (buffer_.size() < kInitialCapacity)
+        buffer_.resize(kInitialCapacity);
+
+    format_ = format;
+    size_ = 0;
+
+    //placeholder for the row length, patched in finishRow
+    if (format_ == Format::Binary)
+        grow(kRowLengthPrefixSize);
+}
+
+void RecordLineBuffer::finishRow()
+{
+    if (format_ == Format::Text) {
+        *grow(1) = '\n';
+    }
+    else {
+        const uint32_t row_length = static_cast<uint32_t>(size_ - kRowLengthPrefixSize);
+        std::memcpy(buffer_.data(), &row_length, kRowLengthPrefixSize);
+    }
+}
+
+uint8_t* RecordLineBuffer::grow(size_t count)
+{
+    if (size_ + count > buffer_.size())
+        buffer_.resize((size_ + count) * 2);
+
+    uint8_t* ptr = buffer_.data() + size_;
+    size_ += count;
+    return ptr;
+}
+
+void RecordLineBuffer::appendBytes(const void* bytes, size_t count)
+{
+    if (count > 0)
+        std::memcpy(grow(count), bytes, count);
+}
+
+void RecordLineBuffer::appendTag(ColumnType type)
+{
+    *grow(1) = static_cast<uint8_t>(type);
+}
+
+void RecordLineBuffer::appendSeparator()
+{
+    *grow(1) = '\t';
+}
+
+void RecordLineBuffer::appendUnsignedDigits(uint64_t value)
+{
+    char digits[kMaxNumberChars];
+    size_t count = 0;
+    do {
+        digits[count++] = static_cast<char>('0' + value % 10);
+        value /= 10;
+    } while (value != 0);
+
+    uint8_t* out = grow(count);
+    for (size_t i = 0; i < count; ++i)
+        out[i] = digits[count - 1 - i];
+}
+
+void RecordLineBuffer::appendColumn(const char* value, size_t len)
+{
+    if (format_ == Format::Binary) {
+        appendTag(ColumnType::String);
+        const uint32_t str_len = static_cast<uint32_t>(len);
+        appendBytes(&str_len, sizeof(str_len));
+        appendBytes(value, len);
+    }
+    else {
+        appendBytes(value, len);
+        appendSeparator();
+    }
+}
+
+void RecordLineBuffer::appendColumn(const std::string& value)
+{
+    appendColumn(value.data(), value.size());
+}
+
+void RecordLineBuffer::appendLastColumn(const std::string& value)
+{
+    if (format_ == Format::Binary)
+        appendColumn(value);
+    else
+        appendBytes(value.data(), value.size());
+}
+
+void RecordLineBuffer::appendColumns(const std::string& columns)
+{
+    appendBytes(columns.data(), columns.size());
+}
+
+std::string RecordLineBuffer::columnsStr() const
+{
+    const size_t offset = format_ == Format::Binary ? kRowLengthPrefixSize : 0;
+    return std::string(reinterpret_cast<const char*>(buffer_.data()) + offset, size_ - offset);
+}
+
+void RecordLineBuffer::appendColumn(float value)
+{
+    if (format_ == Format::Binary) {
+        appendTag(ColumnType::Float);
+        appendBytes(&value, sizeof(value));
+    }
+    else
+        appendColumn(static_cast<double>(value));
+}
+
+void RecordLineBuffer::appendColumn(double value)
+{
+    if (format_ == Format::Binary) {
+        appendTag(ColumnType::Double);
+        appendBytes(&value, sizeof(value));
+    }
+    else {
+        //%g matches the default std::ostream formatting used by the text log so far
+        char* out = reinterpret_cast<char*>(grow(kMaxNumberChars));
+        const int written = std::snprintf(out, kMaxNumberChars, "%g", value);
+        size_ -= kMaxNumberChars - (written > 0 ? static_cast<size_t>(written) : 0);
+        appendSeparator();
+    }
+}
+
+void RecordLineBuffer::appendColumn(int32_t value)
+{
+    appendColumn(static_cast<int64_t>(value));
+}
+
+void RecordLineBuffer::appendColumn(int64_t value)
+{
+    if (format_ == Format::Binary) {
+        appendTag(ColumnType::Int);
+        appendBytes(&value, sizeof(value));
+    }
+    else {
+        uint64_t magnitude = static_cast<uint64_t>(value);
+        if (value < 0) {
+            *grow(1) = '-';
+            magnitude = 0 - magnitude;
+        }
+        appendUnsignedDigits(magnitude);
+        appendSeparator();
+    }
+}
+
+void RecordLineBuffer::appendColumn(uint64_t value)
+{
+    if (format_ == Format::Binary) {
+        appendTag(ColumnType::UInt);
+        appendBytes(&value, sizeof(value));
+    }
+    else {
+        appendUnsignedDigits(value);
+        appendSeparator();
+    }
+}
+
+void RecordLineBuffer::appendColumn(bool value)
+{
+    if (format_ == Format::Binary) {
+        appendTag(ColumnType::Bool);
+        const uint8_t byte = value ? 1 : 0;
+        appendBytes(&byte, sizeof(byte));
+    }
+    else {
+        *grow(1) = value ? '1' : '0';
+        appendSeparator();
+    }
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include <string>
+#include <vector>
+#include <cstdint>
+
+//Reusable byte buffer used to format one recording row at a time.
+//Numbers are formatted in place, so once the buffer has grown to the size
+//of a typical row, producing further rows does not allocate.
+//In Text mode columns are tab separated and rows end with a newline, which is
+//the format of airsim_rec.txt. In Binary mode every column is written as a
+//one byte type tag followed by its raw value and each row is prefixed with
+//its length in bytes, see RecordingFile for the file layout.
+class RecordLineBuffer {
+public:
+    enum class Format : uint8_t {
+        Text, Binary
+    };
+
+    //type tags used for columns in Binary mode
+    enum class ColumnType : uint8_t {
+        String = 's', Float = 'f', Double = 'd', Int = 'i', UInt = 'u', Bool = 'b'
+    };
+
+    //buffer owned by the calling thread, rows are usually formatted on the recording thread
+    static RecordLineBuffer& threadLocal();
+
+    //discards previous contents and starts a new row
+    void reset(Format format = Format::Text);
+    //finishes the row, adds the newline or patches the length prefix
+    void finishRow();
+
+    void appendColumn(const std::string& value);
+    void appendColumn(const char* value, size_t len);
+    void appendColumn(float value);
+    void appendColumn(double value);
+    void appendColumn(int32_t value);
+    void appendColumn(int64_t value);
+    void appendColumn(uint64_t value);
+    void appendColumn(bool value);
+    //last column of the row has no trailing separator in Text mode
+    void appendLastColumn(const std::string& value);
+    //appends columns previously taken from columnsStr() of a buffer with the same format
+    void appendColumns(const std::string& columns);
+
+    Format getFormat() const
+    {
+        return format_;
+    }
+    const uint8_t* data() const
+    {
+        return buffer_.data();
+    }
+    size_t size() const
+    {
+        return size_;
+    }
+    std::string str() const
+    {
+        return std::string(reinterpret_cast<const char*>(buffer_.data()), size_);
+    }
+    //columns appended so far, without the row length prefix used in Binary mode
+    std::string columnsStr() const;
+
+private:
+    uint8_t* grow(size_t count);
+    void appendBytes(const void* bytes, size_t count);
+    void appendTag(ColumnType type);
+    void appendSeparator();
+    void appendUnsignedDigits(uint64_t value);
+
+private:
+    std::vector<uint8_t> buffer_;
+    size_t size_ = 0;
+    Format format_ = Format::Text;
+};
@@ -0,0 +1,184 @@
+#include "CoreMinimal.h"
+#include "HAL/IConsoleManager.h"
+#include "HAL/PlatformTime.h"
+#include "HAL/PlatformProcess.h"
+#include "HAL/FileManager.h"
+#include "Misc/Paths.h"
+#include "RecordLineBuffer.h"
+#include "RecordingWriter.h"
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+//Console commands measuring the recorder outside of a simulation, results go to the log.
+//  AirSim.Bench.RecordLines [rows]
+//  AirSim.Bench.RecordingWriter [seconds per rate] [max frames/s] [directory]
+
+namespace {
+    const int32 kDefaultRows = 1000000;
+
+    //uncompressed 1080p RGB frame, the largest image a camera hands to the recorder
+    const size_t kFrameBytes = 1920 * 1080 * 3;
+    const float kDefaultSecondsPerRate = 5.0f;
+    const int32 kDefaultMaxFrameRate = 120;
+    //a rate counts as sustained while the frames written reach this share of the frames due
+    const double kSustainedShare = 0.95;
+
+    //kinematics columns of one synthetic row, varied per row so no two rows are equal
+    struct BenchRow {
+        uint64_t timestamp_millis;
+        float values[7];
+    };
+
+    BenchRow makeRow(int32 index)
+    {
+        BenchRow row;
+        row.timestamp_millis = 1600000000000ull + static_cast<uint64_t>(index) * 3;
+        for (int i = 0; i < 7; ++i)
+            row.values[i] = static_cast<float>((index + 1) * (i + 1)) * 0.001234f - 3.5f;
+        return row;
+    }
+
+    //how PawnSimApi::getRecordFileLine formatted rows before RecordLineBuffer
+    std::string formatWithStream(const std::string& vehicle_name, const BenchRow& row)
+    {
+        std::ostringstream ss;
+        ss << vehicle_name << "\t";
+        ss << row.timestamp_millis << "\t";
+        ss << row.values[0] << "\t" << row.values[1] << "\t" << row.values[2] << "\t";
+        ss << row.values[3] << "\t" << row.values[4] << "\t"
+            << row.values[5] << "\t" << row.values[6] << "\t";
+
+        return ss.str();
+    }
+
+    void formatWithBuffer(RecordLineBuffer& buffer, const std::string& vehicle_name, const BenchRow& row)
+    {
+        buffer.reset(RecordLineBuffer::Format::Text);
+        buffer.appendColumn(vehicle_name);
+        buffer.appendColumn(row.timestamp_millis);
+        for (float value : row.values)
+            buffer.appendColumn(value);
+    }
+
+    void reportRate(const TCHAR* name, int32 rows, uint64 cycles, uint64 bytes)
+    {
+        const double seconds = FPlatformTime::ToSeconds64(cycles);
+        UE_LOG(LogTemp, Display, TEXT("AirSim.Bench.RecordLines %s: %d rows in %.3f s, %.0f rows/s, %.1f ns/row, %llu bytes"),
+            name, rows, seconds, seconds > 0 ? rows / seconds : 0.0, seconds * 1.0E9 / rows, bytes);
+    }
+
+    void benchRecordLines(const TArray<FString>& args)
+    {
+        const int32 rows = args.Num() > 0 ? FMath::Max(1, FCString::Atoi(*args[0])) : kDefaultRows;
+        const std::string vehicle_name = "Drone1";
+
+        uint64 bytes = 0;
+        uint64 start = FPlatformTime::Cycles64();
+        for (int32 i = 0; i < rows; ++i)
+            bytes += formatWithStream(vehicle_name, makeRow(i)).size();
+        reportRate(TEXT("ostringstream"), rows, FPlatformTime::Cycles64() - start, bytes);
+
+        //str() is what getRecordFileLine still returns, appendRecordFileLine skips it
+        RecordLineBuffer& buffer = RecordLineBuffer::threadLocal();
+        bytes = 0;
+        start = FPlatformTime::Cycles64();
+        for (int32 i = 0; i < rows; ++i) {
+            formatWithBuffer(buffer, vehicle_name, makeRow(i));
+            bytes += buffer.str().size();
+        }
+        reportRate(TEXT("RecordLineBuffer::str"), rows, FPlatformTime::Cycles64() - start, bytes);
+
+        bytes = 0;
+        start = FPlatformTime::Cycles64();
+        for (int32 i = 0; i < rows; ++i) {
+            formatWithBuffer(buffer, vehicle_name, makeRow(i));
+            bytes += buffer.size();
+        }
+        reportRate(TEXT("RecordLineBuffer"), rows, FPlatformTime::Cycles64() - start, bytes);
+    }
+
+    //writes frames at one rate for the given time, returns false once the writer cannot keep up
+    bool benchWriterRate(const std::string& directory, int32 frame_rate, float seconds, const std::vector<uint8_t>& frame)
+    {
+        const std::string log_path = directory + "/airsim_rec.txt";
+        RecordingWriter::Options options;
+        options.sync_policy = RecordingWriter::SyncPolicy::None;
+        RecordingWriter writer;
+        if (!writer.open(log_path, options)) {
+            UE_LOG(LogTemp, Warning, TEXT("AirSim.Bench.RecordingWriter: cannot open %s"), UTF8_TO_TCHAR(log_path.c_str()));
+            return false;
+        }
+
+        RecordLineBuffer& row = RecordLineBuffer::threadLocal();
+        const double frame_period = 1.0 / frame_rate;
+        const uint64 start = FPlatformTime::Cycles64();
+        int32 frames_due = 0, frames_written = 0;
+        for (;;) {
+            const double elapsed = FPlatformTime::ToSeconds64(FPlatformTime::Cycles64() - start);
+            if (elapsed >= seconds)
+                break;
+
+            frames_due = static_cast<int32>(elapsed / frame_period) + 1;
+            if (frames_written >= frames_due) {
+                FPlatformProcess::Sleep(static_cast<float>(frames_written * frame_period - elapsed));
+                continue;
+            }
+
+            const std::string image_name = "img_" + std::to_string(frames_written) + ".raw";
+            if (!writer.writeFile(directory + "/" + image_name, frame.data(), frame.size()))
+                break;
+            row.reset(RecordLineBuffer::Format::Text);
+            row.appendColumn(static_cast<uint64_t>(frames_written));
+            row.appendLastColumn(image_name);
+            row.finishRow();
+            writer.write(row.data(), row.size());
+            writer.flushIfDue();
+            ++frames_written;
+        }
+        writer.close();
+
+        const double elapsed = FPlatformTime::ToSeconds64(FPlatformTime::Cycles64() - start);
+        const bool sustained = !writer.hasFailed() && frames_written >= frames_due * kSustainedShare;
+        UE_LOG(LogTemp, Display, TEXT("AirSim.Bench.RecordingWriter %d frames/s: %d of %d frames in %.2f s, %s, %s"),
+            frame_rate, frames_written, frames_due, elapsed, UTF8_TO_TCHAR(writer.getStatsReport().c_str()),
+            sustained ? TEXT("sustained") : TEXT("NOT sustained"));
+
+        IFileManager::Get().DeleteDirectory(UTF8_TO_TCHAR(directory.c_str()), false, true);
+        IFileManager::Get().MakeDirectory(UTF8_TO_TCHAR(directory.c_str()), true);
+        return sustained;
+    }
+
+    void benchRecordingWriter(const TArray<FString>& args)
+    {
+        const float seconds = args.Num() > 0 ? FMath::Max(0.1f, FCString::Atof(*args[0])) : kDefaultSecondsPerRate;
+        const int32 max_frame_rate = args.Num() > 1 ? FMath::Max(1, FCString::Atoi(*args[1])) : kDefaultMaxFrameRate;
+        const FString directory = args.Num() > 2 ? args[2]
+            : FPaths::ConvertRelativePathToFull(FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("AirSimRecordingBench")));
+        IFileManager::Get().MakeDirectory(*directory, true);
+
+        //random content so that file systems with compression or deduplication see real sizes
+        std::vector<uint8_t> frame(kFrameBytes);
+        FRandomStream random(1);
+        for (uint8_t& value : frame)
+            value = static_cast<uint8_t>(random.RandHelper(256));
+
+        for (int32 frame_rate = 1; frame_rate <= max_frame_rate; frame_rate *= 2) {
+            if (!benchWriterRate(TCHAR_TO_UTF8(*directory), frame_rate, seconds, frame))
+                break;
+        }
+        IFileManager::Get().DeleteDirectory(*directory, false, true);
+    }
+
+    FAutoConsoleCommand bench_recording_writer_command(
+        TEXT("AirSim.Bench.RecordingWriter"),
+        TEXT("Writes synthetic 1080p frames through RecordingWriter at doubling frame rates until the rate is no longer sustained, ")
+        TEXT("logging MB/s and write latency percentiles. Args: [seconds per rate] [max frames/s] [directory]"),
+        FConsoleCommandWithArgsDelegate::CreateStatic(&benchRecordingWriter));
+
+    FAutoConsoleCommand bench_record_lines_command(
+        TEXT("AirSim.Bench.RecordLines"),
+        TEXT("Formats the same recording rows with std::ostringstream and with RecordLineBuffer. Args: [rows]"),
+        FConsoleCommandWithArgsDelegate::CreateStatic(&benchRecordLines));
+}
@@ -5,13 +5,62 @@
 #include "ImageUtils.h"
 #include "common/ClockFactory.hpp"
 #include "common/common_utils/FileSystem.hpp"
+#include "Recording/SensorRecord.h"
 
 
 void RecordingFile::appendRecord(const std::vector<msr::airlib::ImageCaptureBase::ImageResponse>& responses,
     msr::airlib::VehicleSimApiBase* vehicle_sim_api) const
 {
+    std::string image_file_names;
+    if (!saveImages(responses, vehicle_sim_api->getVehicleName(), image_file_names))
+        return;
+
+    const uint64 start_cycles = FPlatformTime::Cycles64();
+
+    // every vehicle in this tree is a PawnSimApi, see ASimModeBase::getVehicleSimApi
+    RecordLineBuffer& buffer = RecordLineBuffer::threadLocal();
+    buffer.reset(getRowFormat());
+    static_cast<const PawnSimApi*>(vehicle_sim_api)->appendRecordFileLine(buffer);
+    writeRow(buffer, image_file_names, start_cycles);
+}
+
+void RecordingFile::appendRecord(const std::vector<msr::airlib::ImageCaptureBase::ImageResponse>& responses,
+    const std::string& vehicle_name, const std::string& row_columns) const
+{
+    std::string image_file_names;
+    if (!saveImages(responses, vehicle_name, image_file_names))
+        return;
+
+    const uint64 start_cycles = FPlatformTime::Cycles64();
+
+    RecordLineBuffer& buffer = RecordLineBuffer::threadLocal();
+    buffer.reset(getRowFormat());
+    buffer.appendColumns(row_columns);
+    writeRow(buffer, image_file_names, start_cycles);
+}
+
+void RecordingFile::appendSensorRows(const std::string& sensor_rows) const
+{
+    if (sensor_writer_ == nullptr || sensor_rows.size() == 0)
+        return;
+
+    sensor_writer_->write(sensor_rows.data(), sensor_rows.size());
+    sensor_writer_->flushIfDue();
+}
+
+RecordLineBuffer::Format RecordingFile::getRowFormat() const
+{
+    return binary_format_ ? RecordLineBuffer::Format::Binary : RecordLineBuffer::Format::Text;
+}
+
+bool RecordingFile::saveImages(const std::vector<msr::airlib::ImageCaptureBase::ImageResponse>& responses,
+    const std::string& vehicle_name, std::string& image_file_names) const
+{
+    if (!isFileOpen())
+        return false;
+
     bool save_success = false;
-    std::ostringstream image_file_names;
+    std::ostringstream image_file_names_stream;
 
     for (auto i = 0; i < responses.size(); ++i) {
         const auto& response = responses.at(i);
@@ -19,10 +68,10 @@ void RecordingFile::appendRecord(const std::vector<msr::airlib::ImageCaptureBase
         //build image file name
         std::ostringstream image_file_name;
         image_file_name << "img_"
-            << vehicle_sim_api->getVehicleName() << "_" 
+            << vehicle_name << "_" 
             << response.camera_name << "_" <<
             common_utils::Utils::toNumeric(response.image_type) << "_" <<
-            common_utils::Utils::getTimeSinceEpochNanos();
+            (sim_time_image_names_ ? response.time_stamp : common_utils::Utils::getTimeSinceEpochNanos());
 
         std::string extension;
         if (response.pixels_as_float)
@@ -35,8 +84,8 @@ void RecordingFile::appendRecord(const std::vector<msr::airlib::ImageCaptureBase
         image_file_name << extension;
 
         if (i > 0)
-            image_file_names << ";";
-        image_file_names << image_file_name.str();
+            image_file_names_stream << ";";
+        image_file_names_stream << image_file_name.str();
         std::string image_full_file_path = common_utils::FileSystem::combine(image_path_, image_file_name.str());
 
         //write image file
@@ -51,9 +100,8 @@ void RecordingFile::appendRecord(const std::vector<msr::airlib::ImageCaptureBase
             }
             else {
                 // Write PNG image, already compressed in binary
-                std::ofstream file(image_full_file_path, std::ios::binary);
-                file.write(reinterpret_cast<const char*>(response.image_data_uint8.data()), response.image_data_uint8.size());
-                file.close();
+                if (!log_writer_->writeFile(image_full_file_path, response.image_data_uint8.data(), response.image_data_uint8.size()))
+                    throw std::runtime_error("Could not write " + image_full_file_path);
             }
 
             save_success = true;
@@ -64,13 +112,22 @@ void RecordingFile::appendRecord(const std::vector<msr::airlib::ImageCaptureBase
         }
     }
 
-    //write to CSV file
-    if (save_success || (responses.size() == 0)) {
-        // Either images were saved successfully, or there were no images 
-        writeString(vehicle_sim_api->getRecordFileLine(false).append(image_file_names.str()).append("\n"));
+    image_file_names = image_file_names_stream.str();
 
-        //UAirBlueprintLib::LogMessage(TEXT("Screenshot saved to:"), filePath, LogDebugLevel::Success);
-    }
+    // Either images were saved successfully, or there were no images 
+    return save_success || (responses.size() == 0);
+}
+
+void RecordingFile::writeRow(RecordLineBuffer& buffer, const std::string& image_file_names, uint64 start_cycles) const
+{
+    buffer.appendLastColumn(image_file_names);
+    buffer.finishRow();
+    writeBytes(buffer.data(), buffer.size());
+
+    row_cycles_ += FPlatformTime::Cycles64() - start_cycles;
+    ++rows_written_;
+
+    log_writer_->flushIfDue();
 }
 
 void RecordingFile::appendColumnHeader(const std::string& header_columns)
@@ -83,8 +140,14 @@ void RecordingFile::createFile(const std::string& file_path, const std::string&
     try {
         closeFile();
 
-        IPlatformFile& platform_file = FPlatformFileManager::Get().GetPlatformFile();
-        log_file_handle_ = platform_file.OpenWrite(*FString(file_path.c_str()));
+        log_writer_.reset(new RecordingWriter());
+        if (!log_writer_->open(file_path, writer_options_)) {
+            log_writer_.reset();
+            return;
+        }
+
+        if (binary_format_)
+            writeString(kBinaryMagicLine);
         appendColumnHeader(header_columns);
     }
     catch(std::exception& ex) {
@@ -92,25 +155,51 @@ void RecordingFile::createFile(const std::string& file_path, const std::string&
     }
 }
 
+void RecordingFile::createSensorFile(const std::string& file_path)
+{
+    sensor_writer_.reset(new RecordingWriter());
+    if (!sensor_writer_->open(file_path, writer_options_)) {
+        UAirBlueprintLib::LogMessageString("Cannot create sensor log ", file_path, LogDebugLevel::Failure);
+        sensor_writer_.reset();
+        return;
+    }
+
+    std::string header = SensorRecord::kHeader;
+    if (binary_format_)
+        header = kBinaryMagicLine + header;
+    sensor_writer_->write(header.data(), header.size());
+}
+
 bool RecordingFile::isFileOpen() const
 {
-    return log_file_handle_ != nullptr;
+    return log_writer_ != nullptr && log_writer_->isOpen();
 }
 
 void RecordingFile::closeFile()
 {
-    if (isFileOpen())
-        delete log_file_handle_;
+    if (log_writer_) {
+        log_writer_->close();
+        UAirBlueprintLib::LogMessageString("Recording I/O: ", log_writer_->getStatsReport(), LogDebugLevel::Informational);
+    }
+
+    log_writer_.reset();
 
-    log_file_handle_ = nullptr;
+    if (sensor_writer_)
+        sensor_writer_->close();
+    sensor_writer_.reset();
 }
 
 void RecordingFile::writeString(const std::string& str) const
+{
+    writeBytes(reinterpret_cast<const uint8_t*>(str.data()), str.size());
+}
+
+void RecordingFile::writeBytes(const uint8_t* data, size_t size) const
 {
     try {    
-        if (log_file_handle_) {
-            FString line_f(str.c_str());
-            log_file_handle_->Write((const uint8*)TCHAR_TO_ANSI(*line_f), line_f.Len());
+        if (isFileOpen()) {
+            // rows are already ASCII or binary, write them as they are
+            log_writer_->write(data, size);
         }
         else
             UAirBlueprintLib::LogMessageString("Attempt to write to recording log file when file was not opened", "", LogDebugLevel::Failure);
@@ -125,14 +214,30 @@ RecordingFile::~RecordingFile()
     stopRecording(true);
 }
 
-void RecordingFile::startRecording(msr::airlib::VehicleSimApiBase* vehicle_sim_api, const std::string& folder)
+void RecordingFile::startRecording(msr::airlib::VehicleSimApiBase* vehicle_sim_api, const RecordingSetting& settings)
+{
+    startRecording(vehicle_sim_api->getRecordFileLine(true), settings);
+}
+
+void RecordingFile::startRecording(const std::string& header_columns, const RecordingSetting& settings)
 {
     try {
-        std::string log_folderpath = common_utils::FileSystem::getLogFolderPath(true, folder);
+        binary_format_ = settings.binary_format;
+        sim_time_image_names_ = settings.trigger == "SimTime" || settings.trigger == "PhysicsSteps";
+        writer_options_ = RecordingWriter::Options(settings);
+        rows_written_ = 0;
+        row_cycles_ = 0;
+
+        std::string log_folderpath = common_utils::FileSystem::getLogFolderPath(true, settings.folder);
         image_path_ = common_utils::FileSystem::ensureFolder(log_folderpath, "images");
-        std::string log_filepath = common_utils::FileSystem::getLogFileNamePath(log_folderpath, record_filename, "", ".txt", false);
-        if (log_filepath != "")
-            createFile(log_filepath, vehicle_sim_api->getRecordFileLine(true));
+        std::string log_filepath = common_utils::FileSystem::getLogFileNamePath(log_folderpath, record_filename, "",
+            binary_format_ ? ".bin" : ".txt", false);
+        if (log_filepath != "") {
+            createFile(log_filepath, header_columns);
+            if (settings.black_box_enabled && isFileOpen())
+                createSensorFile(common_utils::FileSystem::getLogFileNamePath(log_folderpath, sensor_record_filename, "",
+                    binary_format_ ? ".bin" : ".txt", false));
+        }
         else {
             UAirBlueprintLib::LogMessageString("Cannot start recording because path for log file is not available", "", LogDebugLevel::Failure);
             return;
@@ -163,6 +268,12 @@ void RecordingFile::stopRecording(bool ignore_if_stopped)
     else
         closeFile();
 
+    if (rows_written_ > 0) {
+        const double micros_per_row = FPlatformTime::ToMilliseconds64(row_cycles_) * 1000.0 / rows_written_;
+        UAirBlueprintLib::LogMessageString("Recording: ", std::to_string(rows_written_) + " rows, " +
+            std::to_string(micros_per_row) + " us per row", LogDebugLevel::Informational);
+    }
+
     UAirBlueprintLib::LogMessage(TEXT("Recording: "), TEXT("Stopped"), LogDebugLevel::Success);
     UAirBlueprintLib::LogMessage(TEXT("Data saved to: "), FString(image_path_.c_str()), LogDebugLevel::Success);
 }
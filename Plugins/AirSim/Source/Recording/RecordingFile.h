@@ -6,27 +6,64 @@
 #include "physics/Kinematics.hpp"
 #include "HAL/FileManager.h"
 #include "PawnSimApi.h"
+#include "Recording/RecordLineBuffer.h"
+#include "Recording/RecordingWriter.h"
+#include "common/AirSimSettings.hpp"
 
-
+//Writes airsim_rec.txt and the images folder.
+//All file output goes through RecordingWriter so rows are batched into large writes.
+//With RecordingSetting::binary_format the log is written to airsim_rec.bin instead:
+//the magic line "AirSimRec/1", the usual tab separated header line and then one
+//row per record, each prefixed by its uint32 byte length and made of tagged
+//columns as produced by RecordLineBuffer::Format::Binary.
+//With Recording.BlackBox the sensor outputs kept by the black box go to
+//airsim_sensors.txt (or .bin) next to it, see SensorRecord for its rows.
 class RecordingFile {
 public:
+    typedef msr::airlib::AirSimSettings::RecordingSetting RecordingSetting;
+
     ~RecordingFile();
 
     void appendRecord(const std::vector<msr::airlib::ImageCaptureBase::ImageResponse>& responses, msr::airlib::VehicleSimApiBase* vehicle_sim_api) const;
+    //appends a record whose columns were formatted earlier, see PawnSimApi::appendRecordFileLine
+    void appendRecord(const std::vector<msr::airlib::ImageCaptureBase::ImageResponse>& responses, const std::string& vehicle_name,
+        const std::string& row_columns) const;
+    //appends rows formatted by SensorRecord::appendRows to the sensor log
+    void appendSensorRows(const std::string& sensor_rows) const;
+    RecordLineBuffer::Format getRowFormat() const;
     void appendColumnHeader(const std::string& header_columns);
-    void startRecording(msr::airlib::VehicleSimApiBase* vehicle_sim_api, const std::string& folder="");
+    void startRecording(msr::airlib::VehicleSimApiBase* vehicle_sim_api, const RecordingSetting& settings);
+    void startRecording(const std::string& header_columns, const RecordingSetting& settings);
     void stopRecording(bool ignore_if_stopped);
     bool isRecording() const;
 
+    static constexpr const char* kBinaryMagicLine = "AirSimRec/1\n";
+
 private:
     void createFile(const std::string& file_path, const std::string& header_columns);
+    void createSensorFile(const std::string& file_path);
     void closeFile();
     void writeString(const std::string& line) const;
+    void writeBytes(const uint8_t* data, size_t size) const;
+    bool saveImages(const std::vector<msr::airlib::ImageCaptureBase::ImageResponse>& responses, const std::string& vehicle_name,
+        std::string& image_file_names) const;
+    void writeRow(RecordLineBuffer& buffer, const std::string& image_file_names, uint64 start_cycles) const;
     bool isFileOpen() const;
 
 private:
     std::string record_filename = "airsim_rec";
+    std::string sensor_record_filename = "airsim_sensors";
     std::string image_path_;
     bool is_recording_ = false;
-    IFileHandle* log_file_handle_ = nullptr;
+    bool binary_format_ = false;
+    //images of step triggered samples are named after the simulated time of their frame
+    bool sim_time_image_names_ = false;
+    RecordingWriter::Options writer_options_;
+    std::unique_ptr<RecordingWriter> log_writer_;
+    //only open while the black box is enabled
+    std::unique_ptr<RecordingWriter> sensor_writer_;
+
+    //time spent formatting and writing rows, reported when recording stops
+    mutable uint64 rows_written_ = 0;
+    mutable uint64 row_cycles_ = 0;
 };
\ No newline at end of file
@@ -0,0 +1,443 @@
+#include "RecordingPlayback.h"
+#include "HAL/RunnableThread.h"
+#include "HAL/PlatformProcess.h"
+#include "HAL/PlatformTime.h"
+#include "AirBlueprintLib.h"
+#include "Recording/RecordLineBuffer.h"
+#include <cstring>
+#include <algorithm>
+#include <chrono>
+
+namespace {
+    //rows kept parsed ahead of the one being played
+    constexpr size_t kReadAheadRows = 4096;
+    //file reads are done in blocks of this size
+    constexpr size_t kStreamBufferSize = 4 * 1024 * 1024;
+    //longest sleep between checks for Stop()
+    constexpr double kMaxWaitSlice = 0.01;
+    //how long the destructor waits for the thread before killing it; a capture for
+    //regenerated images never completes once the game thread stops drawing frames
+    constexpr double kStopTimeout = 5.0;
+    //longer binary rows are taken as a corrupt length rather than allocated
+    constexpr uint32_t kMaxBinaryRowLength = 16 * 1024 * 1024;
+
+    std::vector<std::string> splitColumns(const std::string& line)
+    {
+        std::vector<std::string> columns;
+        size_t start = 0;
+        while (true) {
+            const size_t end = line.find('\t', start);
+            columns.push_back(line.substr(start, end == std::string::npos ? std::string::npos : end - start));
+            if (end == std::string::npos)
+                break;
+            start = end + 1;
+        }
+        return columns;
+    }
+}
+
+FRecordingPlayback::FRecordingPlayback(const Options& options,
+    const common_utils::UniqueValueMap<std::string, VehicleSimApiBase*>& vehicle_sim_apis)
+    : options_(options), vehicle_sim_apis_(vehicle_sim_apis), stream_buffer_(kStreamBufferSize),
+      stop_task_counter_(0), is_finished_(false), rows_played_(0)
+{
+    thread_.reset(FRunnableThread::Create(this, TEXT("FRecordingPlayback"), 0, TPri_BelowNormal));
+}
+
+FRecordingPlayback::~FRecordingPlayback()
+{
+    Stop();
+    if (thread_ == nullptr)
+        return;
+
+    const double give_up_on = FPlatformTime::Seconds() + kStopTimeout;
+    while (!is_finished_ && FPlatformTime::Seconds() < give_up_on)
+        FPlatformProcess::Sleep(static_cast<float>(kMaxWaitSlice));
+
+    if (is_finished_)
+        thread_->WaitForCompletion();
+    else {
+        UE_LOG(LogTemp, Warning, TEXT("Playback thread did not stop, killing it"));
+        thread_->Kill(false);
+    }
+}
+
+void FRecordingPlayback::stop()
+{
+    Stop();
+}
+
+bool FRecordingPlayback::isFinished() const
+{
+    return is_finished_;
+}
+
+uint64_t FRecordingPlayback::getRowsPlayed() const
+{
+    return rows_played_;
+}
+
+bool FRecordingPlayback::Init()
+{
+    return true;
+}
+
+void FRecordingPlayback::Stop()
+{
+    stop_task_counter_.Increment();
+}
+
+uint32 FRecordingPlayback::Run()
+{
+    std::string header_columns;
+    if (!openFile() || !readHeader(header_columns)) {
+        is_finished_ = true;
+        return 0;
+    }
+
+    if (options_.regenerate_images) {
+        //the new recording keeps the source columns and format, only the images change
+        RecordingSetting output_setting = options_.recording_setting;
+        output_setting.binary_format = binary_format_;
+        output_file_.reset(new RecordingFile());
+        output_file_->startRecording(header_columns, output_setting);
+    }
+
+    UAirBlueprintLib::LogMessageString("Playback started: ", options_.file_path, LogDebugLevel::Success);
+
+    start_wall_seconds_ = FPlatformTime::Seconds();
+    while (stop_task_counter_.GetValue() == 0) {
+        if (rows_.size() < kReadAheadRows / 2 && !end_of_file_)
+            readAhead();
+
+        if (rows_.size() == 0)
+            break;
+
+        const Row row = std::move(rows_.front());
+        rows_.pop_front();
+
+        waitForRowTime(row);
+        if (stop_task_counter_.GetValue() != 0)
+            break;
+
+        playRow(row);
+        ++rows_played_;
+    }
+
+    if (output_file_)
+        output_file_->stopRecording(true);
+
+    UAirBlueprintLib::LogMessageString("Playback finished, rows played: ", std::to_string(rows_played_), LogDebugLevel::Success);
+    is_finished_ = true;
+    return 0;
+}
+
+bool FRecordingPlayback::openFile()
+{
+    file_.rdbuf()->pubsetbuf(stream_buffer_.data(), stream_buffer_.size());
+    file_.open(options_.file_path, std::ios::in | std::ios::binary);
+    if (!file_.is_open()) {
+        UAirBlueprintLib::LogMessageString("Cannot open recording for playback: ", options_.file_path, LogDebugLevel::Failure);
+        return false;
+    }
+    return true;
+}
+
+bool FRecordingPlayback::readHeader(std::string& header_columns)
+{
+    std::string line;
+    if (!std::getline(file_, line))
+        return false;
+
+    std::string magic_line = RecordingFile::kBinaryMagicLine;
+    magic_line.pop_back(); //newline
+    binary_format_ = line == magic_line;
+    if (binary_format_ && !std::getline(file_, line))
+        return false;
+
+    std::vector<std::string> names = splitColumns(line);
+    if (!mapColumns(names)) {
+        UAirBlueprintLib::LogMessageString("Recording file is missing pose columns: ", options_.file_path, LogDebugLevel::Failure);
+        return false;
+    }
+
+    //header as RecordingFile expects it, without the ImageFile column it appends itself
+    header_columns = line.substr(0, line.size() - names.back().size());
+    return true;
+}
+
+bool FRecordingPlayback::mapColumns(const std::vector<std::string>& names)
+{
+    static const char* kPositionNames[] = { "POS_X", "POS_Y", "POS_Z" };
+    static const char* kOrientationNames[] = { "Q_W", "Q_X", "Q_Y", "Q_Z" };
+
+    for (int i = 0; i < static_cast<int>(names.size()); ++i) {
+        const std::string& name = names[i];
+        if (name == "VehicleName")
+            vehicle_name_column_ = i;
+        else if (name == "TimeStamp")
+            timestamp_column_ = i;
+        else if (name == "ImageFile")
+            image_file_column_ = i;
+        for (int axis = 0; axis < 3; ++axis)
+            if (name == kPositionNames[axis])
+                position_columns_[axis] = i;
+        for (int axis = 0; axis < 4; ++axis)
+            if (name == kOrientationNames[axis])
+                orientation_columns_[axis] = i;
+    }
+
+    //ImageFile is always written last, see RecordingFile::appendColumnHeader
+    if (image_file_column_ != static_cast<int>(names.size()) - 1)
+        return false;
+
+    bool has_all = vehicle_name_column_ >= 0 && timestamp_column_ >= 0;
+    for (int column : position_columns_)
+        has_all = has_all && column >= 0;
+    for (int column : orientation_columns_)
+        has_all = has_all && column >= 0;
+    return has_all;
+}
+
+void FRecordingPlayback::readAhead()
+{
+    while (rows_.size() < kReadAheadRows) {
+        Row row;
+        const bool has_row = binary_format_ ? readBinaryRow(row) : readTextRow(row);
+        if (!has_row) {
+            end_of_file_ = true;
+            return;
+        }
+        rows_.push_back(std::move(row));
+    }
+}
+
+bool FRecordingPlayback::readTextRow(Row& row)
+{
+    std::string line;
+    while (std::getline(file_, line)) {
+        if (line.size() == 0)
+            continue;
+
+        const std::vector<std::string> columns = splitColumns(line);
+        if (static_cast<int>(columns.size()) <= image_file_column_)
+            continue;
+
+        try {
+            row.vehicle_name = columns[vehicle_name_column_];
+            row.timestamp_millis = std::stoull(columns[timestamp_column_]);
+            row.pose.position = msr::airlib::Vector3r(std::stof(columns[position_columns_[0]]),
+                std::stof(columns[position_columns_[1]]), std::stof(columns[position_columns_[2]]));
+            row.pose.orientation = msr::airlib::Quaternionr(std::stof(columns[orientation_columns_[0]]),
+                std::stof(columns[orientation_columns_[1]]), std::stof(columns[orientation_columns_[2]]),
+                std::stof(columns[orientation_columns_[3]]));
+        }
+        catch (const std::exception&) {
+            continue; //skip malformed rows such as a truncated last line
+        }
+
+        row.columns = line.substr(0, line.size() - columns.back().size());
+        return true;
+    }
+    return false;
+}
+
+bool FRecordingPlayback::readBinaryRow(Row& row)
+{
+    uint32_t row_length;
+    if (!file_.read(reinterpret_cast<char*>(&row_length), sizeof(row_length)))
+        return false;
+
+    if (row_length > kMaxBinaryRowLength) {
+        UAirBlueprintLib::LogMessageString("Corrupt row length in recording, playback stopped: ", options_.file_path, LogDebugLevel::Failure);
+        return false;
+    }
+
+    std::vector<char> bytes(row_length);
+    if (!file_.read(bytes.data(), row_length))
+        return false;
+
+    std::vector<double> numbers;
+    std::vector<std::string> strings;
+    size_t last_column_start = 0;
+    size_t offset = 0;
+    int column = 0;
+    //whether the row has size more bytes left after offset
+    const auto has_bytes = [&bytes, &offset](size_t size) { return size <= bytes.size() - offset; };
+
+    while (offset < bytes.size()) {
+        last_column_start = offset;
+        const auto tag = static_cast<RecordLineBuffer::ColumnType>(bytes[offset++]);
+        double number = 0;
+        std::string str;
+
+        size_t value_size = 0;
+        switch (tag) {
+        case RecordLineBuffer::ColumnType::String:
+            value_size = sizeof(uint32_t);
+            break;
+        case RecordLineBuffer::ColumnType::Float:
+            value_size = sizeof(float);
+            break;
+        case RecordLineBuffer::ColumnType::Double:
+        case RecordLineBuffer::ColumnType::Int:
+        case RecordLineBuffer::ColumnType::UInt:
+            value_size = sizeof(uint64_t);
+            break;
+        case RecordLineBuffer::ColumnType::Bool:
+            value_size = 1;
+            break;
+        default:
+            break;
+        }
+        if (value_size == 0 || !has_bytes(value_size)) {
+            UAirBlueprintLib::LogMessageString("Corrupt row in recording, playback stopped: ", options_.file_path, LogDebugLevel::Failure);
+            return false;
+        }
+
+        switch (tag) {
+        case RecordLineBuffer::ColumnType::String: {
+            uint32_t len;
+            std::memcpy(&len, &bytes[offset], sizeof(len));
+            offset += sizeof(len);
+            if (!has_bytes(len)) {
+                UAirBlueprintLib::LogMessageString("Corrupt row in recording, playback stopped: ", options_.file_path, LogDebugLevel::Failure);
+                return false;
+            }
+            str.assign(bytes.data() + offset, len);
+            offset += len;
+            break;
+        }
+        case RecordLineBuffer::ColumnType::Float: {
+            float value;
+            std::memcpy(&value, &bytes[offset], sizeof(value));
+            offset += sizeof(value);
+            number = value;
+            break;
+        }
+        case RecordLineBuffer::ColumnType::Double:
+            std::memcpy(&number, &bytes[offset], sizeof(number));
+            offset += sizeof(number);
+            break;
+        case RecordLineBuffer::ColumnType::Int: {
+            int64_t value;
+            std::memcpy(&value, &bytes[offset], sizeof(value));
+            offset += sizeof(value);
+            number = static_cast<double>(value);
+            break;
+        }
+        case RecordLineBuffer::ColumnType::UInt: {
+            uint64_t value;
+            std::memcpy(&value, &bytes[offset], sizeof(value));
+            offset += sizeof(value);
+            if (column == timestamp_column_)
+                row.timestamp_millis = value;
+            number = static_cast<double>(value);
+            break;
+        }
+        default: //Bool
+            number = bytes[offset++] != 0 ? 1 : 0;
+            break;
+        }
+
+        numbers.push_back(number);
+        strings.push_back(std::move(str));
+        ++column;
+    }
+
+    if (column <= image_file_column_) {
+        UAirBlueprintLib::LogMessageString("Row with missing columns in recording, playback stopped: ", options_.file_path, LogDebugLevel::Failure);
+        return false;
+    }
+
+    row.vehicle_name = strings[vehicle_name_column_];
+    row.pose.position = msr::airlib::Vector3r(static_cast<float>(numbers[position_columns_[0]]),
+        static_cast<float>(numbers[position_columns_[1]]), static_cast<float>(numbers[position_columns_[2]]));
+    row.pose.orientation = msr::airlib::Quaternionr(static_cast<float>(numbers[orientation_columns_[0]]),
+        static_cast<float>(numbers[orientation_columns_[1]]), static_cast<float>(numbers[orientation_columns_[2]]),
+        static_cast<float>(numbers[orientation_columns_[3]]));
+    row.columns.assign(bytes.data(), last_column_start);
+    return true;
+}
+
+void FRecordingPlayback::waitForRowTime(const Row& row)
+{
+    if (!has_first_timestamp_) {
+        first_timestamp_millis_ = row.timestamp_millis;
+        has_first_timestamp_ = true;
+    }
+
+    if (options_.time_scale <= 0)
+        return;
+
+    //rows of several vehicles may be slightly out of order, earlier ones are played right away
+    const int64_t row_millis = std::max<int64_t>(0,
+        static_cast<int64_t>(row.timestamp_millis) - static_cast<int64_t>(first_timestamp_millis_));
+    const double row_offset = row_millis / 1000.0 / options_.time_scale;
+    const double due_on = start_wall_seconds_ + row_offset;
+
+    double now = FPlatformTime::Seconds();
+    while (now < due_on && stop_task_counter_.GetValue() == 0) {
+        FPlatformProcess::Sleep(static_cast<float>(std::min(due_on - now, kMaxWaitSlice)));
+        now = FPlatformTime::Seconds();
+    }
+}
+
+bool FRecordingPlayback::waitForPoseApplied(uint64_t pose_number)
+{
+    std::unique_lock<std::mutex> lock(poses_mutex_);
+    while (poses_applied_ < pose_number && stop_task_counter_.GetValue() == 0)
+        poses_applied_cv_.wait_for(lock, std::chrono::duration<double>(kMaxWaitSlice));
+    return poses_applied_ >= pose_number;
+}
+
+void FRecordingPlayback::applyPendingPoses()
+{
+    std::unordered_map<VehicleSimApiBase*, msr::airlib::Pose> poses;
+    uint64_t poses_queued;
+    {
+        std::lock_guard<std::mutex> lock(poses_mutex_);
+        poses.swap(pending_poses_);
+        poses_queued = poses_queued_;
+    }
+
+    //on the game thread setPose runs right away
+    for (const auto& vehicle_pose : poses)
+        vehicle_pose.first->setPose(vehicle_pose.second, true);
+
+    {
+        std::lock_guard<std::mutex> lock(poses_mutex_);
+        poses_applied_ = poses_queued;
+    }
+    poses_applied_cv_.notify_all();
+}
+
+void FRecordingPlayback::playRow(const Row& row)
+{
+    VehicleSimApiBase* vehicle_sim_api = vehicle_sim_apis_.findOrDefault(row.vehicle_name, nullptr);
+    if (vehicle_sim_api == nullptr)
+        return;
+
+    msr::airlib::Pose pose = row.pose;
+    pose.orientation.normalize();
+    uint64_t pose_number;
+    {
+        std::lock_guard<std::mutex> lock(poses_mutex_);
+        pending_poses_[vehicle_sim_api] = pose;
+        pose_number = ++poses_queued_;
+    }
+
+    if (output_file_) {
+        //the images have to show the row's pose
+        if (!waitForPoseApplied(pose_number))
+            return;
+
+        std::vector<ImageCaptureBase::ImageResponse> responses;
+        const auto& requests = options_.recording_setting.requests;
+        const auto request = requests.find(row.vehicle_name);
+        if (request != requests.end())
+            vehicle_sim_api->getImageCapture()->getImages(request->second, responses);
+
+        output_file_->appendRecord(responses, row.vehicle_name, row.columns);
+    }
+}
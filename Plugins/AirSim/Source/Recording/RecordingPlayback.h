@@ -0,0 +1,115 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HAL/Runnable.h"
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <fstream>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <unordered_map>
+#include "api/VehicleSimApiBase.hpp"
+#include "common/AirSimSettings.hpp"
+#include "common/common_utils/UniqueValueMap.hpp"
+#include "Recording/RecordingFile.h"
+
+//Replays a recording made by FRecordingThread.
+//Rows are streamed from airsim_rec.txt or airsim_rec.bin on a worker thread with
+//read-ahead, and each vehicle is moved to its recorded pose at the recorded
+//timestamp, optionally scaled in time. The poses are handed to the game thread,
+//which applies them in applyPendingPoses every tick; the playback thread never
+//blocks on a game thread that may be waiting for it. When images are regenerated, the cameras
+//listed in the Recording settings are captured after every row and written to a
+//new recording folder, so a dataset can be rendered again with different camera
+//settings than it was recorded with.
+class FRecordingPlayback : public FRunnable
+{
+public:
+    typedef msr::airlib::AirSimSettings::RecordingSetting RecordingSetting;
+    typedef msr::airlib::VehicleSimApiBase VehicleSimApiBase;
+    typedef msr::airlib::ImageCaptureBase ImageCaptureBase;
+
+    struct Options {
+        std::string file_path;
+        //1 plays in real time, 2 twice as fast, 0 or less as fast as possible
+        float time_scale = 1.0f;
+        bool regenerate_images = false;
+        //cameras and output folder used when regenerating images
+        RecordingSetting recording_setting;
+    };
+
+public:
+    FRecordingPlayback(const Options& options,
+        const common_utils::UniqueValueMap<std::string, VehicleSimApiBase*>& vehicle_sim_apis);
+    virtual ~FRecordingPlayback();
+
+    //any thread: asks the playback to end without waiting for it, see isFinished
+    void stop();
+    bool isFinished() const;
+    uint64_t getRowsPlayed() const;
+
+    //game thread: moves the vehicles to the latest poses played since the last call
+    void applyPendingPoses();
+
+protected:
+    virtual bool Init() override;
+    virtual uint32 Run() override;
+    virtual void Stop() override;
+
+private:
+    struct Row {
+        std::string vehicle_name;
+        uint64_t timestamp_millis = 0;
+        msr::airlib::Pose pose;
+        //every column except ImageFile, in the format of the source file
+        std::string columns;
+    };
+
+    bool openFile();
+    bool readHeader(std::string& header_columns);
+    void readAhead();
+    bool readTextRow(Row& row);
+    bool readBinaryRow(Row& row);
+    bool mapColumns(const std::vector<std::string>& names);
+    void waitForRowTime(const Row& row);
+    bool waitForPoseApplied(uint64_t pose_number);
+    void playRow(const Row& row);
+
+private:
+    Options options_;
+    common_utils::UniqueValueMap<std::string, VehicleSimApiBase*> vehicle_sim_apis_;
+
+    std::ifstream file_;
+    std::vector<char> stream_buffer_;
+    bool binary_format_ = false;
+    bool end_of_file_ = false;
+    std::deque<Row> rows_;
+
+    //positions of the columns we need within a row
+    int vehicle_name_column_ = -1, timestamp_column_ = -1;
+    int position_columns_[3] = { -1, -1, -1 };
+    int orientation_columns_[4] = { -1, -1, -1, -1 };
+    int image_file_column_ = -1;
+
+    std::unique_ptr<RecordingFile> output_file_;
+
+    double start_wall_seconds_ = 0;
+    uint64_t first_timestamp_millis_ = 0;
+    bool has_first_timestamp_ = false;
+
+    //latest pose per vehicle not applied yet, and counts of poses handed over and applied
+    std::mutex poses_mutex_;
+    std::condition_variable poses_applied_cv_;
+    std::unordered_map<VehicleSimApiBase*, msr::airlib::Pose> pending_poses_;
+    uint64_t poses_queued_ = 0;
+    uint64_t poses_applied_ = 0;
+
+    FThreadSafeCounter stop_task_counter_;
+    std::atomic<bool> is_finished_;
+    std::atomic<uint64_t> rows_played_;
+    std::unique_ptr<FRunnableThread> thread_;
+};
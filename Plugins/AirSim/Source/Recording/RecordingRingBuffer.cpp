@@ -0,0 +1,149 @@
+#include "RecordingRingBuffer.h"
+#include <cstring>
+
+RecordingRingBuffer::RecordingRingBuffer(size_t capacity_bytes, double retention_secs)
+    : arena_(capacity_bytes), retention_nanos_(static_cast<TTimePoint>(retention_secs * 1.0E9))
+{
+}
+
+bool RecordingRingBuffer::push(TTimePoint timestamp, const std::string& vehicle_name, const std::string& row_columns,
+    const std::string& sensor_rows, const std::vector<ImageResponse>& responses)
+{
+    //drop what fell out of the retention window
+    while (entries_.size() > 0 && timestamp - entries_.front().timestamp > retention_nanos_)
+        entries_.pop_front();
+
+    const size_t size = getSerializedSize(vehicle_name, row_columns, sensor_rows, responses);
+    size_t offset;
+    if (!allocate(size, offset))
+        return false;
+
+    uint8_t* out = arena_.data() + offset;
+    writeString(out, vehicle_name);
+    writeString(out, row_columns);
+    writeString(out, sensor_rows);
+    writeValue<uint32_t>(out, static_cast<uint32_t>(responses.size()));
+    for (const auto& response : responses) {
+        writeString(out, response.camera_name);
+        writeValue<int32_t>(out, static_cast<int32_t>(response.image_type));
+        writeValue<uint8_t>(out, response.pixels_as_float ? 1 : 0);
+        writeValue<uint8_t>(out, response.compress ? 1 : 0);
+        writeValue<int32_t>(out, response.width);
+        writeValue<int32_t>(out, response.height);
+        writeValue<uint64_t>(out, response.image_data_uint8.size());
+        writeBytes(out, response.image_data_uint8.data(), response.image_data_uint8.size());
+        writeValue<uint64_t>(out, response.image_data_float.size());
+        writeBytes(out, response.image_data_float.data(), response.image_data_float.size() * sizeof(float));
+    }
+
+    entries_.push_back(Entry{ offset, size, timestamp });
+    return true;
+}
+
+void RecordingRingBuffer::drain(const SampleVisitor& visitor)
+{
+    std::vector<ImageResponse> responses;
+
+    for (const auto& entry : entries_) {
+        const uint8_t* in = arena_.data() + entry.offset;
+        const std::string vehicle_name = readString(in);
+        const std::string row_columns = readString(in);
+        const std::string sensor_rows = readString(in);
+
+        responses.resize(readValue<uint32_t>(in));
+        for (auto& response : responses) {
+            response.camera_name = readString(in);
+            response.image_type = static_cast<msr::airlib::ImageCaptureBase::ImageType>(readValue<int32_t>(in));
+            response.pixels_as_float = readValue<uint8_t>(in) != 0;
+            response.compress = readValue<uint8_t>(in) != 0;
+            response.width = readValue<int32_t>(in);
+            response.height = readValue<int32_t>(in);
+            response.image_data_uint8.resize(static_cast<size_t>(readValue<uint64_t>(in)));
+            readBytes(in, response.image_data_uint8.data(), response.image_data_uint8.size());
+            response.image_data_float.resize(static_cast<size_t>(readValue<uint64_t>(in)));
+            readBytes(in, response.image_data_float.data(), response.image_data_float.size() * sizeof(float));
+        }
+
+        visitor(vehicle_name, row_columns, sensor_rows, responses);
+    }
+
+    entries_.clear();
+}
+
+bool RecordingRingBuffer::allocate(size_t size, size_t& offset)
+{
+    if (size > arena_.size())
+        return false;
+
+    //entries are contiguous and never straddle the end of the arena,
+    //so the free space is either one region or the two ends of the arena
+    while (true) {
+        if (entries_.size() == 0) {
+            offset = 0;
+            return true;
+        }
+
+        const size_t oldest = entries_.front().offset;
+        const size_t end = entries_.back().offset + entries_.back().size;
+        const bool wrapped = entries_.back().offset < oldest;
+
+        if (!wrapped) {
+            if (arena_.size() - end >= size) {
+                offset = end;
+                return true;
+            }
+            if (oldest >= size) {
+                offset = 0;
+                return true;
+            }
+        }
+        else if (oldest - end >= size) {
+            offset = end;
+            return true;
+        }
+
+        entries_.pop_front();
+    }
+}
+
+size_t RecordingRingBuffer::getSerializedSize(const std::string& vehicle_name, const std::string& row_columns,
+    const std::string& sensor_rows, const std::vector<ImageResponse>& responses) const
+{
+    size_t size = sizeof(uint32_t) + vehicle_name.size() + sizeof(uint32_t) + row_columns.size()
+        + sizeof(uint32_t) + sensor_rows.size() + sizeof(uint32_t);
+    for (const auto& response : responses) {
+        size += sizeof(uint32_t) + response.camera_name.size();
+        size += sizeof(int32_t) + 2 * sizeof(uint8_t) + 2 * sizeof(int32_t);
+        size += sizeof(uint64_t) + response.image_data_uint8.size();
+        size += sizeof(uint64_t) + response.image_data_float.size() * sizeof(float);
+    }
+    return size;
+}
+
+void RecordingRingBuffer::writeBytes(uint8_t*& out, const void* data, size_t size) const
+{
+    if (size > 0)
+        std::memcpy(out, data, size);
+    out += size;
+}
+
+void RecordingRingBuffer::writeString(uint8_t*& out, const std::string& str) const
+{
+    writeValue<uint32_t>(out, static_cast<uint32_t>(str.size()));
+    writeBytes(out, str.data(), str.size());
+}
+
+void RecordingRingBuffer::readBytes(const uint8_t*& in, void* data, size_t size) const
+{
+    if (size > 0)
+        std::memcpy(data, in, size);
+    in += size;
+}
+
+std::string RecordingRingBuffer::readString(const uint8_t*& in) const
+{
+    const uint32_t size = readValue<uint32_t>(in);
+    std::string str(reinterpret_cast<const char*>(in), size);
+    in += size;
+    return str;
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include <string>
+#include <vector>
+#include <deque>
+#include <functional>
+#include "common/Common.hpp"
+#include "common/ImageCaptureBase.hpp"
+
+//Fixed size in-memory store for the black box recorder.
+//Samples (row columns, sensor rows and images) are serialized into one arena that is
+//allocated when recording starts, so the memory budget is never exceeded: when a
+//new sample does not fit, the oldest samples are dropped until it does. Samples
+//older than the retention window are dropped as well.
+class RecordingRingBuffer {
+public:
+    typedef msr::airlib::ImageCaptureBase::ImageResponse ImageResponse;
+    typedef msr::airlib::TTimePoint TTimePoint;
+    typedef std::function<void(const std::string& vehicle_name, const std::string& row_columns,
+        const std::string& sensor_rows, const std::vector<ImageResponse>& responses)> SampleVisitor;
+
+public:
+    RecordingRingBuffer(size_t capacity_bytes, double retention_secs);
+
+    //returns false if the sample is larger than the whole budget
+    //sensor_rows are finished rows as produced by SensorRecord::appendRows
+    bool push(TTimePoint timestamp, const std::string& vehicle_name, const std::string& row_columns,
+        const std::string& sensor_rows, const std::vector<ImageResponse>& responses);
+
+    //visits samples from oldest to newest and empties the buffer
+    void drain(const SampleVisitor& visitor);
+
+    size_t getSampleCount() const
+    {
+        return entries_.size();
+    }
+    size_t getCapacity() const
+    {
+        return arena_.size();
+    }
+
+private:
+    struct Entry {
+        size_t offset;
+        size_t size;
+        TTimePoint timestamp;
+    };
+
+    bool allocate(size_t size, size_t& offset);
+    size_t getSerializedSize(const std::string& vehicle_name, const std::string& row_columns,
+        const std::string& sensor_rows, const std::vector<ImageResponse>& responses) const;
+
+    void writeBytes(uint8_t*& out, const void* data, size_t size) const;
+    void writeString(uint8_t*& out, const std::string& str) const;
+    template<typename T>
+    void writeValue(uint8_t*& out, const T& value) const
+    {
+        writeBytes(out, &value, sizeof(T));
+    }
+
+    void readBytes(const uint8_t*& in, void* data, size_t size) const;
+    std::string readString(const uint8_t*& in) const;
+    template<typename T>
+    T readValue(const uint8_t*& in) const
+    {
+        T value;
+        readBytes(in, &value, sizeof(T));
+        return value;
+    }
+
+private:
+    std::vector<uint8_t> arena_;
+    std::deque<Entry> entries_;
+    TTimePoint retention_nanos_;
+};
@@ -4,7 +4,9 @@
 
 #include <thread>
 #include <mutex>
+#include <algorithm>
 #include "RenderRequest.h"
+#include "Recording/SensorRecord.h"
 #include "PIPCamera.h"
 
 
@@ -12,10 +14,16 @@ std::unique_ptr<FRecordingThread> FRecordingThread::running_instance_;
 std::unique_ptr<FRecordingThread> FRecordingThread::finishing_instance_;
 msr::airlib::WorkerThreadSignal FRecordingThread::finishing_signal_;
 bool FRecordingThread::first_ = true;
+std::mutex FRecordingThread::instance_mutex_;
+
+namespace {
+    //pending samples above which the recorder reports that it can't keep up
+    constexpr size_t kSampleBacklogWarning = 1000;
+}
 
 
 FRecordingThread::FRecordingThread()
-    : stop_task_counter_(0), recording_file_(nullptr), is_ready_(false)
+    : stop_task_counter_(0), recording_file_(nullptr), black_box_triggered_(false), is_ready_(false)
 {
     thread_.reset(FRunnableThread::Create(this, TEXT("FRecordingThread"), 0, TPri_BelowNormal)); // Windows default, possible to specify more priority
 }
@@ -29,8 +37,16 @@ void FRecordingThread::startRecording(const RecordingSetting& settings,
     //TODO: check FPlatformProcess::SupportsMultithreading()?
     assert(!isRecording());
 
+    std::lock_guard<std::mutex> instance_lock(instance_mutex_);
+
     running_instance_.reset(new FRecordingThread());
     running_instance_->settings_ = settings;
+    if (settings.trigger == "SimTime")
+        running_instance_->trigger_mode_ = TriggerMode::SimTime;
+    else if (settings.trigger == "PhysicsSteps")
+        running_instance_->trigger_mode_ = TriggerMode::PhysicsSteps;
+    else
+        running_instance_->trigger_mode_ = TriggerMode::WallClock;
     running_instance_->vehicle_sim_apis_ = vehicle_sim_apis;
 
     for (const auto& vehicle_sim_api : vehicle_sim_apis) {
@@ -42,9 +58,15 @@ void FRecordingThread::startRecording(const RecordingSetting& settings,
 
     running_instance_->last_screenshot_on_ = 0;
 
+    if (settings.black_box_enabled) {
+        //the whole budget is reserved up front so memory use doesn't grow while recording
+        running_instance_->black_box_.reset(new RecordingRingBuffer(
+            static_cast<size_t>(settings.black_box_memory_mb) * 1024 * 1024, settings.black_box_pre_trigger_secs));
+    }
+
     running_instance_->recording_file_.reset(new RecordingFile());
     // Just need any 1 instance, to set the header line of the record file
-    running_instance_->recording_file_->startRecording(*(vehicle_sim_apis.begin()), settings.folder);
+    running_instance_->recording_file_->startRecording(*(vehicle_sim_apis.begin()), settings);
 
     // Set is_ready at the end, setting this before can cause a race when the file isn't open yet
     running_instance_->is_ready_ = true;
@@ -67,6 +89,8 @@ bool FRecordingThread::isRecording()
 
 void FRecordingThread::stopRecording()
 {
+    std::lock_guard<std::mutex> instance_lock(instance_mutex_);
+
     if (running_instance_)
     {
         assert(finishing_instance_ == nullptr);
@@ -105,43 +129,254 @@ bool FRecordingThread::Init()
     return true;
 }
 
+void FRecordingThread::onSimStep()
+{
+    std::lock_guard<std::mutex> instance_lock(instance_mutex_);
+
+    FRecordingThread* instance = running_instance_.get();
+    if (instance == nullptr || !instance->is_ready_ || instance->trigger_mode_ == TriggerMode::WallClock)
+        return;
+
+    bool is_due;
+    if (instance->trigger_mode_ == TriggerMode::PhysicsSteps) {
+        const uint64_t every_n_steps = std::max(1u, instance->settings_.record_every_n_steps);
+        is_due = instance->steps_since_start_ % every_n_steps == 0;
+    }
+    else {
+        //advance by whole intervals from the first sample so that rounding never accumulates
+        const msr::airlib::TTimePoint now = msr::airlib::ClockFactory::get()->nowNanos();
+        const auto interval = static_cast<msr::airlib::TTimePoint>(instance->settings_.record_interval * 1.0E9);
+        if (instance->next_sample_on_ == 0)
+            instance->next_sample_on_ = now;
+        is_due = now >= instance->next_sample_on_;
+        if (is_due)
+            instance->next_sample_on_ += std::max<msr::airlib::TTimePoint>(interval, 1);
+    }
+    ++instance->steps_since_start_;
+
+    if (is_due)
+        instance->captureSample();
+}
+
+void FRecordingThread::captureSample()
+{
+    std::vector<Sample> samples;
+    RecordLineBuffer& buffer = RecordLineBuffer::threadLocal();
+    const msr::airlib::TTimePoint time_stamp = msr::airlib::ClockFactory::get()->nowNanos();
+
+    for (const auto& vehicle_sim_api : vehicle_sim_apis_) {
+        const auto& vehicle_name = vehicle_sim_api->getVehicleName();
+
+        const auto* kinematics = vehicle_sim_api->getGroundTruthKinematics();
+        bool is_pose_unequal = kinematics && last_poses_[vehicle_name] != kinematics->pose;
+
+        if (kinematics)
+            checkBlackBoxThreshold(*kinematics);
+
+        if (!settings_.record_on_move || is_pose_unequal) {
+            last_poses_[vehicle_name] = kinematics->pose;
+
+            //columns are formatted here so they reflect exactly this simulation step
+            buffer.reset(recording_file_->getRowFormat());
+            static_cast<const PawnSimApi*>(vehicle_sim_api)->appendRecordFileLine(buffer);
+            //this runs in the physics step, so lidar clouds are not being replaced while they are read
+            samples.push_back(Sample{ vehicle_name, buffer.columnsStr(), captureSensorRows(vehicle_sim_api, true), time_stamp });
+        }
+    }
+
+    if (samples.size() == 0)
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(pending_samples_mutex_);
+        pending_samples_.push_back(std::move(samples));
+
+        if (pending_samples_.size() > kSampleBacklogWarning && !reported_backlog_) {
+            reported_backlog_ = true;
+            UAirBlueprintLib::LogMessageString("Recording is falling behind the simulation, ",
+                "consider a longer RecordInterval or fewer cameras", LogDebugLevel::Failure);
+        }
+    }
+    pending_samples_cv_.notify_one();
+}
+
+void FRecordingThread::triggerBlackBox(const std::string& reason)
+{
+    std::lock_guard<std::mutex> instance_lock(instance_mutex_);
+
+    FRecordingThread* instance = running_instance_.get();
+    if (instance == nullptr || instance->black_box_ == nullptr)
+        return;
+
+    //the first reason of a pending trigger is kept
+    if (!instance->black_box_triggered_) {
+        std::lock_guard<std::mutex> lock(instance->black_box_trigger_mutex_);
+        instance->black_box_trigger_reason_ = reason;
+    }
+    instance->black_box_triggered_ = true;
+}
+
+bool FRecordingThread::isBlackBoxEnabled()
+{
+    std::lock_guard<std::mutex> instance_lock(instance_mutex_);
+    return running_instance_ != nullptr && running_instance_->black_box_ != nullptr;
+}
+
+void FRecordingThread::checkBlackBoxThreshold(const msr::airlib::Kinematics::State& kinematics)
+{
+    if (black_box_ && settings_.black_box_accel_threshold > 0 &&
+        kinematics.accelerations.linear.norm() > settings_.black_box_accel_threshold) {
+        if (!black_box_triggered_) {
+            std::lock_guard<std::mutex> lock(black_box_trigger_mutex_);
+            black_box_trigger_reason_ = "acceleration threshold";
+        }
+        black_box_triggered_ = true;
+    }
+}
+
+std::string FRecordingThread::captureSensorRows(const VehicleSimApiBase* vehicle_sim_api, bool include_lidar) const
+{
+    std::string sensor_rows;
+    if (black_box_ == nullptr)
+        return sensor_rows;
+
+    const msr::airlib::VehicleApiBase* vehicle_api = static_cast<const PawnSimApi*>(vehicle_sim_api)->getVehicleApiBase();
+    if (vehicle_api != nullptr)
+        SensorRecord::appendRows(*vehicle_api, vehicle_sim_api->getVehicleName(), recording_file_->getRowFormat(),
+            include_lidar, sensor_rows);
+    return sensor_rows;
+}
+
+void FRecordingThread::recordSample(const std::string& vehicle_name, const std::string& row_columns, const std::string& sensor_rows,
+    const std::vector<ImageCaptureBase::ImageResponse>& responses)
+{
+    if (black_box_ == nullptr) {
+        recording_file_->appendRecord(responses, vehicle_name, row_columns);
+        return;
+    }
+
+    const msr::airlib::TTimePoint now = msr::airlib::ClockFactory::get()->nowNanos();
+
+    if (black_box_triggered_.exchange(false)) {
+        std::string reason;
+        {
+            std::lock_guard<std::mutex> lock(black_box_trigger_mutex_);
+            reason = black_box_trigger_reason_;
+        }
+        UAirBlueprintLib::LogMessageString("Black box triggered by ", reason, LogDebugLevel::Informational);
+
+        black_box_->drain([this](const std::string& buffered_vehicle_name, const std::string& buffered_row_columns,
+            const std::string& buffered_sensor_rows, const std::vector<ImageCaptureBase::ImageResponse>& buffered_responses) {
+            recording_file_->appendRecord(buffered_responses, buffered_vehicle_name, buffered_row_columns);
+            recording_file_->appendSensorRows(buffered_sensor_rows);
+        });
+
+        //another trigger during the post trigger period extends it
+        post_trigger_until_ = now + static_cast<msr::airlib::TTimePoint>(settings_.black_box_post_trigger_secs * 1.0E9);
+    }
+
+    if (now < post_trigger_until_) {
+        recording_file_->appendRecord(responses, vehicle_name, row_columns);
+        recording_file_->appendSensorRows(sensor_rows);
+    }
+    else if (!black_box_->push(now, vehicle_name, row_columns, sensor_rows, responses) && !reported_oversized_sample_) {
+        reported_oversized_sample_ = true;
+        UAirBlueprintLib::LogMessageString("Recording sample is larger than the black box memory budget, ",
+            "increase Recording.BlackBox.MemoryBudgetMB", LogDebugLevel::Failure);
+    }
+}
+
 uint32 FRecordingThread::Run()
 {
     while (stop_task_counter_.GetValue() == 0)
     {
         //make sure all vars are set up
         if (is_ready_) {
-            bool interval_elapsed = msr::airlib::ClockFactory::get()->elapsedSince(last_screenshot_on_) > settings_.record_interval;
+            if (trigger_mode_ == TriggerMode::WallClock)
+                recordOnWallClock();
+            else
+                recordPendingSamples();
+        }
+    }
+
+    //samples taken before the stop request still belong to the recording
+    if (trigger_mode_ != TriggerMode::WallClock && recording_file_) {
+        recordPendingSamples();
 
-            if (interval_elapsed) {
-                last_screenshot_on_ = msr::airlib::ClockFactory::get()->nowNanos();
+        if (max_image_skew_ > 0)
+            UAirBlueprintLib::LogMessageString("Recording: images were rendered up to ",
+                std::to_string(max_image_skew_ * 1.0E3) + " ms of simulated time after their rows", LogDebugLevel::Informational);
+    }
+
+    recording_file_.reset();
 
-                for (const auto& vehicle_sim_api : vehicle_sim_apis_) {
-                    const auto& vehicle_name = vehicle_sim_api->getVehicleName();
+    return 0;
+}
 
-                    const auto* kinematics = vehicle_sim_api->getGroundTruthKinematics();
-                    bool is_pose_unequal = kinematics && last_poses_[vehicle_name] != kinematics->pose;
+void FRecordingThread::recordOnWallClock()
+{
+    bool interval_elapsed = msr::airlib::ClockFactory::get()->elapsedSince(last_screenshot_on_) > settings_.record_interval;
 
-                    if (!settings_.record_on_move || is_pose_unequal) {
-                        last_poses_[vehicle_name] = kinematics->pose;
+    if (interval_elapsed) {
+        last_screenshot_on_ = msr::airlib::ClockFactory::get()->nowNanos();
 
-                        std::vector<ImageCaptureBase::ImageResponse> responses;
+        for (const auto& vehicle_sim_api : vehicle_sim_apis_) {
+            const auto& vehicle_name = vehicle_sim_api->getVehicleName();
 
-                        image_captures_[vehicle_name]->getImages(settings_.requests[vehicle_name], responses);
-                        recording_file_->appendRecord(responses, vehicle_sim_api);
-                    }
+            const auto* kinematics = vehicle_sim_api->getGroundTruthKinematics();
+            bool is_pose_unequal = kinematics && last_poses_[vehicle_name] != kinematics->pose;
+
+            if (kinematics)
+                checkBlackBoxThreshold(*kinematics);
+
+            if (!settings_.record_on_move || is_pose_unequal) {
+                last_poses_[vehicle_name] = kinematics->pose;
+
+                std::vector<ImageCaptureBase::ImageResponse> responses;
+
+                image_captures_[vehicle_name]->getImages(settings_.requests[vehicle_name], responses);
+                if (black_box_ == nullptr)
+                    recording_file_->appendRecord(responses, vehicle_sim_api);
+                else {
+                    RecordLineBuffer& buffer = RecordLineBuffer::threadLocal();
+                    buffer.reset(recording_file_->getRowFormat());
+                    static_cast<const PawnSimApi*>(vehicle_sim_api)->appendRecordFileLine(buffer);
+                    //lidar clouds are replaced by the physics thread while this thread runs
+                    recordSample(vehicle_name, buffer.columnsStr(), captureSensorRows(vehicle_sim_api, false), responses);
                 }
             }
         }
-
     }
+}
 
-    recording_file_.reset();
+void FRecordingThread::recordPendingSamples()
+{
+    std::deque<std::vector<Sample>> samples;
+    {
+        std::unique_lock<std::mutex> lock(pending_samples_mutex_);
+        //wake up periodically so that Stop() is noticed
+        pending_samples_cv_.wait_for(lock, std::chrono::milliseconds(100), [this]() {
+            return pending_samples_.size() > 0;
+        });
+        samples.swap(pending_samples_);
+    }
 
-    return 0;
+    for (const auto& sample : samples) {
+        for (const auto& vehicle_sample : sample) {
+            //images can only be taken now, after the step the columns were captured on;
+            //their files are named after the simulated time of their own frame
+            std::vector<ImageCaptureBase::ImageResponse> responses;
+            image_captures_[vehicle_sample.vehicle_name]->getImages(settings_.requests[vehicle_sample.vehicle_name], responses);
+            for (const auto& response : responses) {
+                if (response.time_stamp > vehicle_sample.time_stamp)
+                    max_image_skew_ = std::max(max_image_skew_,
+                        msr::airlib::ClockFactory::get()->elapsedBetween(response.time_stamp, vehicle_sample.time_stamp));
+            }
+            recordSample(vehicle_sample.vehicle_name, vehicle_sample.row_columns, vehicle_sample.sensor_rows, responses);
+        }
+    }
 }
 
-
 void FRecordingThread::Stop()
 {
     stop_task_counter_.Increment();
@@ -6,8 +6,13 @@
 #include "AirBlueprintLib.h"
 #include "api/VehicleSimApiBase.hpp"
 #include "Recording/RecordingFile.h"
+#include "Recording/RecordingRingBuffer.h"
 #include "physics/Kinematics.hpp"
 #include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <atomic>
 #include "common/ClockFactory.hpp"
 #include "common/AirSimSettings.hpp"
 #include "common/WorkerThread.hpp"
@@ -30,12 +35,44 @@ public:
     static void killRecording();
     static bool isRecording();
 
+    //called once per simulation step by RecordingTrigger, or per tick when there is no physics world
+    static void onSimStep();
+
+    //writes out the black box buffer and keeps recording for the post trigger period,
+    //safe to call from any thread, ignored unless Recording.BlackBox is enabled
+    static void triggerBlackBox(const std::string& reason);
+    //true while a recording with Recording.BlackBox enabled runs, to skip building trigger reasons
+    static bool isBlackBoxEnabled();
+
 protected:
     virtual bool Init() override;
     virtual uint32 Run() override;
     virtual void Stop() override;
     virtual void Exit() override;
 
+private:
+    enum class TriggerMode {
+        WallClock, SimTime, PhysicsSteps
+    };
+
+    //rows captured on the simulation thread, images are added by the recording thread;
+    //rendering cannot wait in the physics step, so the images come from the frame rendered
+    //when the recording thread gets to the sample, which may be some steps later
+    struct Sample {
+        std::string vehicle_name;
+        std::string row_columns;
+        std::string sensor_rows; //only captured for the black box, see SensorRecord
+        msr::airlib::TTimePoint time_stamp; //simulated time the row was captured at
+    };
+
+    void recordOnWallClock();
+    void recordPendingSamples();
+    void captureSample();
+    std::string captureSensorRows(const VehicleSimApiBase* vehicle_sim_api, bool include_lidar) const;
+    void recordSample(const std::string& vehicle_name, const std::string& row_columns, const std::string& sensor_rows,
+        const std::vector<ImageCaptureBase::ImageResponse>& responses);
+    void checkBlackBoxThreshold(const msr::airlib::Kinematics::State& kinematics);
+
 private:
     FThreadSafeCounter stop_task_counter_;
 
@@ -43,6 +80,8 @@ private:
     static std::unique_ptr<FRecordingThread> finishing_instance_;
     static msr::airlib::WorkerThreadSignal finishing_signal_;
     static bool first_;
+    //guards running_instance_ against onSimStep on the physics thread
+    static std::mutex instance_mutex_;
     
     static std::unique_ptr<FRecordingThread> instance_;
 
@@ -56,5 +95,22 @@ private:
 
     msr::airlib::TTimePoint last_screenshot_on_;
 
+    TriggerMode trigger_mode_ = TriggerMode::WallClock;
+    uint64_t steps_since_start_ = 0;
+    msr::airlib::TTimePoint next_sample_on_ = 0;
+    std::deque<std::vector<Sample>> pending_samples_;
+    std::mutex pending_samples_mutex_;
+    std::condition_variable pending_samples_cv_;
+    bool reported_backlog_ = false;
+    //largest simulated time between a row and its images, reported when recording stops
+    msr::airlib::TTimeDelta max_image_skew_ = 0;
+
+    std::unique_ptr<RecordingRingBuffer> black_box_;
+    std::atomic<bool> black_box_triggered_;
+    std::string black_box_trigger_reason_;
+    std::mutex black_box_trigger_mutex_;
+    msr::airlib::TTimePoint post_trigger_until_ = 0;
+    bool reported_oversized_sample_ = false;
+
     bool is_ready_;
 };
\ No newline at end of file
@@ -0,0 +1,24 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "common/UpdatableObject.hpp"
+#include "Recording/RecordingThread.h"
+
+//Member of the physics world that lets the recorder sample on simulation steps
+//rather than on wall clock time. Because it is updated inside the physics loop,
+//rows are produced at exactly the same simulated instants on every run,
+//regardless of how fast the host is.
+class RecordingTrigger : public msr::airlib::UpdatableObject {
+public:
+    virtual void update() override
+    {
+        UpdatableObject::update();
+
+        FRecordingThread::onSimStep();
+    }
+
+protected:
+    virtual void resetImplementation() override
+    {
+    }
+};
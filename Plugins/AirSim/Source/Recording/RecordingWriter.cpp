@@ -0,0 +1,358 @@
+#include "RecordingWriter.h"
+#include "HAL/PlatformFilemanager.h"
+#include "HAL/PlatformTime.h"
+#include "AirBlueprintLib.h"
+#include "common/common_utils/Utils.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#if PLATFORM_LINUX || PLATFORM_MAC
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#define AIRSIM_RECORDING_POSIX_IO 1
+#else
+#define AIRSIM_RECORDING_POSIX_IO 0
+#endif
+
+namespace {
+    //O_DIRECT needs buffer address, file offset and transfer size aligned to the logical block size
+    constexpr size_t kIoAlignment = 4096;
+    constexpr size_t kMaxLatencySamples = 4096;
+
+    size_t alignUp(size_t value, size_t alignment)
+    {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+#if AIRSIM_RECORDING_POSIX_IO
+    //a write that makes no progress this many times in a row is treated as an error
+    constexpr int kMaxZeroLengthWrites = 16;
+
+    //writes all bytes, retrying writes interrupted by a signal and short writes;
+    //false with errno set only on a real error
+    bool writeAll(int fd, const uint8_t* bytes, size_t size)
+    {
+        int zero_length_writes = 0;
+        while (size > 0) {
+            const ssize_t written = ::write(fd, bytes, size);
+            if (written < 0) {
+                if (errno == EINTR)
+                    continue;
+                return false;
+            }
+            if (written == 0) {
+                if (++zero_length_writes >= kMaxZeroLengthWrites) {
+                    errno = EIO;
+                    return false;
+                }
+                continue;
+            }
+            zero_length_writes = 0;
+            bytes += written;
+            size -= static_cast<size_t>(written);
+        }
+        return true;
+    }
+#endif
+}
+
+RecordingWriter::Options::Options(const RecordingSetting& settings)
+{
+    buffer_size = static_cast<size_t>(settings.write_buffer_size_kb) * 1024;
+    flush_interval = settings.flush_interval;
+    preallocate_bytes = static_cast<uint64_t>(settings.preallocate_mb) * 1024 * 1024;
+    direct_io = settings.direct_io;
+
+    if (settings.sync_policy == "None")
+        sync_policy = SyncPolicy::None;
+    else if (settings.sync_policy == "OnFlush")
+        sync_policy = SyncPolicy::OnFlush;
+    else
+        sync_policy = SyncPolicy::OnClose;
+}
+
+RecordingWriter::RecordingWriter()
+{
+    latency_samples_ms_.reserve(kMaxLatencySamples);
+}
+
+RecordingWriter::~RecordingWriter()
+{
+    close();
+}
+
+bool RecordingWriter::open(const std::string& file_path, const Options& options)
+{
+    close();
+
+    options_ = options;
+    buffer_capacity_ = alignUp(std::max<size_t>(options_.buffer_size, kIoAlignment), kIoAlignment);
+    buffer_ = static_cast<uint8_t*>(FMemory::Malloc(buffer_capacity_, kIoAlignment));
+    buffer_used_ = 0;
+    failed_ = false;
+    bytes_written_ = 0;
+    flushes_ = 0;
+    latency_samples_ms_.clear();
+    next_latency_sample_ = 0;
+
+    if (!openHandle(file_path)) {
+        FMemory::Free(buffer_);
+        buffer_ = nullptr;
+        return false;
+    }
+
+    opened_on_cycles_ = last_flush_cycles_ = FPlatformTime::Cycles64();
+    closed_on_cycles_ = 0;
+    return true;
+}
+
+void RecordingWriter::close()
+{
+    if (!isOpen())
+        return;
+
+    //the unaligned tail left behind by O_DIRECT writes goes out with a regular write
+    disableDirectIo();
+    flush();
+    if (options_.sync_policy != SyncPolicy::None)
+        syncHandle();
+    closeHandle();
+
+    FMemory::Free(buffer_);
+    buffer_ = nullptr;
+    buffer_used_ = 0;
+    closed_on_cycles_ = FPlatformTime::Cycles64();
+}
+
+bool RecordingWriter::isOpen() const
+{
+    return fd_ >= 0 || file_handle_ != nullptr;
+}
+
+bool RecordingWriter::write(const void* data, size_t size)
+{
+    if (!isOpen() || failed_)
+        return false;
+
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    while (size > 0) {
+        const size_t chunk = std::min(size, buffer_capacity_ - buffer_used_);
+        std::memcpy(buffer_ + buffer_used_, bytes, chunk);
+        buffer_used_ += chunk;
+        bytes += chunk;
+        size -= chunk;
+
+        if (buffer_used_ == buffer_capacity_ && !flush())
+            return false;
+    }
+    return true;
+}
+
+bool RecordingWriter::flush()
+{
+    if (!isOpen() || failed_)
+        return false;
+    if (buffer_used_ == 0)
+        return true;
+
+    const uint64 start_cycles = FPlatformTime::Cycles64();
+
+    //with O_DIRECT only whole blocks can be written, the tail stays in the buffer until close
+    size_t write_size = buffer_used_;
+    if (direct_io_active_)
+        write_size = buffer_used_ / kIoAlignment * kIoAlignment;
+
+    if (write_size > 0) {
+        if (!writeToHandle(buffer_, write_size)) {
+            fail();
+            return false;
+        }
+        bytes_written_ += write_size;
+        buffer_used_ -= write_size;
+        if (buffer_used_ > 0)
+            std::memmove(buffer_, buffer_ + write_size, buffer_used_);
+    }
+
+    if (options_.sync_policy == SyncPolicy::OnFlush)
+        syncHandle();
+
+    ++flushes_;
+    last_flush_cycles_ = FPlatformTime::Cycles64();
+    addLatencySample(start_cycles);
+    return true;
+}
+
+bool RecordingWriter::hasFailed() const
+{
+    return failed_;
+}
+
+void RecordingWriter::flushIfDue()
+{
+    if (options_.flush_interval > 0 &&
+        FPlatformTime::ToSeconds64(FPlatformTime::Cycles64() - last_flush_cycles_) >= options_.flush_interval) {
+        flush();
+    }
+}
+
+bool RecordingWriter::writeFile(const std::string& file_path, const void* data, size_t size)
+{
+    const uint64 start_cycles = FPlatformTime::Cycles64();
+    bool success = false;
+
+#if AIRSIM_RECORDING_POSIX_IO
+    int fd = ::open(file_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd >= 0) {
+        success = writeAll(fd, static_cast<const uint8_t*>(data), size);
+        if (options_.sync_policy != SyncPolicy::None)
+            ::fsync(fd);
+        ::close(fd);
+    }
+#else
+    IFileHandle* handle = FPlatformFileManager::Get().GetPlatformFile().OpenWrite(UTF8_TO_TCHAR(file_path.c_str()));
+    if (handle) {
+        success = handle->Write(static_cast<const uint8*>(data), size);
+        if (options_.sync_policy != SyncPolicy::None)
+            handle->Flush(true);
+        delete handle;
+    }
+#endif
+
+    if (success)
+        bytes_written_ += size;
+    addLatencySample(start_cycles);
+    return success;
+}
+
+RecordingWriter::Stats RecordingWriter::getStats() const
+{
+    Stats stats;
+    stats.bytes_written = bytes_written_;
+    stats.flushes = flushes_;
+
+    const uint64 end_cycles = closed_on_cycles_ != 0 ? closed_on_cycles_ : FPlatformTime::Cycles64();
+    if (opened_on_cycles_ != 0)
+        stats.open_seconds = FPlatformTime::ToSeconds64(end_cycles - opened_on_cycles_);
+
+    if (latency_samples_ms_.size() > 0) {
+        std::vector<float> sorted = latency_samples_ms_;
+        std::sort(sorted.begin(), sorted.end());
+        auto percentile = [&sorted](float p) {
+            return sorted[std::min(sorted.size() - 1, static_cast<size_t>(p * sorted.size()))];
+        };
+        stats.p50_ms = percentile(0.50f);
+        stats.p95_ms = percentile(0.95f);
+        stats.p99_ms = percentile(0.99f);
+        stats.max_ms = sorted.back();
+    }
+
+    return stats;
+}
+
+std::string RecordingWriter::getStatsReport() const
+{
+    const Stats stats = getStats();
+    return common_utils::Utils::stringf("%.1f MB at %.1f MB/s, write latency p50 %.2f ms, p95 %.2f ms, p99 %.2f ms, max %.2f ms",
+        stats.bytes_written / (1024.0 * 1024.0), stats.getMegabytesPerSecond(),
+        stats.p50_ms, stats.p95_ms, stats.p99_ms, stats.max_ms);
+}
+
+bool RecordingWriter::openHandle(const std::string& file_path)
+{
+    direct_io_active_ = false;
+
+#if AIRSIM_RECORDING_POSIX_IO
+    int flags = O_WRONLY | O_CREAT | O_TRUNC;
+#if PLATFORM_LINUX
+    if (options_.direct_io)
+        flags |= O_DIRECT;
+#endif
+    fd_ = ::open(file_path.c_str(), flags, 0644);
+#if PLATFORM_LINUX
+    if (fd_ < 0 && options_.direct_io) {
+        //some file systems such as tmpfs reject O_DIRECT
+        fd_ = ::open(file_path.c_str(), flags & ~O_DIRECT, 0644);
+    }
+    else if (fd_ >= 0 && options_.direct_io)
+        direct_io_active_ = true;
+
+    if (fd_ >= 0 && options_.preallocate_bytes > 0) {
+        //reserve blocks without changing the visible file size so readers never see padding
+        ::fallocate(fd_, FALLOC_FL_KEEP_SIZE, 0, static_cast<off_t>(options_.preallocate_bytes));
+    }
+#endif
+    return fd_ >= 0;
+#else
+    file_handle_ = FPlatformFileManager::Get().GetPlatformFile().OpenWrite(UTF8_TO_TCHAR(file_path.c_str()));
+    return file_handle_ != nullptr;
+#endif
+}
+
+void RecordingWriter::closeHandle()
+{
+#if AIRSIM_RECORDING_POSIX_IO
+    if (fd_ >= 0) {
+        ::close(fd_);
+        fd_ = -1;
+    }
+#endif
+    if (file_handle_) {
+        delete file_handle_;
+        file_handle_ = nullptr;
+    }
+    direct_io_active_ = false;
+}
+
+bool RecordingWriter::writeToHandle(const void* data, size_t size)
+{
+#if AIRSIM_RECORDING_POSIX_IO
+    return writeAll(fd_, static_cast<const uint8_t*>(data), size);
+#else
+    return file_handle_->Write(static_cast<const uint8*>(data), size);
+#endif
+}
+
+void RecordingWriter::syncHandle()
+{
+#if AIRSIM_RECORDING_POSIX_IO
+    if (fd_ >= 0)
+        ::fsync(fd_);
+#else
+    if (file_handle_)
+        file_handle_->Flush(true);
+#endif
+}
+
+void RecordingWriter::disableDirectIo()
+{
+#if PLATFORM_LINUX
+    if (direct_io_active_)
+        ::fcntl(fd_, F_SETFL, ::fcntl(fd_, F_GETFL) & ~O_DIRECT);
+#endif
+    direct_io_active_ = false;
+}
+
+void RecordingWriter::addLatencySample(uint64 start_cycles)
+{
+    const float latency_ms = static_cast<float>(FPlatformTime::ToMilliseconds64(FPlatformTime::Cycles64() - start_cycles));
+    if (latency_samples_ms_.size() < kMaxLatencySamples)
+        latency_samples_ms_.push_back(latency_ms);
+    else
+        latency_samples_ms_[next_latency_sample_] = latency_ms;
+    next_latency_sample_ = (next_latency_sample_ + 1) % kMaxLatencySamples;
+}
+
+void RecordingWriter::fail()
+{
+#if AIRSIM_RECORDING_POSIX_IO
+    const std::string reason = std::strerror(errno);
+#else
+    const std::string reason = "";
+#endif
+    UAirBlueprintLib::LogMessageString("Recording write failed, the rest of the recording is dropped: ", reason, LogDebugLevel::Failure);
+
+    failed_ = true;
+    buffer_used_ = 0;
+}
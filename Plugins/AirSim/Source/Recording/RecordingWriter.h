@@ -0,0 +1,103 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HAL/FileManager.h"
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "common/AirSimSettings.hpp"
+
+//Buffered file writer used by the recorder.
+//Data is staged in one large aligned buffer which is handed to the OS only when it
+//fills up or when the flush interval elapses, so the recording thread issues a few
+//large writes instead of one small write per row. Optionally the file is preallocated
+//and synced to disk according to RecordingSetting::sync_policy.
+//On Linux the writer can bypass the page cache with O_DIRECT, other platforms fall back
+//to buffered writes through IFileHandle.
+class RecordingWriter {
+public:
+    typedef msr::airlib::AirSimSettings::RecordingSetting RecordingSetting;
+
+    enum class SyncPolicy {
+        None, OnFlush, OnClose
+    };
+
+    struct Options {
+        size_t buffer_size = 4 * 1024 * 1024;
+        float flush_interval = 1.0f; //seconds, <= 0 flushes only when the buffer is full
+        uint64_t preallocate_bytes = 0;
+        SyncPolicy sync_policy = SyncPolicy::OnClose;
+        bool direct_io = false;
+
+        Options() {}
+        explicit Options(const RecordingSetting& settings);
+    };
+
+    struct Stats {
+        uint64_t bytes_written = 0;
+        uint64_t flushes = 0;
+        double open_seconds = 0;
+        //latency of handing a buffer or an image file to the OS, in milliseconds
+        float p50_ms = 0, p95_ms = 0, p99_ms = 0, max_ms = 0;
+
+        double getMegabytesPerSecond() const
+        {
+            return open_seconds > 0 ? bytes_written / (1024.0 * 1024.0) / open_seconds : 0;
+        }
+    };
+
+public:
+    RecordingWriter();
+    ~RecordingWriter();
+
+    bool open(const std::string& file_path, const Options& options);
+    void close();
+    bool isOpen() const;
+
+    //false once a write to the file failed; the data is dropped and so is everything
+    //written after it, the failure is logged once
+    bool write(const void* data, size_t size);
+    bool flush();
+    bool hasFailed() const;
+    //flushes if the flush interval has elapsed since the last flush
+    void flushIfDue();
+
+    //writes a complete file, such as an image, with a single call and the same sync policy
+    bool writeFile(const std::string& file_path, const void* data, size_t size);
+
+    Stats getStats() const;
+    std::string getStatsReport() const;
+
+private:
+    bool openHandle(const std::string& file_path);
+    void closeHandle();
+    bool writeToHandle(const void* data, size_t size);
+    void syncHandle();
+    void disableDirectIo();
+    void addLatencySample(uint64 start_cycles);
+    void fail();
+
+private:
+    Options options_;
+
+    uint8_t* buffer_ = nullptr;
+    size_t buffer_capacity_ = 0;
+    size_t buffer_used_ = 0;
+
+    //platform file handle, fd_ is used on POSIX platforms and file_handle_ elsewhere
+    int fd_ = -1;
+    bool direct_io_active_ = false;
+    IFileHandle* file_handle_ = nullptr;
+    //a write failed, e.g. on a full disk; the file is not written to anymore
+    bool failed_ = false;
+
+    uint64 opened_on_cycles_ = 0;
+    uint64 closed_on_cycles_ = 0;
+    uint64 last_flush_cycles_ = 0;
+    uint64_t bytes_written_ = 0;
+    uint64_t flushes_ = 0;
+
+    //most recent latencies, oldest samples are overwritten
+    std::vector<float> latency_samples_ms_;
+    size_t next_latency_sample_ = 0;
+};
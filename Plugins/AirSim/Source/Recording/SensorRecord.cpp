@@ -0,0 +1,135 @@
+#include "SensorRecord.h"
+#include "sensors/imu/ImuBase.hpp"
+#include "sensors/barometer/BarometerBase.hpp"
+#include "sensors/magnetometer/MagnetometerBase.hpp"
+#include "sensors/gps/GpsBase.hpp"
+#include "sensors/distance/DistanceBase.hpp"
+#include "sensors/lidar/LidarBase.hpp"
+#include <cstring>
+
+//values written after the time stamp:
+//  Imu          orientation w x y z, angular velocity x y z, linear acceleration x y z
+//  Barometer    altitude, pressure, qnh
+//  Magnetometer magnetic field x y z
+//  Gps          latitude, longitude, altitude, eph, epv, velocity x y z, fix type, utc time, valid
+//  Distance     distance, min distance, max distance
+//  Lidar        pose x y z w x y z, point count, then x y z of every point
+
+namespace {
+    typedef msr::airlib::SensorBase::SensorType SensorType;
+
+    //separate from RecordLineBuffer::threadLocal, which holds the row of the caller
+    RecordLineBuffer& sensorRowBuffer()
+    {
+        thread_local RecordLineBuffer buffer;
+        return buffer;
+    }
+
+    void appendVector(RecordLineBuffer& buffer, const msr::airlib::Vector3r& value)
+    {
+        buffer.appendColumn(value.x());
+        buffer.appendColumn(value.y());
+        buffer.appendColumn(value.z());
+    }
+
+    void appendQuaternion(RecordLineBuffer& buffer, const msr::airlib::Quaternionr& value)
+    {
+        buffer.appendColumn(value.w());
+        buffer.appendColumn(value.x());
+        buffer.appendColumn(value.y());
+        buffer.appendColumn(value.z());
+    }
+
+    void beginRow(RecordLineBuffer& buffer, RecordLineBuffer::Format format, const std::string& vehicle_name,
+        const char* sensor_type, const msr::airlib::SensorBase& sensor, msr::airlib::TTimePoint time_stamp)
+    {
+        buffer.reset(format);
+        buffer.appendColumn(vehicle_name);
+        buffer.appendColumn(sensor_type, std::strlen(sensor_type));
+        buffer.appendColumn(sensor.getName());
+        buffer.appendColumn(static_cast<uint64_t>(time_stamp));
+    }
+
+    void endRow(RecordLineBuffer& buffer, std::string& rows)
+    {
+        buffer.finishRow();
+        rows.append(reinterpret_cast<const char*>(buffer.data()), buffer.size());
+    }
+}
+
+void SensorRecord::appendRows(const msr::airlib::VehicleApiBase& vehicle_api, const std::string& vehicle_name,
+    RecordLineBuffer::Format format, bool include_lidar, std::string& rows)
+{
+    const auto& sensors = vehicle_api.getSensors();
+    RecordLineBuffer& buffer = sensorRowBuffer();
+
+    for (msr::airlib::uint i = 0; i < sensors.size(SensorType::Imu); ++i) {
+        const auto* imu = static_cast<const msr::airlib::ImuBase*>(sensors.getByType(SensorType::Imu, i));
+        const auto& output = imu->getOutput();
+        beginRow(buffer, format, vehicle_name, "Imu", *imu, output.time_stamp);
+        appendQuaternion(buffer, output.orientation);
+        appendVector(buffer, output.angular_velocity);
+        appendVector(buffer, output.linear_acceleration);
+        endRow(buffer, rows);
+    }
+
+    for (msr::airlib::uint i = 0; i < sensors.size(SensorType::Barometer); ++i) {
+        const auto* barometer = static_cast<const msr::airlib::BarometerBase*>(sensors.getByType(SensorType::Barometer, i));
+        const auto& output = barometer->getOutput();
+        beginRow(buffer, format, vehicle_name, "Barometer", *barometer, output.time_stamp);
+        buffer.appendColumn(output.altitude);
+        buffer.appendColumn(output.pressure);
+        buffer.appendColumn(output.qnh);
+        endRow(buffer, rows);
+    }
+
+    for (msr::airlib::uint i = 0; i < sensors.size(SensorType::Magnetometer); ++i) {
+        const auto* magnetometer = static_cast<const msr::airlib::MagnetometerBase*>(sensors.getByType(SensorType::Magnetometer, i));
+        const auto& output = magnetometer->getOutput();
+        beginRow(buffer, format, vehicle_name, "Magnetometer", *magnetometer, output.time_stamp);
+        appendVector(buffer, output.magnetic_field_body);
+        endRow(buffer, rows);
+    }
+
+    for (msr::airlib::uint i = 0; i < sensors.size(SensorType::Gps); ++i) {
+        const auto* gps = static_cast<const msr::airlib::GpsBase*>(sensors.getByType(SensorType::Gps, i));
+        const auto& output = gps->getOutput();
+        beginRow(buffer, format, vehicle_name, "Gps", *gps, output.time_stamp);
+        buffer.appendColumn(output.gnss.geo_point.latitude);
+        buffer.appendColumn(output.gnss.geo_point.longitude);
+        buffer.appendColumn(output.gnss.geo_point.altitude);
+        buffer.appendColumn(output.gnss.eph);
+        buffer.appendColumn(output.gnss.epv);
+        appendVector(buffer, output.gnss.velocity);
+        buffer.appendColumn(static_cast<int32_t>(output.gnss.fix_type));
+        buffer.appendColumn(static_cast<uint64_t>(output.gnss.time_utc));
+        buffer.appendColumn(output.is_valid);
+        endRow(buffer, rows);
+    }
+
+    for (msr::airlib::uint i = 0; i < sensors.size(SensorType::Distance); ++i) {
+        const auto* distance = static_cast<const msr::airlib::DistanceBase*>(sensors.getByType(SensorType::Distance, i));
+        const auto& output = distance->getOutput();
+        beginRow(buffer, format, vehicle_name, "Distance", *distance, output.time_stamp);
+        buffer.appendColumn(output.distance);
+        buffer.appendColumn(output.min_distance);
+        buffer.appendColumn(output.max_distance);
+        endRow(buffer, rows);
+    }
+
+    if (!include_lidar)
+        return;
+
+    for (msr::airlib::uint i = 0; i < sensors.size(SensorType::Lidar); ++i) {
+        const auto* lidar = static_cast<const msr::airlib::LidarBase*>(sensors.getByType(SensorType::Lidar, i));
+        const auto& output = lidar->getOutput();
+        beginRow(buffer, format, vehicle_name, "Lidar", *lidar, output.time_stamp);
+        appendVector(buffer, output.pose.position);
+        appendQuaternion(buffer, output.pose.orientation);
+        const size_t point_count = output.point_cloud.size() / 3;
+        buffer.appendColumn(static_cast<uint64_t>(point_count));
+        for (size_t point = 0; point < point_count * 3; ++point)
+            buffer.appendColumn(output.point_cloud[point]);
+        endRow(buffer, rows);
+    }
+}
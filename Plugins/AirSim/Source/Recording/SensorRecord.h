@@ -0,0 +1,20 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include <string>
+#include "api/VehicleApiBase.hpp"
+#include "Recording/RecordLineBuffer.h"
+
+//Formats the current outputs of the sensors of a vehicle as recording rows, one row per
+//sensor: VehicleName, SensorType, SensorName, the time stamp of the output in nanoseconds
+//and then the values of the output, listed per sensor type in SensorRecord.cpp.
+//Used by the black box so that sensor outputs are kept next to the rows and images.
+class SensorRecord {
+public:
+    static constexpr const char* kHeader = "VehicleName\tSensorType\tSensorName\tTimeStamp\tValues\n";
+
+    //appends the finished rows to rows; lidar point clouds are left out unless include_lidar
+    //is set, the physics thread replaces them while they are read from other threads
+    static void appendRows(const msr::airlib::VehicleApiBase& vehicle_api, const std::string& vehicle_name,
+        RecordLineBuffer::Format format, bool include_lidar, std::string& rows);
+};
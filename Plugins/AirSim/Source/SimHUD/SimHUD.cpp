@@ -138,6 +138,8 @@ void ASimHUD::CreateHUDWidget()
 	InitializeSubWindows();
 
 	HUDWidget->AddToViewport();
+	if (AirSimSettings::singleton().headless)
+		HUDWidget->SetVisibility(ESlateVisibility::Collapsed);
 
 	//synchronize PIP views
 	HUDWidget->initializeForPlay();
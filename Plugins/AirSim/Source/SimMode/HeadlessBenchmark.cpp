@@ -0,0 +1,160 @@
+#include "CoreMinimal.h"
+#include "HAL/IConsoleManager.h"
+#include "HAL/PlatformTime.h"
+#include "Containers/Ticker.h"
+#include "EngineUtils.h"
+#include "Engine/World.h"
+#include "SimMode/SimModeBase.h"
+#include "common/ClockFactory.hpp"
+
+//Console command measuring how much faster the running simulation goes headless. It runs the
+//simulation with rendering for a while, then headless for as long, and logs the simulated
+//seconds per wall second, physics steps and game frames of each. The headless state the
+//simulation had before is restored at the end.
+//  AirSim.Bench.Headless [seconds per mode]
+
+namespace {
+    const float kDefaultSecondsPerMode = 10.0f;
+    //lets the frame rate settle after rendering is switched
+    const double kSettleSeconds = 2.0;
+
+    enum class Phase {
+        SettleRendered,
+        Rendered,
+        SettleHeadless,
+        Headless
+    };
+
+    struct PhaseStart {
+        double wall_seconds = 0;
+        msr::airlib::TTimePoint sim_nanos = 0;
+        uint64 physics_steps = 0;
+        uint64 frames = 0;
+    };
+
+    struct HeadlessRun {
+        TWeakObjectPtr<ASimModeBase> sim_mode;
+        bool was_headless = false;
+        double seconds_per_mode = 0;
+        Phase phase = Phase::SettleRendered;
+        PhaseStart start;
+        double rendered_speed = 0;
+        FDelegateHandle ticker;
+    };
+
+    HeadlessRun run;
+
+    PhaseStart takePhaseStart(const ASimModeBase* sim_mode)
+    {
+        PhaseStart start;
+        start.wall_seconds = FPlatformTime::Seconds();
+        start.sim_nanos = msr::airlib::ClockFactory::get()->nowNanos();
+        start.physics_steps = sim_mode->GetPhysicsLoopStats().steps;
+        start.frames = GFrameCounter;
+        return start;
+    }
+
+    //logs the phase that ends now and returns its simulated seconds per wall second
+    double reportPhase(const TCHAR* name, const ASimModeBase* sim_mode)
+    {
+        const PhaseStart end = takePhaseStart(sim_mode);
+        const double wall_seconds = end.wall_seconds - run.start.wall_seconds;
+        const double sim_seconds = (end.sim_nanos - run.start.sim_nanos) / 1.0E9;
+        const PhysicsLoopMonitor::Stats stats = sim_mode->GetPhysicsLoopStats();
+        const double speed = wall_seconds > 0 ? sim_seconds / wall_seconds : 0.0;
+
+        UE_LOG(LogTemp, Display, TEXT("AirSim.Bench.Headless %s: %.2f sim s per wall s over %.1f s, %.0f physics steps/s, ")
+            TEXT("%.1f frames/s, clock_speed %.2f in the last window"),
+            name, speed, wall_seconds, wall_seconds > 0 ? (end.physics_steps - run.start.physics_steps) / wall_seconds : 0.0,
+            wall_seconds > 0 ? (end.frames - run.start.frames) / wall_seconds : 0.0, stats.clock_speed);
+        return speed;
+    }
+
+    bool finish()
+    {
+        if (run.sim_mode.IsValid())
+            run.sim_mode->SetHeadless(run.was_headless);
+        run.ticker.Reset();
+        return false;
+    }
+
+    bool tickHeadlessRun(float)
+    {
+        ASimModeBase* sim_mode = run.sim_mode.Get();
+        if (sim_mode == nullptr || !sim_mode->HasActorBegunPlay()) {
+            UE_LOG(LogTemp, Warning, TEXT("AirSim.Bench.Headless: the simulation stopped, no result"));
+            return finish();
+        }
+
+        const double elapsed = FPlatformTime::Seconds() - run.start.wall_seconds;
+        switch (run.phase) {
+        case Phase::SettleRendered:
+            if (elapsed >= kSettleSeconds) {
+                run.phase = Phase::Rendered;
+                run.start = takePhaseStart(sim_mode);
+            }
+            break;
+        case Phase::Rendered:
+            if (elapsed >= run.seconds_per_mode) {
+                run.rendered_speed = reportPhase(TEXT("rendered"), sim_mode);
+                sim_mode->SetHeadless(true);
+                run.phase = Phase::SettleHeadless;
+                run.start = takePhaseStart(sim_mode);
+            }
+            break;
+        case Phase::SettleHeadless:
+            if (elapsed >= kSettleSeconds) {
+                run.phase = Phase::Headless;
+                run.start = takePhaseStart(sim_mode);
+            }
+            break;
+        case Phase::Headless:
+            if (elapsed >= run.seconds_per_mode) {
+                const double headless_speed = reportPhase(TEXT("headless"), sim_mode);
+                UE_LOG(LogTemp, Display, TEXT("AirSim.Bench.Headless: headless runs %.2fx the simulated time of rendered"),
+                    run.rendered_speed > 0 ? headless_speed / run.rendered_speed : 0.0);
+                return finish();
+            }
+            break;
+        }
+        return true;
+    }
+
+    void benchHeadless(const TArray<FString>& args, UWorld* world)
+    {
+        if (run.ticker.IsValid()) {
+            UE_LOG(LogTemp, Warning, TEXT("AirSim.Bench.Headless is already running"));
+            return;
+        }
+
+        ASimModeBase* sim_mode = nullptr;
+        if (world != nullptr) {
+            for (TActorIterator<ASimModeBase> it(world); it; ++it) {
+                if (it->HasActorBegunPlay()) {
+                    sim_mode = *it;
+                    break;
+                }
+            }
+        }
+        if (sim_mode == nullptr) {
+            UE_LOG(LogTemp, Warning, TEXT("AirSim.Bench.Headless needs a running simulation"));
+            return;
+        }
+
+        run = HeadlessRun();
+        run.sim_mode = sim_mode;
+        run.was_headless = sim_mode->IsHeadless();
+        run.seconds_per_mode = args.Num() > 0 ? FMath::Max(1.0f, FCString::Atof(*args[0])) : kDefaultSecondsPerMode;
+        run.start = takePhaseStart(sim_mode);
+        sim_mode->SetHeadless(false);
+
+        //phases advance once per frame from the core ticker, which keeps ticking headless
+        run.ticker = FTicker::GetCoreTicker().AddTicker(FTickerDelegate::CreateStatic(&tickHeadlessRun));
+    }
+
+    FAutoConsoleCommand bench_headless_command(
+        TEXT("AirSim.Bench.Headless"),
+        TEXT("Runs the simulation with rendering, then headless, and logs the simulated seconds per wall second of each. ")
+        TEXT("Args: [seconds per mode]"),
+        FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&benchHeadless));
+}
@@ -0,0 +1,38 @@
+#include "PacedClock.h"
+#include "common/common_utils/Utils.hpp"
+
+PacedClock::PacedClock(double speed, msr::airlib::TTimePoint start, msr::airlib::TTimePoint now)
+    : start_(start), base_time_(now), base_wall_time_(common_utils::Utils::getTimeSinceEpochNanos()), speed_(speed)
+{
+}
+
+void PacedClock::setSpeed(double speed)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    const msr::airlib::TTimePoint wall_now = common_utils::Utils::getTimeSinceEpochNanos();
+    base_time_ = nowNanos(wall_now);
+    base_wall_time_ = wall_now;
+    speed_ = speed;
+}
+
+double PacedClock::getSpeed() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return speed_;
+}
+
+msr::airlib::TTimePoint PacedClock::nowNanos() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return nowNanos(common_utils::Utils::getTimeSinceEpochNanos());
+}
+
+msr::airlib::TTimePoint PacedClock::getStart() const
+{
+    return start_;
+}
+
+msr::airlib::TTimePoint PacedClock::nowNanos(msr::airlib::TTimePoint wall_now) const
+{
+    return base_time_ + static_cast<msr::airlib::TTimePoint>((wall_now - base_wall_time_) * speed_);
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "common/ClockBase.hpp"
+#include <mutex>
+
+//Clock running at a speed relative to the wall clock like ScalableClock, whose
+//speed can be changed while it runs without a jump in simulated time.
+//With AdaptiveClockSpeed the physics loop monitor lowers it while the loop cannot
+//keep its period, so every step still advances the simulation by about one period
+//instead of by the longer wall time the step took.
+class PacedClock : public msr::airlib::ClockBase {
+public:
+    //continues from the current time of the clock it replaces
+    PacedClock(double speed, msr::airlib::TTimePoint start, msr::airlib::TTimePoint now);
+
+    //simulated seconds per wall second from now on
+    void setSpeed(double speed);
+    double getSpeed() const;
+
+    virtual msr::airlib::TTimePoint nowNanos() const override;
+    virtual msr::airlib::TTimePoint getStart() const override;
+
+private:
+    msr::airlib::TTimePoint nowNanos(msr::airlib::TTimePoint wall_now) const;
+
+private:
+    mutable std::mutex mutex_;
+    msr::airlib::TTimePoint start_;
+    msr::airlib::TTimePoint base_time_;     //simulated time when the speed last changed
+    msr::airlib::TTimePoint base_wall_time_;
+    double speed_;
+};
@@ -0,0 +1,74 @@
+#include "ParallelPhysicsEngine.h"
+#include "Async/ParallelFor.h"
+#include "HAL/PlatformTime.h"
+#include <algorithm>
+
+ParallelPhysicsEngine::ParallelPhysicsEngine(bool enable_ground_lock, const Vector3r& wind)
+    : enable_ground_lock_(enable_ground_lock), wind_(wind)
+{
+}
+
+void ParallelPhysicsEngine::insert(PhysicsBody* body_ptr)
+{
+    PhysicsEngineBase::insert(body_ptr);
+
+    Shard shard;
+    shard.body = body_ptr;
+    shard.engine.reset(new msr::airlib::FastPhysicsEngine(enable_ground_lock_, wind_));
+    shard.engine->insert(body_ptr);
+    shards_.push_back(std::move(shard));
+}
+
+void ParallelPhysicsEngine::erase_remove(PhysicsBody* body_ptr)
+{
+    PhysicsEngineBase::erase_remove(body_ptr);
+
+    shards_.erase(std::remove_if(shards_.begin(), shards_.end(),
+        [body_ptr](const Shard& shard) { return shard.body == body_ptr; }), shards_.end());
+}
+
+void ParallelPhysicsEngine::clear()
+{
+    PhysicsEngineBase::clear();
+    shards_.clear();
+}
+
+void ParallelPhysicsEngine::resetImplementation()
+{
+    for (Shard& shard : shards_)
+        shard.engine->reset();
+}
+
+void ParallelPhysicsEngine::update()
+{
+    PhysicsEngineBase::update();
+
+    const uint64 start_cycles = FPlatformTime::Cycles64();
+
+    //every task writes only the kinematics of its own body
+    const int32 shard_count = static_cast<int32>(shards_.size());
+    ParallelFor(shard_count, [this](int32 index) {
+        shards_[index].engine->update();
+    }, shard_count < MinParallelBodies);
+
+    ++update_count_;
+    update_cycles_ += FPlatformTime::Cycles64() - start_cycles;
+}
+
+void ParallelPhysicsEngine::reportState(msr::airlib::StateReporter& reporter)
+{
+    for (Shard& shard : shards_)
+        shard.engine->reportState(reporter);
+
+    const double update_us = update_count_ == 0 ? 0
+        : FPlatformTime::ToMilliseconds64(update_cycles_) * 1000.0 / update_count_;
+    reporter.writeValue("Parallel bodies", static_cast<int>(shards_.size()));
+    reporter.writeValue("Physics update (us)", update_us);
+}
+
+void ParallelPhysicsEngine::setWind(const Vector3r& wind)
+{
+    wind_ = wind;
+    for (Shard& shard : shards_)
+        shard.engine->setWind(wind);
+}
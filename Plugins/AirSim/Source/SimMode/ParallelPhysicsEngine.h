@@ -0,0 +1,52 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "physics/PhysicsEngineBase.hpp"
+#include "physics/FastPhysicsEngine.hpp"
+#include <memory>
+#include <vector>
+
+//FastPhysicsEngine integrating every body on its own task of the task graph.
+//FastPhysicsEngine bodies never touch each other, every one is integrated from
+//its own state, its collision info and the wind only. So each body gets an
+//engine of its own and the engines are updated concurrently, which gives the
+//same results as one engine updating the bodies in turn.
+//Enabled with "ParallelBodyUpdate" under "FastPhysicsEngine" in settings.
+class ParallelPhysicsEngine : public msr::airlib::PhysicsEngineBase {
+public:
+    typedef msr::airlib::PhysicsBody PhysicsBody;
+    typedef msr::airlib::Vector3r Vector3r;
+
+public:
+    ParallelPhysicsEngine(bool enable_ground_lock, const Vector3r& wind);
+
+    virtual void insert(PhysicsBody* body_ptr) override;
+    virtual void erase_remove(PhysicsBody* body_ptr) override;
+    virtual void clear() override;
+
+    virtual void update() override;
+    virtual void reportState(msr::airlib::StateReporter& reporter) override;
+    virtual void setWind(const Vector3r& wind) override;
+
+protected:
+    virtual void resetImplementation() override;
+
+private:
+    struct Shard {
+        PhysicsBody* body;
+        std::unique_ptr<msr::airlib::FastPhysicsEngine> engine;
+    };
+
+    //fewer bodies are updated on the calling thread, not worth a task each
+    static constexpr int32 MinParallelBodies = 2;
+
+    bool enable_ground_lock_;
+    Vector3r wind_;
+
+    //in insertion order, which is also the order of the state report
+    std::vector<Shard> shards_;
+
+    //engine update time for the debug report
+    uint64 update_count_ = 0;
+    uint64 update_cycles_ = 0;
+};
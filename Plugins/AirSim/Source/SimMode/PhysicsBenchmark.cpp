@@ -0,0 +1,230 @@
+#include "CoreMinimal.h"
+#include "HAL/IConsoleManager.h"
+#include "HAL/PlatformTime.h"
+#include "EngineUtils.h"
+#include "Engine/World.h"
+#include "SimMode/SimModeBase.h"
+#include "SimMode/ParallelPhysicsEngine.h"
+#include "common/ClockFactory.hpp"
+#include "common/SteppableClock.hpp"
+#include "physics/World.hpp"
+#include "physics/FastPhysicsEngine.hpp"
+#include "sensors/SensorFactory.hpp"
+#include "vehicles/multirotor/MultiRotorParamsFactory.hpp"
+#include "vehicles/multirotor/MultiRotorPhysicsBody.hpp"
+#include <cstring>
+#include <memory>
+#include <vector>
+
+//Console commands measuring the physics engines with multirotors that exist only in physics,
+//without pawns, rendering or the physics thread. They replace the global clock while they
+//run, so they refuse to run while a simulation is playing. Results go to the log.
+//  AirSim.Bench.PhysicsScaling [max bodies] [steps]
+//  AirSim.Bench.PhysicsEquivalence [bodies] [steps]
+
+namespace {
+    using namespace msr::airlib;
+
+    const int32 kDefaultMaxBodies = 64;
+    const int32 kDefaultScalingSteps = 3000;
+    const int32 kDefaultEquivalenceBodies = 16;
+    const int32 kDefaultEquivalenceSteps = 10000;
+    //default physics loop period
+    const TTimeDelta kStepSeconds = 3.0E-3;
+
+    //a disarmed SimpleFlight multirotor falling and tumbling from its own start state;
+    //the vehicle setting must outlive the api, which keeps a pointer to it
+    struct BenchVehicle {
+        std::unique_ptr<AirSimSettings::VehicleSetting> setting;
+        std::unique_ptr<MultiRotorParams> params;
+        std::unique_ptr<MultirotorApiBase> api;
+        std::unique_ptr<Kinematics> kinematics;
+        std::unique_ptr<Environment> environment;
+        std::unique_ptr<MultiRotorPhysicsBody> body;
+    };
+
+    //a set of bodies stepped by one engine
+    struct BenchWorld {
+        std::vector<std::unique_ptr<BenchVehicle>> vehicles;
+        std::unique_ptr<msr::airlib::World> world;
+    };
+
+    //every body starts from a different state, the same one for the same index
+    Kinematics::State makeStartState(int32 index)
+    {
+        Kinematics::State state = Kinematics::State::zero();
+        state.pose.position = Vector3r(5.0f * index, -3.0f * (index % 7), -50.0f - index);
+        state.twist.linear = Vector3r(1.0f + 0.1f * index, -0.5f, 0.25f * (index % 3));
+        state.twist.angular = Vector3r(0.3f, -0.2f * (index % 5), 0.05f * index);
+        return state;
+    }
+
+    void createWorld(BenchWorld& bench_world, int32 body_count, bool parallel)
+    {
+        std::unique_ptr<PhysicsEngineBase> engine;
+        if (parallel)
+            engine.reset(new ParallelPhysicsEngine(false, Vector3r::Zero()));
+        else
+            engine.reset(new FastPhysicsEngine(false, Vector3r::Zero()));
+        bench_world.world.reset(new msr::airlib::World(std::move(engine)));
+
+        const std::shared_ptr<const SensorFactory> sensor_factory = std::make_shared<SensorFactory>();
+        const GeoPoint home(47.641468, -122.140165, 122);
+
+        for (int32 i = 0; i < body_count; ++i) {
+            std::unique_ptr<BenchVehicle> vehicle(new BenchVehicle());
+            vehicle->setting.reset(new AirSimSettings::VehicleSetting());
+            vehicle->setting->vehicle_name = "Bench" + std::to_string(i);
+            vehicle->setting->vehicle_type = AirSimSettings::kVehicleTypeSimpleFlight;
+            vehicle->params = MultiRotorParamsFactory::createConfig(vehicle->setting.get(), sensor_factory);
+            vehicle->api = vehicle->params->createMultirotorApi();
+
+            const Kinematics::State start_state = makeStartState(i);
+            vehicle->kinematics.reset(new Kinematics(start_state));
+            vehicle->environment.reset(new Environment(Environment::State(start_state.pose.position, home)));
+            vehicle->body.reset(new MultiRotorPhysicsBody(vehicle->params.get(), vehicle->api.get(),
+                vehicle->kinematics.get(), vehicle->environment.get()));
+            vehicle->api->setSimulatedGroundTruth(&vehicle->kinematics->getState(), vehicle->environment.get());
+
+            bench_world.world->insert(vehicle->body.get());
+            bench_world.vehicles.push_back(std::move(vehicle));
+        }
+
+        bench_world.world->reset();
+    }
+
+    //false while a simulation runs on the global clock these commands replace
+    bool canReplaceClock(UWorld* world)
+    {
+        if (world != nullptr) {
+            for (TActorIterator<ASimModeBase> it(world); it; ++it) {
+                if (it->HasActorBegunPlay()) {
+                    UE_LOG(LogTemp, Warning, TEXT("AirSim physics benchmarks replace the clock, stop the simulation first"));
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    //steps with a fixed period whatever the wall time, so runs are repeatable
+    class ScopedSteppableClock {
+    public:
+        ScopedSteppableClock()
+            : previous_(ClockFactory::get()), clock_(std::make_shared<SteppableClock>(kStepSeconds))
+        {
+            ClockFactory::get(clock_);
+        }
+        ~ScopedSteppableClock()
+        {
+            ClockFactory::get(previous_);
+        }
+        void step()
+        {
+            clock_->step();
+        }
+
+    private:
+        std::shared_ptr<ClockBase> previous_;
+        std::shared_ptr<SteppableClock> clock_;
+    };
+
+    double timeSteps(BenchWorld& bench_world, ScopedSteppableClock& clock, int32 steps)
+    {
+        const uint64 start = FPlatformTime::Cycles64();
+        for (int32 step = 0; step < steps; ++step) {
+            clock.step();
+            bench_world.world->update();
+        }
+        return FPlatformTime::ToMilliseconds64(FPlatformTime::Cycles64() - start) * 1000.0 / steps;
+    }
+
+    void benchPhysicsScaling(const TArray<FString>& args, UWorld* world)
+    {
+        if (!canReplaceClock(world))
+            return;
+
+        const int32 max_bodies = args.Num() > 0 ? FMath::Clamp(FCString::Atoi(*args[0]), 1, 1024) : kDefaultMaxBodies;
+        const int32 steps = args.Num() > 1 ? FMath::Max(1, FCString::Atoi(*args[1])) : kDefaultScalingSteps;
+
+        ScopedSteppableClock clock;
+        for (int32 body_count = 1; body_count <= max_bodies; body_count *= 2) {
+            //each world is created right before it is stepped, so its first step is a regular one
+            double fast_us, parallel_us;
+            {
+                BenchWorld fast;
+                createWorld(fast, body_count, false);
+                fast_us = timeSteps(fast, clock, steps);
+            }
+            {
+                BenchWorld parallel;
+                createWorld(parallel, body_count, true);
+                parallel_us = timeSteps(parallel, clock, steps);
+            }
+            UE_LOG(LogTemp, Display, TEXT("AirSim.Bench.PhysicsScaling %d bodies: FastPhysicsEngine %.1f us/step, ParallelPhysicsEngine %.1f us/step, ")
+                TEXT("%.2fx, step period %.0f us"),
+                body_count, fast_us, parallel_us, parallel_us > 0 ? fast_us / parallel_us : 0.0, kStepSeconds * 1.0E6);
+        }
+    }
+
+    //bitwise, a claim of identical results has no tolerance
+    bool isSameState(const Kinematics::State& a, const Kinematics::State& b, float& max_position_difference)
+    {
+        max_position_difference = FMath::Max(max_position_difference, (a.pose.position - b.pose.position).norm());
+        const auto same = [](const void* x, const void* y, size_t size) { return std::memcmp(x, y, size) == 0; };
+        return same(a.pose.position.data(), b.pose.position.data(), 3 * sizeof(real_T))
+            && same(a.pose.orientation.coeffs().data(), b.pose.orientation.coeffs().data(), 4 * sizeof(real_T))
+            && same(a.twist.linear.data(), b.twist.linear.data(), 3 * sizeof(real_T))
+            && same(a.twist.angular.data(), b.twist.angular.data(), 3 * sizeof(real_T))
+            && same(a.accelerations.linear.data(), b.accelerations.linear.data(), 3 * sizeof(real_T))
+            && same(a.accelerations.angular.data(), b.accelerations.angular.data(), 3 * sizeof(real_T));
+    }
+
+    void benchPhysicsEquivalence(const TArray<FString>& args, UWorld* world)
+    {
+        if (!canReplaceClock(world))
+            return;
+
+        const int32 body_count = args.Num() > 0 ? FMath::Clamp(FCString::Atoi(*args[0]), 1, 1024) : kDefaultEquivalenceBodies;
+        const int32 steps = args.Num() > 1 ? FMath::Max(1, FCString::Atoi(*args[1])) : kDefaultEquivalenceSteps;
+
+        ScopedSteppableClock clock;
+        BenchWorld fast, parallel;
+        createWorld(fast, body_count, false);
+        createWorld(parallel, body_count, true);
+
+        //both worlds see the same clock at every step
+        int32 first_different_step = -1;
+        for (int32 step = 0; step < steps && first_different_step < 0; ++step) {
+            clock.step();
+            fast.world->update();
+            parallel.world->update();
+
+            float max_position_difference = 0;
+            for (int32 i = 0; i < body_count; ++i) {
+                if (!isSameState(fast.vehicles[i]->kinematics->getState(), parallel.vehicles[i]->kinematics->getState(), max_position_difference)) {
+                    first_different_step = step;
+                    UE_LOG(LogTemp, Warning, TEXT("AirSim.Bench.PhysicsEquivalence: body %d differs after step %d, position by %g m"),
+                        i, step + 1, max_position_difference);
+                    break;
+                }
+            }
+        }
+
+        if (first_different_step < 0)
+            UE_LOG(LogTemp, Display, TEXT("AirSim.Bench.PhysicsEquivalence: %d bodies identical bit for bit after %d steps"),
+                body_count, steps);
+    }
+
+    FAutoConsoleCommand bench_physics_scaling_command(
+        TEXT("AirSim.Bench.PhysicsScaling"),
+        TEXT("Steps 1, 2, 4, ... multirotors with FastPhysicsEngine and ParallelPhysicsEngine and logs the time per step. ")
+        TEXT("Args: [max bodies] [steps]"),
+        FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&benchPhysicsScaling));
+
+    FAutoConsoleCommand bench_physics_equivalence_command(
+        TEXT("AirSim.Bench.PhysicsEquivalence"),
+        TEXT("Steps the same multirotors with FastPhysicsEngine and ParallelPhysicsEngine and checks their kinematics are identical. ")
+        TEXT("Args: [bodies] [steps]"),
+        FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&benchPhysicsEquivalence));
+}
@@ -0,0 +1,88 @@
+#include "PhysicsLoopMonitor.h"
+#include "HAL/PlatformTime.h"
+#include "common/ClockFactory.hpp"
+#include <algorithm>
+
+PhysicsLoopMonitor::PhysicsLoopMonitor(double target_period, PacedClock* paced_clock)
+    : step_begin_(this, true), step_end_(this, false), target_period_(target_period), paced_clock_(paced_clock)
+{
+    stats_.target_period = target_period;
+    if (paced_clock_ != nullptr)
+        base_clock_speed_ = paced_clock_->getSpeed();
+}
+
+PhysicsLoopMonitor::Stats PhysicsLoopMonitor::getStats() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+void PhysicsLoopMonitor::beginStep()
+{
+    const double now = FPlatformTime::Seconds();
+
+    if (last_begin_ == 0)
+        startWindow(now);
+    else {
+        const double interval = now - last_begin_;
+        const double pause_gap = PauseGapSeconds;
+        if (interval > std::max(pause_gap, 10 * target_period_))
+            startWindow(now);
+        else if (interval > 2 * target_period_) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            ++stats_.missed_deadlines;
+        }
+    }
+
+    last_begin_ = now;
+}
+
+void PhysicsLoopMonitor::endStep()
+{
+    const double now = FPlatformTime::Seconds();
+    const double duration = now - last_begin_;
+
+    ++window_steps_;
+    window_duration_ += duration;
+    window_max_duration_ = std::max(window_max_duration_, duration);
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ++stats_.steps;
+        if (duration > target_period_)
+            ++stats_.overruns;
+    }
+
+    const double window_seconds = now - window_start_;
+    if (window_seconds < WindowSeconds)
+        return;
+
+    const double average_duration = window_duration_ / window_steps_;
+    if (paced_clock_ != nullptr) {
+        //steps then advance the simulation by about one period however long they take;
+        //sleeping instead would stretch the time every step covers
+        const double sustained_period = average_duration * AdaptiveHeadroom;
+        paced_period_ = sustained_period > target_period_ ? sustained_period : 0;
+        paced_clock_->setSpeed(paced_period_ > 0 ? base_clock_speed_ * target_period_ / paced_period_ : base_clock_speed_);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stats_.actual_rate = window_steps_ / window_seconds;
+        stats_.update_duration = average_duration;
+        stats_.max_update_duration = window_max_duration_;
+        stats_.clock_speed = msr::airlib::ClockFactory::get()->elapsedSince(window_sim_start_) / window_seconds;
+        stats_.paced_period = paced_period_;
+    }
+
+    startWindow(now);
+}
+
+void PhysicsLoopMonitor::startWindow(double now)
+{
+    window_start_ = now;
+    window_sim_start_ = msr::airlib::ClockFactory::get()->nowNanos();
+    window_steps_ = 0;
+    window_duration_ = 0;
+    window_max_duration_ = 0;
+}
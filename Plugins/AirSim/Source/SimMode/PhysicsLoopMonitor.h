@@ -0,0 +1,141 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "common/UpdatableObject.hpp"
+#include "SimMode/PacedClock.h"
+#include <mutex>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+//Timing of the physics thread. A marker updated before the vehicles starts every
+//step and the physics engine, which the world updates after all of its members,
+//ends it once it has integrated the bodies (see MonitoredPhysicsEngine), so every
+//step is timed in wall time from the start of the vehicle updates to the end of
+//the integration, and the starts of consecutive steps give the rate the loop
+//actually runs at. Without an engine a second marker after the vehicles ends it.
+//With AdaptiveClockSpeed in settings, a loop that cannot keep the period slows
+//the PacedClock down to the period it sustains, so each step still advances the
+//simulation by about one period instead of the longer time the step took.
+class PhysicsLoopMonitor {
+public:
+    struct Stats {
+        double target_period = 0;           //seconds between steps that were asked for
+        double actual_rate = 0;             //steps per wall second in the last window
+        double update_duration = 0;         //average seconds of the vehicle updates in the last window
+        double max_update_duration = 0;     //longest vehicle update in the last window
+        double clock_speed = 0;             //simulated seconds per wall second in the last window
+        double paced_period = 0;            //period the adaptive mode slowed the clock down to, 0 if not slowed
+        uint64_t steps = 0;
+        uint64_t overruns = 0;              //steps whose update took longer than the period
+        uint64_t missed_deadlines = 0;      //steps that started a whole period late
+    };
+
+public:
+    //paced_clock is slowed down when the loop falls behind, null to only measure
+    PhysicsLoopMonitor(double target_period, PacedClock* paced_clock);
+
+    msr::airlib::UpdatableObject* getStepBegin()
+    {
+        return &step_begin_;
+    }
+    //world member for a world without a physics engine
+    msr::airlib::UpdatableObject* getStepEnd()
+    {
+        return &step_end_;
+    }
+
+    //physics thread: ends the step, called once the engine has integrated the bodies
+    void endStep();
+
+    //as of the end of the last window
+    Stats getStats() const;
+
+private:
+    class Marker : public msr::airlib::UpdatableObject {
+    public:
+        Marker(PhysicsLoopMonitor* monitor, bool is_begin)
+            : monitor_(monitor), is_begin_(is_begin)
+        {
+        }
+        virtual void update() override
+        {
+            UpdatableObject::update();
+            if (is_begin_)
+                monitor_->beginStep();
+            else
+                monitor_->endStep();
+        }
+
+    protected:
+        virtual void resetImplementation() override
+        {
+        }
+
+    private:
+        PhysicsLoopMonitor* monitor_;
+        bool is_begin_;
+    };
+
+    void beginStep();
+    void startWindow(double now);
+
+private:
+    //stats are taken over windows this long
+    static constexpr double WindowSeconds = 1.0;
+    //a gap this long between steps is a pause, not a missed deadline
+    static constexpr double PauseGapSeconds = 0.1;
+    //adaptive period over the average update duration
+    static constexpr double AdaptiveHeadroom = 1.2;
+
+    Marker step_begin_;
+    Marker step_end_;
+    double target_period_;
+    PacedClock* paced_clock_;
+    double base_clock_speed_ = 1;
+
+    //physics thread only
+    double last_begin_ = 0;
+    double window_start_ = 0;
+    msr::airlib::TTimePoint window_sim_start_ = 0;
+    uint64_t window_steps_ = 0;
+    double window_duration_ = 0;
+    double window_max_duration_ = 0;
+    double paced_period_ = 0;
+
+    mutable std::mutex mutex_;
+    Stats stats_;
+};
+
+//Physics engine that ends the step of the monitor after it has integrated the bodies.
+//The objects after_step are updated in between, in order, so they see the state the
+//step ends with, and reset with the engine.
+template <class Engine>
+class MonitoredPhysicsEngine : public Engine {
+public:
+    template <typename... Args>
+    MonitoredPhysicsEngine(PhysicsLoopMonitor* monitor, const std::vector<msr::airlib::UpdatableObject*>& after_step, Args&&... args)
+        : Engine(std::forward<Args>(args)...), monitor_(monitor), after_step_(after_step)
+    {
+    }
+
+    virtual void update() override
+    {
+        Engine::update();
+        for (msr::airlib::UpdatableObject* object : after_step_)
+            object->update();
+        monitor_->endStep();
+    }
+
+protected:
+    virtual void resetImplementation() override
+    {
+        Engine::resetImplementation();
+        for (msr::airlib::UpdatableObject* object : after_step_)
+            object->reset();
+    }
+
+private:
+    PhysicsLoopMonitor* monitor_;
+    std::vector<msr::airlib::UpdatableObject*> after_step_;
+};
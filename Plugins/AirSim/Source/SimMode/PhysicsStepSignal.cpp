@@ -0,0 +1,95 @@
+#include "PhysicsStepSignal.h"
+#include "HAL/PlatformTime.h"
+#include "common/ClockFactory.hpp"
+
+PhysicsStepSignal::PhysicsStepSignal(PauseFunction pause)
+    : pause_(std::move(pause))
+{
+}
+
+std::shared_future<PhysicsStepSignal::Result> PhysicsStepSignal::continueForTime(double seconds)
+{
+    return startRequest(Until::Time, seconds, 0);
+}
+
+std::shared_future<PhysicsStepSignal::Result> PhysicsStepSignal::continueForFrames(uint32_t frames)
+{
+    return startRequest(Until::Frames, 0, frames);
+}
+
+std::shared_future<PhysicsStepSignal::Result> PhysicsStepSignal::continueForSteps(uint32_t steps)
+{
+    return startRequest(Until::Steps, 0, steps);
+}
+
+void PhysicsStepSignal::setFrameNumber(uint32_t frame_number)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    frame_number_ = frame_number;
+}
+
+PhysicsStepSignal::Result PhysicsStepSignal::getLastResult() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return last_result_;
+}
+
+void PhysicsStepSignal::update()
+{
+    UpdatableObject::update();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!has_request_)
+        return;
+
+    ++request_.steps;
+    bool is_done = false;
+    switch (request_.until) {
+    case Until::Time:
+        is_done = msr::airlib::ClockFactory::get()->elapsedSince(request_.start_time) >= request_.seconds;
+        break;
+    case Until::Frames:
+        is_done = frame_number_ - request_.start_frame >= request_.count;
+        break;
+    case Until::Steps:
+        is_done = request_.steps >= request_.count;
+        break;
+    }
+
+    if (is_done) {
+        pause_();
+        finishRequest(true);
+    }
+}
+
+std::shared_future<PhysicsStepSignal::Result> PhysicsStepSignal::startRequest(Until until, double seconds, uint32_t count)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (has_request_)
+        finishRequest(false);
+
+    request_ = Request();
+    request_.until = until;
+    request_.seconds = seconds;
+    request_.count = count;
+    request_.start_time = msr::airlib::ClockFactory::get()->nowNanos();
+    request_.start_frame = frame_number_;
+    request_.start_wall_seconds = FPlatformTime::Seconds();
+    has_request_ = true;
+
+    return request_.promise.get_future().share();
+}
+
+//called with mutex_ held
+void PhysicsStepSignal::finishRequest(bool completed)
+{
+    Result result;
+    result.steps = request_.steps;
+    result.sim_seconds = msr::airlib::ClockFactory::get()->elapsedSince(request_.start_time);
+    result.wall_seconds = FPlatformTime::Seconds() - request_.start_wall_seconds;
+    result.completed = completed;
+
+    last_result_ = result;
+    has_request_ = false;
+    request_.promise.set_value(result);
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "common/UpdatableObject.hpp"
+#include <future>
+#include <mutex>
+#include <functional>
+#include <cstdint>
+
+//Ends ContinueForTime, ContinueForFrames and lockstep steps. It is updated at the
+//end of every physics step, once the engine has integrated it (see
+//MonitoredPhysicsEngine), checks whether the requested simulated time, number of
+//rendered frames or number of physics steps has passed and, once it has, pauses
+//the simulation and completes the future handed out for the request.
+//Callers wait on that future instead of spinning on PhysicsWorld::isPaused().
+class PhysicsStepSignal : public msr::airlib::UpdatableObject {
+public:
+    struct Result {
+        uint64_t steps = 0;             //physics steps taken
+        double sim_seconds = 0;         //simulated time that passed
+        double wall_seconds = 0;        //from the request until the simulation was paused
+        bool completed = false;         //false if a newer request replaced this one
+    };
+
+    //pauses the simulation, called on the physics thread when a request is done
+    typedef std::function<void()> PauseFunction;
+
+public:
+    explicit PhysicsStepSignal(PauseFunction pause);
+
+    //a new request replaces the one in progress, which completes right away
+    std::shared_future<Result> continueForTime(double seconds);
+    std::shared_future<Result> continueForFrames(uint32_t frames);
+    //pauses in the update of the last step, so exactly this many steps are taken
+    std::shared_future<Result> continueForSteps(uint32_t steps);
+
+    //frame counter continueForFrames counts, set by the game thread every tick
+    void setFrameNumber(uint32_t frame_number);
+
+    Result getLastResult() const;
+
+    virtual void update() override;
+
+protected:
+    virtual void resetImplementation() override
+    {
+    }
+
+private:
+    enum class Until {
+        Time, Frames, Steps
+    };
+
+    struct Request {
+        Until until = Until::Time;
+        double seconds = 0;
+        uint32_t count = 0;
+        msr::airlib::TTimePoint start_time = 0;
+        uint32_t start_frame = 0;
+        double start_wall_seconds = 0;
+        uint64_t steps = 0;
+        std::promise<Result> promise;
+    };
+
+    std::shared_future<Result> startRequest(Until until, double seconds, uint32_t count);
+    void finishRequest(bool completed);
+
+private:
+    PauseFunction pause_;
+
+    mutable std::mutex mutex_;
+    bool has_request_ = false;
+    Request request_;
+    uint32_t frame_number_ = 0;
+    Result last_result_;
+};
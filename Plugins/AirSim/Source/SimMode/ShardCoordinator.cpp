@@ -0,0 +1,342 @@
+#include "ShardCoordinator.h"
+#include "AirBlueprintLib.h"
+#include "HAL/PlatformProcess.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+
+#if PLATFORM_LINUX
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+namespace {
+    //vehicle names may hold spaces, they are sent as one word with %XX escapes
+    std::string encodeWord(const std::string& text)
+    {
+        std::string word;
+        for (const char c : text) {
+            const unsigned char byte = static_cast<unsigned char>(c);
+            if (byte <= ' ' || byte == '%' || byte == 0x7F) {
+                char escape[4];
+                std::snprintf(escape, sizeof(escape), "%%%02X", byte);
+                word += escape;
+            }
+            else
+                word += c;
+        }
+        return word;
+    }
+
+    std::string decodeWord(const std::string& word)
+    {
+        std::string text;
+        for (size_t i = 0; i < word.size(); ++i) {
+            if (word[i] == '%' && i + 2 < word.size()) {
+                text += static_cast<char>(std::strtol(word.substr(i + 1, 2).c_str(), nullptr, 16));
+                i += 2;
+            }
+            else
+                text += word[i];
+        }
+        return text;
+    }
+}
+
+ShardCoordinator::ShardCoordinator(const ShardingSetting& setting, int api_port, const std::vector<std::string>& vehicle_names, StepFunction step)
+    : setting_(setting), step_(std::move(step))
+{
+    self_.shard_index = setting.shard_index;
+    self_.api_port = api_port;
+    self_.vehicle_names = vehicle_names;
+}
+
+ShardCoordinator::~ShardCoordinator()
+{
+    stop();
+}
+
+bool ShardCoordinator::start()
+{
+#if PLATFORM_LINUX
+    if (isCoordinator()) {
+        sockaddr_un address = {};
+        address.sun_family = AF_UNIX;
+        if (setting_.socket_path.size() >= sizeof(address.sun_path)) {
+            UAirBlueprintLib::LogMessageString("Sharding Socket path is too long: ", setting_.socket_path, LogDebugLevel::Failure);
+            return false;
+        }
+        std::strncpy(address.sun_path, setting_.socket_path.c_str(), sizeof(address.sun_path) - 1);
+
+        //left behind by a coordinator that did not shut down
+        unlink(setting_.socket_path.c_str());
+
+        listen_socket_ = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (listen_socket_ < 0 || bind(listen_socket_, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0
+            || listen(listen_socket_, static_cast<int>(setting_.shard_count)) != 0) {
+            UAirBlueprintLib::LogMessageString("Cannot listen for shards on ", setting_.socket_path, LogDebugLevel::Failure);
+            if (listen_socket_ >= 0)
+                close(listen_socket_);
+            listen_socket_ = -1;
+            return false;
+        }
+    }
+
+    is_running_ = true;
+    thread_ = std::thread(isCoordinator() ? &ShardCoordinator::coordinatorLoop : &ShardCoordinator::shardLoop, this);
+    return true;
+#else
+    UAirBlueprintLib::LogMessageString("Sharding needs Unix sockets, it is only supported on Linux", "", LogDebugLevel::Failure);
+    return false;
+#endif
+}
+
+void ShardCoordinator::stop()
+{
+    is_running_ = false;
+    if (thread_.joinable())
+        thread_.join();
+
+#if PLATFORM_LINUX
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& connection : connections_)
+        close(connection.first);
+    connections_.clear();
+
+    if (coordinator_socket_ >= 0)
+        close(coordinator_socket_);
+    coordinator_socket_ = -1;
+
+    if (listen_socket_ >= 0) {
+        close(listen_socket_);
+        unlink(setting_.socket_path.c_str());
+    }
+    listen_socket_ = -1;
+#endif
+
+    step_done_.notify_all();
+}
+
+uint64_t ShardCoordinator::beginStep(uint32_t steps)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    const uint64_t sequence = ++sequence_;
+    const std::string line = "STEP " + std::to_string(sequence) + " " + std::to_string(steps);
+    for (auto& connection : connections_) {
+        if (connection.second->has_hello)
+            sendLine(connection.first, line);
+    }
+    return sequence;
+}
+
+bool ShardCoordinator::endStep(uint64_t sequence)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    const int timeout_seconds = StepTimeoutSeconds;
+    const bool all_done = step_done_.wait_for(lock, std::chrono::seconds(timeout_seconds), [this, sequence]() {
+        if (!is_running_)
+            return true;
+        for (const auto& connection : connections_) {
+            if (connection.second->has_hello && connection.second->done_sequence < sequence)
+                return false;
+        }
+        return true;
+    });
+
+    if (!all_done)
+        UE_LOG(LogTemp, Warning, TEXT("Shards did not finish step %llu in %d seconds"), static_cast<unsigned long long>(sequence), timeout_seconds);
+    return all_done;
+}
+
+int ShardCoordinator::getVehicleApiPort(const std::string& vehicle_name) const
+{
+    for (const ShardInfo& shard : getShards()) {
+        for (const std::string& name : shard.vehicle_names) {
+            if (name == vehicle_name)
+                return shard.api_port;
+        }
+    }
+    return -1;
+}
+
+std::vector<ShardCoordinator::ShardInfo> ShardCoordinator::getShards() const
+{
+    std::vector<ShardInfo> shards;
+    shards.push_back(self_);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto& connection : connections_) {
+        if (connection.second->has_hello)
+            shards.push_back(connection.second->info);
+    }
+    return shards;
+}
+
+void ShardCoordinator::coordinatorLoop()
+{
+#if PLATFORM_LINUX
+    std::vector<pollfd> poll_fds;
+    while (is_running_) {
+        poll_fds.clear();
+        poll_fds.push_back(pollfd{ listen_socket_, POLLIN, 0 });
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (const auto& connection : connections_)
+                poll_fds.push_back(pollfd{ connection.first, POLLIN, 0 });
+        }
+
+        //wakes up regularly to notice stop()
+        if (poll(poll_fds.data(), poll_fds.size(), 100) <= 0)
+            continue;
+
+        if (poll_fds[0].revents & POLLIN) {
+            const int shard_socket = accept(listen_socket_, nullptr, nullptr);
+            if (shard_socket >= 0) {
+                std::lock_guard<std::mutex> lock(mutex_);
+                connections_[shard_socket].reset(new Connection());
+                connections_[shard_socket]->socket = shard_socket;
+            }
+        }
+
+        for (size_t i = 1; i < poll_fds.size(); ++i) {
+            if (poll_fds[i].revents == 0)
+                continue;
+
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto found = connections_.find(poll_fds[i].fd);
+            if (found == connections_.end())
+                continue;
+
+            Connection& connection = *found->second;
+            const bool is_open = (poll_fds[i].revents & POLLIN) && receiveLines(connection.socket, connection.received,
+                [this, &connection](const std::string& line) { onCoordinatorLine(connection, line); });
+            if (!is_open) {
+                UE_LOG(LogTemp, Warning, TEXT("Shard %u disconnected"), connection.info.shard_index);
+                close(connection.socket);
+                connections_.erase(found);
+            }
+            step_done_.notify_all();
+        }
+    }
+#endif
+}
+
+//called with mutex_ held
+void ShardCoordinator::onCoordinatorLine(Connection& connection, const std::string& line)
+{
+    std::istringstream words(line);
+    std::string command;
+    words >> command;
+
+    if (command == "HELLO") {
+        words >> connection.info.shard_index >> connection.info.api_port;
+        std::string vehicle_name;
+        while (words >> vehicle_name)
+            connection.info.vehicle_names.push_back(decodeWord(vehicle_name));
+
+        //a shard joining late starts counting from the current step
+        connection.done_sequence = sequence_;
+        connection.has_hello = true;
+        UE_LOG(LogTemp, Log, TEXT("Shard %u connected with %d vehicles"), connection.info.shard_index,
+            static_cast<int>(connection.info.vehicle_names.size()));
+    }
+    else if (command == "DONE")
+        words >> connection.done_sequence;
+}
+
+void ShardCoordinator::shardLoop()
+{
+#if PLATFORM_LINUX
+    std::string received;
+    while (is_running_) {
+        if (coordinator_socket_ < 0) {
+            sockaddr_un address = {};
+            address.sun_family = AF_UNIX;
+            std::strncpy(address.sun_path, setting_.socket_path.c_str(), sizeof(address.sun_path) - 1);
+
+            const int coordinator_socket = socket(AF_UNIX, SOCK_STREAM, 0);
+            if (coordinator_socket < 0 || connect(coordinator_socket, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+                if (coordinator_socket >= 0)
+                    close(coordinator_socket);
+                FPlatformProcess::Sleep(ConnectRetrySeconds);
+                continue;
+            }
+
+            std::string hello = "HELLO " + std::to_string(self_.shard_index) + " " + std::to_string(self_.api_port);
+            for (const std::string& vehicle_name : self_.vehicle_names)
+                hello += " " + encodeWord(vehicle_name);
+            sendLine(coordinator_socket, hello);
+
+            received.clear();
+            std::lock_guard<std::mutex> lock(mutex_);
+            coordinator_socket_ = coordinator_socket;
+        }
+
+        pollfd poll_fd{ coordinator_socket_, POLLIN, 0 };
+        if (poll(&poll_fd, 1, 100) <= 0)
+            continue;
+
+        const bool is_open = receiveLines(coordinator_socket_, received, [this](const std::string& line) {
+            std::istringstream words(line);
+            std::string command;
+            uint64_t sequence = 0;
+            uint32_t steps = 0;
+            words >> command >> sequence >> steps;
+            if (command != "STEP")
+                return;
+
+            step_(steps);
+            sendLine(coordinator_socket_, "DONE " + std::to_string(sequence));
+        });
+
+        if (!is_open) {
+            UE_LOG(LogTemp, Warning, TEXT("Lost the shard coordinator, reconnecting"));
+            std::lock_guard<std::mutex> lock(mutex_);
+            close(coordinator_socket_);
+            coordinator_socket_ = -1;
+        }
+    }
+#endif
+}
+
+bool ShardCoordinator::receiveLines(int socket, std::string& received, const std::function<void(const std::string&)>& on_line)
+{
+#if PLATFORM_LINUX
+    char buffer[4096];
+    const ssize_t size = recv(socket, buffer, sizeof(buffer), 0);
+    if (size <= 0)
+        return false;
+    received.append(buffer, static_cast<size_t>(size));
+
+    size_t line_end;
+    while ((line_end = received.find('\n')) != std::string::npos) {
+        const std::string line = received.substr(0, line_end);
+        received.erase(0, line_end + 1);
+        on_line(line);
+    }
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool ShardCoordinator::sendLine(int socket, const std::string& line)
+{
+#if PLATFORM_LINUX
+    const std::string message = line + "\n";
+    size_t sent = 0;
+    while (sent < message.size()) {
+        const ssize_t size = send(socket, message.data() + sent, message.size() - sent, MSG_NOSIGNAL);
+        if (size <= 0)
+            return false;
+        sent += static_cast<size_t>(size);
+    }
+    return true;
+#else
+    return false;
+#endif
+}
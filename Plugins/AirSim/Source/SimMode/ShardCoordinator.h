@@ -0,0 +1,103 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "common/AirSimSettings.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+//Links the processes of a sharded simulation over a local Unix socket (Linux only).
+//Every process runs the same map with its own subset of the vehicles, see
+//AirSimSettings::isVehicleInShard. Shard 0 is the coordinator: the other shards
+//connect to it and tell it their API port and vehicles, so it knows which process
+//serves which vehicle. In lockstep mode the coordinator also hands every step to
+//all shards and only returns once each one has taken it, so the shards advance
+//simulated time together.
+//Vehicle API calls are not proxied: a client asks the coordinator for the API port
+//of the shard that simulates a vehicle (simGetVehicleApiPort, see ShardRpcServer) and talks to that shard
+//directly. Vehicles are not replicated either, a process neither renders nor
+//collides with the vehicles of other shards, nor do its sensors see them.
+//Messages are single text lines:
+//  shard -> coordinator: HELLO <shard index> <api port> <vehicle> <vehicle> ...
+//                        (spaces, control characters and % in names escaped as %XX)
+//  coordinator -> shard: STEP <sequence> <physics steps>
+//  shard -> coordinator: DONE <sequence>
+class ShardCoordinator {
+public:
+    typedef msr::airlib::AirSimSettings::ShardingSetting ShardingSetting;
+    //takes the physics steps in this process, called on the shard's socket thread
+    typedef std::function<void(uint32_t steps)> StepFunction;
+
+    struct ShardInfo {
+        unsigned int shard_index = 0;
+        int api_port = 0;
+        std::vector<std::string> vehicle_names;
+    };
+
+public:
+    ShardCoordinator(const ShardingSetting& setting, int api_port, const std::vector<std::string>& vehicle_names, StepFunction step);
+    ~ShardCoordinator();
+
+    //false if the socket could not be set up, the reason is logged
+    bool start();
+    void stop();
+
+    bool isCoordinator() const
+    {
+        return setting_.shard_index == 0;
+    }
+
+    //coordinator only: sends a step to every connected shard and returns its sequence
+    //number, for the caller to take the same step itself before waiting on endStep
+    uint64_t beginStep(uint32_t steps);
+    //coordinator only: false if a shard did not report the step done in time
+    bool endStep(uint64_t sequence);
+
+    //api port of the shard simulating the vehicle, -1 if no connected shard has it
+    int getVehicleApiPort(const std::string& vehicle_name) const;
+    std::vector<ShardInfo> getShards() const;
+
+private:
+    struct Connection {
+        int socket = -1;
+        std::string received;
+        bool has_hello = false;
+        ShardInfo info;
+        uint64_t done_sequence = 0;
+    };
+
+    void coordinatorLoop();
+    void shardLoop();
+    //false if the peer is gone
+    bool receiveLines(int socket, std::string& received, const std::function<void(const std::string&)>& on_line);
+    static bool sendLine(int socket, const std::string& line);
+    void onCoordinatorLine(Connection& connection, const std::string& line);
+
+private:
+    //a shard that takes longer for one step is considered stuck
+    static constexpr int StepTimeoutSeconds = 30;
+    //how often a shard retries to reach the coordinator
+    static constexpr float ConnectRetrySeconds = 0.5f;
+
+    ShardingSetting setting_;
+    ShardInfo self_;
+    StepFunction step_;
+
+    std::atomic<bool> is_running_{ false };
+    std::thread thread_;
+    int listen_socket_ = -1;
+    int coordinator_socket_ = -1;
+
+    mutable std::mutex mutex_;
+    std::condition_variable step_done_;
+    //coordinator: connected shards by socket
+    std::map<int, std::unique_ptr<Connection>> connections_;
+    uint64_t sequence_ = 0;
+};
@@ -0,0 +1,32 @@
+#include "ShardRpcServer.h"
+#include "SimMode/SimModeBase.h"
+#include "common/Common.hpp"
+#include <map>
+
+#ifndef AIRLIB_NO_RPC
+STRICT_MODE_OFF
+#ifndef RPCLIB_MSGPACK
+#define RPCLIB_MSGPACK clmdep_msgpack
+#endif
+//rpclib uses the name of Unreal's check macro
+#undef check
+#include "rpc/server.h"
+STRICT_MODE_ON
+#endif
+
+void ShardRpcCalls::bind(void* rpc_server, const ASimModeBase* simmode)
+{
+#ifndef AIRLIB_NO_RPC
+    rpc::server* server = static_cast<rpc::server*>(rpc_server);
+
+    server->bind("simGetVehicleApiPort", [simmode](const std::string& vehicle_name) -> int {
+        return simmode->GetVehicleApiPort(vehicle_name);
+    });
+    server->bind("simGetVehicleApiPorts", [simmode]() -> std::map<std::string, int> {
+        return simmode->GetVehicleApiPorts();
+    });
+#else
+    unused(rpc_server);
+    unused(simmode);
+#endif
+}
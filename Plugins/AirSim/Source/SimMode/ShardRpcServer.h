@@ -0,0 +1,33 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "api/ApiProvider.hpp"
+#include <cstdint>
+#include <string>
+
+class ASimModeBase;
+
+//Directory of a sharded simulation on the API server, so a client connected to shard 0
+//finds the process simulating each vehicle; other shards only know their own vehicles:
+//  simGetVehicleApiPort(vehicle_name) -> API port, -1 if no connected shard has the vehicle
+//  simGetVehicleApiPorts() -> {vehicle name: API port} for the vehicles of all connected shards
+//The vehicle calls themselves go to the port of the vehicle, they are not forwarded
+//between processes, see ShardCoordinator.
+class ShardRpcCalls {
+public:
+    //rpc_server is the rpc::server of an RpcLibServerBase, simmode must outlive it
+    static void bind(void* rpc_server, const ASimModeBase* simmode);
+};
+
+#ifndef AIRLIB_NO_RPC
+//RpcLibServerBase, or one of the vehicle servers derived from it, with the ShardRpcCalls bound
+template <class RpcServer>
+class ShardRpcServer : public RpcServer {
+public:
+    ShardRpcServer(const ASimModeBase* simmode, msr::airlib::ApiProvider* api_provider, const std::string& server_address, uint16_t port)
+        : RpcServer(api_provider, server_address, port)
+    {
+        ShardRpcCalls::bind(this->getServer(), simmode);
+    }
+};
+#endif
@@ -7,8 +7,12 @@
 #include "Kismet/GameplayStatics.h"
 #include "Misc/OutputDeviceNull.h"
 #include "Engine/World.h"
+#include "Engine/Engine.h"
+#include "HAL/IConsoleManager.h"
 
 #include <memory>
+#include <cstdlib>
+#include <algorithm>
 #include "AirBlueprintLib.h"
 #include "common/AirSimSettings.hpp"
 #include "common/ScalableClock.hpp"
@@ -16,6 +20,10 @@
 #include "SimJoyStick/SimJoyStick.h"
 #include "common/EarthCelestial.hpp"
 #include "sensors/lidar/LidarSimple.hpp"
+#include "UnrealSensors/UnrealLidarSensor.h"
+#include "UnrealSensors/UnrealDistanceArraySensor.h"
+#include "UnrealSensors/StaticSceneBVH.h"
+#include "GameThreadCommandQueue.h"
 #include "sensors/distance/DistanceSimple.hpp"
 
 #include "Kismet/GameplayStatics.h"
@@ -24,6 +32,12 @@
 
 #include "DrawDebugHelpers.h"
 
+DECLARE_CYCLE_STAT(TEXT("AdvanceTimeOfDay"), STAT_AirSim_AdvanceTimeOfDay, STATGROUP_AirSim);
+DECLARE_CYCLE_STAT(TEXT("ShowClockStats"), STAT_AirSim_ShowClockStats, STATGROUP_AirSim);
+DECLARE_CYCLE_STAT(TEXT("UpdateDebugReport"), STAT_AirSim_UpdateDebugReport, STATGROUP_AirSim);
+DECLARE_CYCLE_STAT(TEXT("DrawLidarDebugPoints"), STAT_AirSim_DrawLidarDebugPoints, STATGROUP_AirSim);
+DECLARE_CYCLE_STAT(TEXT("DrawDistanceSensorDebugPoints"), STAT_AirSim_DrawDistanceSensorDebugPoints, STATGROUP_AirSim);
+
 //TODO: this is going to cause circular references which is fine here but
 //in future we should consider moving SimMode not derived from AActor and move
 //it to AirLib and directly implement WorldSimApiBase interface
@@ -70,6 +84,13 @@ void ASimModeBase::BeginPlay()
 	//initilize APIs
 	WorldSimApiRef.reset(new WorldSimApi(this));
 	ApiProviderRef.reset(new msr::airlib::ApiProvider(WorldSimApiRef.get()));
+    GameThreadCommandQueue::initialize();
+    tickProfiler.reset(new TickProfiler());
+    advanceTimeOfDaySection = tickProfiler->addSection("AdvanceTimeOfDay");
+    showClockStatsSection = tickProfiler->addSection("ShowClockStats");
+    updateDebugReportSection = tickProfiler->addSection("UpdateDebugReport");
+    drawLidarDebugPointsSection = tickProfiler->addSection("DrawLidarDebugPoints");
+    drawDistanceSensorDebugPointsSection = tickProfiler->addSection("DrawDistanceSensorDebugPoints");
 	
 	//Setup Debug Reporter
     debugReporter.initialize(false);
@@ -91,6 +112,15 @@ void ASimModeBase::BeginPlay()
 
 	SetupClockSpeed();
 
+    //every run draws the same random numbers from the engine and the C library;
+    //sensor noise comes from AirLib's own generators, which are not reseeded here
+    if (GetSettings().deterministic_setting.enabled) {
+        const int32 seed = static_cast<int32>(GetSettings().deterministic_setting.seed);
+        std::srand(static_cast<unsigned int>(seed));
+        FMath::RandInit(seed);
+        FMath::SRandInit(seed);
+    }
+
     SetupVehiclesAndCamera();
 
 	//Setup Recording
@@ -113,6 +143,12 @@ void ASimModeBase::BeginPlay()
 
 	SetStencilIDs();
 
+    if (GetSettings().sensor_static_bvh)
+        StaticSceneBVH::build(GetWorld());
+
+    if (GetSettings().headless)
+        SetHeadless(true);
+
 	UAirBlueprintLib::LogMessage(TEXT("Press F1 to see help"), TEXT(""), LogDebugLevel::Informational);
 }
 
@@ -152,9 +188,15 @@ void ASimModeBase::EndPlay(const EEndPlayReason::Type EndPlayReason)
 {
     FRecordingThread::stopRecording();
     FRecordingThread::killRecording();
+    Playback.reset();
+    FinishingPlaybacks.clear();
+    GameThreadCommandQueue::shutdown();
+    StaticSceneBVH::clear();
+    lidar_debug_points_.clear();
     WorldSimApiRef.reset();
     ApiProviderRef.reset();
     ApiServer.reset();
+    tickProfiler.reset();
     GlobalNedTransform.reset();
 
     CameraDirector = nullptr;
@@ -248,6 +290,12 @@ void ASimModeBase::PauseSimulation(bool is_paused)
 	UGameplayStatics::SetGamePaused(GetWorld(), is_paused);
 }
 
+void ASimModeBase::PausePhysics(bool is_paused)
+{
+    //nothing moves the vehicles but the API
+    unused(is_paused);
+}
+
 void ASimModeBase::ContinueForTime(double seconds)
 {
     //should be overridden by derived class
@@ -262,6 +310,40 @@ void ASimModeBase::ContinueForFrames(uint32_t frames)
     throw std::domain_error("ContinueForFrames is not implemented by SimMode");
 }
 
+LockstepObservation ASimModeBase::LockstepStep(uint32_t steps, const std::map<std::string, std::vector<msr::airlib::ImageCaptureBase::ImageRequest>>& image_requests)
+{
+    //should be overriden by derived class
+    unused(steps);
+    unused(image_requests);
+    throw std::domain_error("LockstepStep is not implemented by SimMode");
+}
+
+PhysicsLoopMonitor::Stats ASimModeBase::GetPhysicsLoopStats() const
+{
+    //physics is stepped by Unreal
+    return PhysicsLoopMonitor::Stats();
+}
+
+WorldStateHash::Result ASimModeBase::GetWorldStateHash() const
+{
+    //physics is stepped by Unreal, which does not step deterministically
+    return WorldStateHash::Result();
+}
+
+int ASimModeBase::GetVehicleApiPort(const std::string& vehicle_name) const
+{
+    //only vehicles of this process are known here
+    return ApiProviderRef->getVehicleSimApi(vehicle_name) != nullptr ? GetSettings().api_port : -1;
+}
+
+std::map<std::string, int> ASimModeBase::GetVehicleApiPorts() const
+{
+    std::map<std::string, int> api_ports;
+    for (auto& api : ApiProviderRef->getVehicleSimApis())
+        api_ports[api->getVehicleName()] = GetSettings().api_port;
+    return api_ports;
+}
+
 void ASimModeBase::SetWind(const msr::airlib::Vector3r& wind) const
 {
     // should be overridden by derived class
@@ -303,19 +385,88 @@ void ASimModeBase::Tick(float DeltaSeconds)
     if (IsRecording())
         ++RecordTickCount;
 
-    advanceTimeOfDay();
+    if (!RecordingSteppedByPhysics)
+        FRecordingThread::onSimStep();
 
-    ShowClockStats();
+    tickProfiler->beginTick();
 
-    UpdateDebugReport(debugReporter);
+    if (Playback != nullptr) {
+        Playback->applyPendingPoses();
+        if (Playback->isFinished())
+            StopPlayback();
+    }
+    FinishingPlaybacks.erase(std::remove_if(FinishingPlaybacks.begin(), FinishingPlaybacks.end(),
+        [](const std::unique_ptr<FRecordingPlayback>& playback) { return playback->isFinished(); }),
+        FinishingPlaybacks.end());
 
-    DrawLidarDebugPoints();
+    {
+        TickProfiler::Scope scope(tickProfiler.get(), advanceTimeOfDaySection, GET_STATID(STAT_AirSim_AdvanceTimeOfDay));
+        advanceTimeOfDay();
+    }
 
-    DrawDistanceSensorDebugPoints();
+    //nobody looks at the screen when headless
+    if (!headless_) {
+        {
+            TickProfiler::Scope scope(tickProfiler.get(), showClockStatsSection, GET_STATID(STAT_AirSim_ShowClockStats));
+            ShowClockStats();
+        }
+        {
+            TickProfiler::Scope scope(tickProfiler.get(), updateDebugReportSection, GET_STATID(STAT_AirSim_UpdateDebugReport));
+            UpdateDebugReport(debugReporter);
+        }
+        {
+            TickProfiler::Scope scope(tickProfiler.get(), drawLidarDebugPointsSection, GET_STATID(STAT_AirSim_DrawLidarDebugPoints));
+            DrawLidarDebugPoints();
+        }
+        {
+            TickProfiler::Scope scope(tickProfiler.get(), drawDistanceSensorDebugPointsSection, GET_STATID(STAT_AirSim_DrawDistanceSensorDebugPoints));
+            DrawDistanceSensorDebugPoints();
+        }
+    }
 
     Super::Tick(DeltaSeconds);
 }
 
+void ASimModeBase::SetHeadless(bool is_headless)
+{
+    if (is_headless == headless_)
+        return;
+    headless_ = is_headless;
+
+    //RenderRequest renders the world for the frames it captures in
+    UAirBlueprintLib::enableWorldRendering(this, !is_headless);
+
+    //headless runs as fast as the game thread goes, frames are not held back for a display
+    IConsoleVariable* max_fps_var = IConsoleManager::Get().FindConsoleVariable(TEXT("t.MaxFPS"));
+    IConsoleVariable* vsync_var = IConsoleManager::Get().FindConsoleVariable(TEXT("r.VSync"));
+    if (is_headless) {
+        saved_smooth_frame_rate_ = GEngine->bSmoothFrameRate;
+        saved_fixed_frame_rate_ = GEngine->bUseFixedFrameRate;
+        saved_max_fps_ = max_fps_var ? max_fps_var->GetFloat() : 0;
+        saved_vsync_ = vsync_var ? vsync_var->GetInt() : 0;
+
+        GEngine->bSmoothFrameRate = false;
+        GEngine->bUseFixedFrameRate = false;
+        if (max_fps_var)
+            max_fps_var->Set(0.0f);
+        if (vsync_var)
+            vsync_var->Set(0);
+    }
+    else {
+        GEngine->bSmoothFrameRate = saved_smooth_frame_rate_;
+        GEngine->bUseFixedFrameRate = saved_fixed_frame_rate_;
+        if (max_fps_var)
+            max_fps_var->Set(saved_max_fps_);
+        if (vsync_var)
+            vsync_var->Set(saved_vsync_);
+    }
+}
+
+bool ASimModeBase::IsHeadless() const
+{
+    return headless_;
+}
+
 void ASimModeBase::ShowClockStats()
 {
     float clock_speed = GetSettings().clock_speed;
@@ -372,7 +523,22 @@ void ASimModeBase::Reset()
 
 std::string ASimModeBase::GetDebugReport()
 {
-    return debugReporter.getOutput();
+    return debugReporter.getOutput() + tickProfiler->getReport();
+}
+
+std::vector<TickProfiler::SectionStats> ASimModeBase::GetTickProfile() const
+{
+    return tickProfiler->getStats();
+}
+
+bool ASimModeBase::StartTickTrace(const std::string& FilePath)
+{
+    return tickProfiler->startTrace(FilePath);
+}
+
+bool ASimModeBase::StopTickTrace()
+{
+    return tickProfiler->stopTrace();
 }
 
 void ASimModeBase::SetupInputBindings()
@@ -444,6 +610,41 @@ bool ASimModeBase::IsRecording() const
     return FRecordingThread::isRecording();
 }
 
+void ASimModeBase::TriggerBlackBoxRecording()
+{
+    FRecordingThread::triggerBlackBox("API request");
+}
+
+void ASimModeBase::StartPlayback(const FString& FilePath, float TimeScale, bool RegenerateImages)
+{
+    FRecordingPlayback::Options options;
+    options.file_path = TCHAR_TO_UTF8(*FilePath);
+    options.time_scale = TimeScale;
+    options.regenerate_images = RegenerateImages;
+    options.recording_setting = GetSettings().recording_setting;
+
+    //only one playback at a time, the previous one is stopped first
+    StopPlayback();
+    //physics would move the vehicles away from the recorded poses between rows
+    PausePhysics(true);
+    Playback.reset(new FRecordingPlayback(options, GetApiProvider()->getVehicleSimApis()));
+}
+
+void ASimModeBase::StopPlayback()
+{
+    //the thread may be waiting for a frame to capture, it is not joined here
+    if (Playback != nullptr) {
+        Playback->stop();
+        FinishingPlaybacks.push_back(std::move(Playback));
+        PausePhysics(IsSimulationPaused());
+    }
+}
+
+bool ASimModeBase::IsPlaybackActive() const
+{
+    return Playback != nullptr && !Playback->isFinished();
+}
+
 //API server start/stop
 void ASimModeBase::StartApiServer()
 {
@@ -621,7 +822,8 @@ void ASimModeBase::SetupVehiclesAndCamera()
 		{
 			//if vehicle is of type for derived SimMode and auto creatable
 			msr::airlib::AirSimSettings::VehicleSetting* vehicle_setting = iter->second.get();
-			if (vehicle_setting->auto_create && IsVehicleTypeSupported(vehicle_setting->vehicle_type)) {
+			if (vehicle_setting->auto_create && IsVehicleTypeSupported(vehicle_setting->vehicle_type)
+				&& AirSimSettings::singleton().isVehicleInShard(*vehicle_setting)) {
 
 				// Get initial position
 				FVector spawnPos = playerStart->GetTransform().GetLocation();
@@ -718,6 +920,50 @@ std::unique_ptr<PawnSimApi> ASimModeBase::CreateVehicleSimApi(const PawnSimApi::
     return sim_api;
 }
 
+std::shared_ptr<const LidarPackedCloud> ASimModeBase::GetLidarPackedCloud(const std::string& vehicle_name, const std::string& lidar_name) const
+{
+    if (GetApiProvider() == nullptr)
+        return nullptr;
+
+    msr::airlib::VehicleApiBase* api = GetApiProvider()->getVehicleApi(vehicle_name);
+    if (api == nullptr)
+        return nullptr;
+
+    msr::airlib::uint count_lidars = api->getSensors().size(SensorType::Lidar);
+    for (msr::airlib::uint i = 0; i < count_lidars; i++) {
+        // lidars are always created by UnrealSensorFactory
+        const UnrealLidarSensor* lidar =
+            static_cast<const UnrealLidarSensor*>(api->getSensors().getByType(SensorType::Lidar, i));
+        if (lidar != nullptr && (lidar_name == "" || lidar->getName() == lidar_name))
+            return lidar->getPackedOutput();
+    }
+
+    return nullptr;
+}
+
+std::vector<msr::airlib::real_T> ASimModeBase::GetDistanceArray(const std::string& vehicle_name, const std::string& sensor_name) const
+{
+    if (GetApiProvider() == nullptr)
+        return {};
+
+    msr::airlib::VehicleApiBase* api = GetApiProvider()->getVehicleApi(vehicle_name);
+    if (api == nullptr)
+        return {};
+
+    msr::airlib::uint count_distance_sensors = api->getSensors().size(SensorType::Distance);
+    for (msr::airlib::uint i = 0; i < count_distance_sensors; i++) {
+        const msr::airlib::SensorBase* sensor = api->getSensors().getByType(SensorType::Distance, i);
+        if (sensor == nullptr || (sensor_name != "" && sensor->getName() != sensor_name))
+            continue;
+
+        const UnrealDistanceArraySensor* distance_array = UnrealDistanceArraySensor::fromSensor(sensor);
+        if (distance_array != nullptr)
+            return distance_array->getBeamDistances();
+    }
+
+    return {};
+}
+
 // Draws debug-points on main viewport for Lidar laser hits.
 // Used for debugging only.
 void ASimModeBase::DrawLidarDebugPoints()
@@ -730,6 +976,8 @@ void ASimModeBase::DrawLidarDebugPoints()
     if (GetApiProvider() == nullptr)
         return;
 
+    std::set<std::pair<std::string, std::string>> drawn_lidars;
+
     for (auto& sim_api : GetApiProvider()->getVehicleSimApis()) {
         PawnSimApi* pawn_sim_api = static_cast<PawnSimApi*>(sim_api);
         std::string vehicle_name = pawn_sim_api->getVehicleName();
@@ -742,44 +990,44 @@ void ASimModeBase::DrawLidarDebugPoints()
                 // TODO: Is it incorrect to assume LidarSimple here?
                 const msr::airlib::LidarSimple* lidar =
                     static_cast<const msr::airlib::LidarSimple*>(api->getSensors().getByType(SensorType::Lidar, i));
-                if (lidar != nullptr && lidar->getParams().draw_debug_points) {
-                    lidar_draw_debug_points_ = true;
-
-                    msr::airlib::LidarData lidar_data = lidar->getOutput();
-
-                    if (lidar_data.point_cloud.size() < 3)
-                        return;
-
-                    for (int j = 0; j < lidar_data.point_cloud.size(); j = j + 3) {
-                        Vector3r point(lidar_data.point_cloud[j], lidar_data.point_cloud[j + 1], lidar_data.point_cloud[j + 2]);
-
-                        FVector uu_point;
-
-                        if (lidar->getParams().data_frame == AirSimSettings::kVehicleInertialFrame) {
-                            uu_point = pawn_sim_api->getNedTransform().fromLocalNed(point);
-                        }
-                        else if (lidar->getParams().data_frame == AirSimSettings::kSensorLocalFrame) {
-
-                            Vector3r point_w = VectorMath::transformToWorldFrame(point, lidar_data.pose, true);
-                            uu_point = pawn_sim_api->getNedTransform().fromLocalNed(point_w);
-                        }
-                        else
-                            throw std::runtime_error("Unknown requested data frame");
-
-                        DrawDebugPoint(
-                            this->GetWorld(),
-                            uu_point,
-                            5,              // size
-                            FColor::Green,
-                            false,          // persistent (never goes away)
-                            0.03            // LifeTime: point leaves a trail on moving object
-                        );
-                    }
+                if (lidar == nullptr || !lidar->getParams().draw_debug_points)
+                    continue;
+                lidar_draw_debug_points_ = true;
+
+                const auto key = std::make_pair(vehicle_name, lidar->getName());
+                drawn_lidars.insert(key);
+                std::unique_ptr<LidarDebugPoints>& debug_points = lidar_debug_points_[key];
+                if (debug_points == nullptr)
+                    debug_points.reset(new LidarDebugPoints(this));
+
+                // getOutput() is reassigned by the physics thread while we read it, draw the copy made for us;
+                // it is in the vehicle inertial frame whatever the DataFrame, so no sensor pose is needed, which
+                // with ContinuousSweep is a different one for every column of the scan
+                const UnrealLidarSensor* unreal_lidar = static_cast<const UnrealLidarSensor*>(lidar);
+                const auto lidar_data = unreal_lidar->getDebugOutput();
+                // only scans that were not drawn yet are uploaded
+                if (lidar_data == nullptr || !debug_points->beginUpdate(lidar_data->time_stamp))
+                    continue;
+
+                const int decimation = unreal_lidar->getDrawDebugPointsDecimation();
+                for (size_t j = 0; j + 2 < lidar_data->point_cloud.size(); j += 3 * decimation) {
+                    const Vector3r point(lidar_data->point_cloud[j], lidar_data->point_cloud[j + 1], lidar_data->point_cloud[j + 2]);
+                    debug_points->addPoint(pawn_sim_api->getNedTransform().fromLocalNed(point));
                 }
+
+                debug_points->endUpdate();
             }
         }
     }
 
+    // vehicles or lidars that went away since the last pass
+    for (auto it = lidar_debug_points_.begin(); it != lidar_debug_points_.end();) {
+        if (drawn_lidars.count(it->first) == 0)
+            it = lidar_debug_points_.erase(it);
+        else
+            ++it;
+    }
+
     lidar_checks_done_ = true;
 }
 
@@ -7,15 +7,35 @@
 #include "ParticleDefinitions.h"
 
 #include <string>
+#include <map>
+#include <set>
+#include <utility>
+#include <vector>
 #include "CameraDirector.h"
 #include "common/AirSimSettings.hpp"
 #include "common/ClockFactory.hpp"
 #include "api/ApiServerBase.hpp"
 #include "api/ApiProvider.hpp"
 #include "PawnSimApi.h"
+#include "Recording/RecordingPlayback.h"
+#include "UnrealSensors/LidarPackedCloud.h"
+#include "UnrealSensors/LidarDebugPoints.h"
+#include "SimMode/PhysicsLoopMonitor.h"
+#include "SimMode/TickProfiler.h"
+#include "SimMode/WorldStateHash.h"
 #include "common/StateReporterWrapper.hpp"
 #include "SimModeBase.generated.h"
 
+//what a lockstep step returns, all taken after the physics steps and in the same rendered frame
+struct LockstepObservation {
+	uint32_t steps = 0; //physics steps taken
+	msr::airlib::TTimePoint time_stamp = 0; //simulated time after the last step
+	double sim_seconds = 0; //simulated time the steps took
+	double wall_seconds = 0; //from the call until the observations were taken
+	uint64_t state_hash = 0; //of the world in the last step, 0 unless Deterministic
+	std::map<std::string, std::vector<msr::airlib::ImageCaptureBase::ImageResponse>> images; //by vehicle name
+};
+
 UCLASS()
 class AIRSIM_API ASimModeBase : public AActor
 {
@@ -53,6 +73,22 @@ public:
 	*/
 	bool SpawnVehicleAtRuntime(const std::string& vehicle_name, const std::string& vehicle_type, const msr::airlib::Pose& pose, const std::string& pawn_path = "");
 
+	/**
+	* Returns the last scan of a lidar in the packed point format
+	* @param vehicle_name - The vehicle the lidar is attached to
+	* @param lidar_name - The name of the lidar, empty for the first one
+	* @return null if not found or the PointFormat of the lidar is XYZ
+	*/
+	std::shared_ptr<const LidarPackedCloud> GetLidarPackedCloud(const std::string& vehicle_name, const std::string& lidar_name) const;
+
+	/**
+	* Returns the last distances of a rangefinder array, a distance sensor with Beams in its settings
+	* @param vehicle_name - The vehicle the sensor is attached to
+	* @param sensor_name - The name of the distance sensor, empty for the first array
+	* @return the distance in meters along every beam, empty if no such array
+	*/
+	std::vector<msr::airlib::real_T> GetDistanceArray(const std::string& vehicle_name, const std::string& sensor_name) const;
+
 protected:
 	
 	/**
@@ -145,6 +181,14 @@ public:
 	*/
 	virtual void PauseSimulation(bool Pause);
 
+	/**
+	* Pauses only the physics of the vehicles while the world keeps ticking and rendering,
+	* used while a playback poses the vehicles.
+	* @param Pause - true if you want to pause, false if you want to resume
+	* @note Override Optional, simmodes without physics have nothing to pause
+	*/
+	virtual void PausePhysics(bool Pause);
+
 	/**
 	* Called by WorldSimAPI to unpause for seconds and then pause again
 	* @param Seconds - The time in seconds to continue
@@ -160,6 +204,44 @@ public:
 	* @note Override Required
 	*/
 	virtual void ContinueForFrames(uint32_t Frames);
+
+	/**
+	* Called by WorldSimAPI in Lockstep mode to advance physics, render one frame and capture images in it
+	* @param Steps - The number of physics steps to take, 0 only renders and captures
+	* @param ImageRequests - The images to capture by vehicle name
+	* @return The images and timing of the step
+	* @note Override Required
+	*/
+	virtual LockstepObservation LockstepStep(uint32_t Steps, const std::map<std::string, std::vector<msr::airlib::ImageCaptureBase::ImageRequest>>& ImageRequests);
+
+	/**
+	* Called by WorldSimAPI for the timing of the physics loop
+	* @return The timing, all zero if the SimMode has no physics loop of its own
+	* @note Override Optional
+	*/
+	virtual PhysicsLoopMonitor::Stats GetPhysicsLoopStats() const;
+
+	/**
+	* Called by WorldSimAPI to compare runs of a Deterministic simulation
+	* @return Hashes of the world state as of the last physics step, all zero if not Deterministic
+	* @note Override Optional
+	*/
+	virtual WorldStateHash::Result GetWorldStateHash() const;
+
+	/**
+	* Called by WorldSimAPI to find the process serving a vehicle when the simulation is sharded
+	* @param VehicleName - The name of the vehicle
+	* @return The API port of the shard simulating the vehicle, -1 if not known
+	* @note Override Optional
+	*/
+	virtual int GetVehicleApiPort(const std::string& VehicleName) const;
+
+	/**
+	* Called by the API server to list where every vehicle is served when the simulation is sharded
+	* @return The API port of the shard simulating each vehicle, by vehicle name
+	* @note Override Optional
+	*/
+	virtual std::map<std::string, int> GetVehicleApiPorts() const;
 #pragma endregion Pause Functions
 
 #pragma region Recording Functions
@@ -180,8 +262,39 @@ public:
 	/** Checks if Recording Thread is recording */
     virtual bool IsRecording() const;
 
+	/** Writes out the black box recording buffer, see Recording.BlackBox in settings */
+	UFUNCTION(BlueprintCallable, Category = "AirSim")
+	void TriggerBlackBoxRecording();
+
+	/**
+	* Moves the vehicles along a recording made by the recorder, physics is paused until it ends
+	* @param FilePath - airsim_rec.txt or airsim_rec.bin to play
+	* @param TimeScale - 1 plays in real time, 0 or less plays as fast as possible
+	* @param RegenerateImages - Captures the Recording cameras again for every row into a new recording folder
+	*/
+	UFUNCTION(BlueprintCallable, Category = "AirSim")
+	void StartPlayback(const FString& FilePath, float TimeScale = 1.0f, bool RegenerateImages = false);
+
+	/** Stops the playback started by StartPlayback, physics resumes unless the simulation is paused */
+	UFUNCTION(BlueprintCallable, Category = "AirSim")
+	void StopPlayback();
+
+	/** Checks if a playback is still running */
+	UFUNCTION(BlueprintCallable, Category = "AirSim")
+	bool IsPlaybackActive() const;
+
+protected:
+	/**
+	* Set by simmodes that step the recorder from their physics loop, see RecordingTrigger.
+	* Otherwise the recorder is stepped once per Tick.
+	*/
+	bool RecordingSteppedByPhysics = false;
+
 private:
 	int RecordTickCount;
+	std::unique_ptr<FRecordingPlayback> Playback;
+	/** Stopped playbacks, deleted in Tick once their thread has exited */
+	std::vector<std::unique_ptr<FRecordingPlayback>> FinishingPlaybacks;
 #pragma endregion Recording Functions
 
 #pragma region API Functions
@@ -311,6 +424,37 @@ public:
 	*/
 	virtual std::string GetDebugReport();
 
+	/**
+	* Called by WorldSimAPI for where the game thread spends its time in Tick
+	* @return Timing of every profiled section over the last ticks
+	*/
+	std::vector<TickProfiler::SectionStats> GetTickProfile() const;
+
+	/**
+	* Called by WorldSimAPI to record every profiled section run to a file
+	* @param FilePath - CSV if it ends in .csv, Chrome trace event JSON otherwise
+	* @return False if a trace is already being recorded
+	*/
+	bool StartTickTrace(const std::string& FilePath);
+
+	/**
+	* Called by WorldSimAPI to write the trace started with StartTickTrace
+	* @return False if no trace was recorded or the file could not be written
+	*/
+	bool StopTickTrace();
+
+	/**
+	* Switches what the Headless setting turns off at runtime: world rendering outside of captures,
+	* the frame rate cap, VSync and the debug drawing of Tick. Starts as the Headless setting.
+	* @param Headless - true to stop rendering for a display, false to restore it
+	*/
+	UFUNCTION(BlueprintCallable, Category = "AirSim")
+	void SetHeadless(bool Headless);
+
+	/** Checks if the simulation currently runs headless, see SetHeadless */
+	UFUNCTION(BlueprintCallable, Category = "AirSim")
+	bool IsHeadless() const;
+
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Debugging")
 	bool EnableReport = false;
 
@@ -318,16 +462,36 @@ protected:
 	//Optional Override
 	virtual void UpdateDebugReport(msr::airlib::StateReporterWrapper& debug_reporter);
 
+	//times the sections of Tick, see TickProfiler
+	std::unique_ptr<TickProfiler> tickProfiler;
+
 private:
 	msr::airlib::StateReporterWrapper debugReporter;
 
 	bool lidar_checks_done_ = false;
 	bool lidar_draw_debug_points_ = false;
+	// points drawn for every lidar with DrawDebugPoints, by vehicle and lidar name;
+	// entries of lidars that are gone are removed on the next pass
+	std::map<std::pair<std::string, std::string>, std::unique_ptr<LidarDebugPoints>> lidar_debug_points_;
 
 	void DrawLidarDebugPoints();
 	void DrawDistanceSensorDebugPoints();
 
 	void ShowClockStats();
+
+	//sections of Tick in tickProfiler, added in BeginPlay
+	TickProfiler::SectionId advanceTimeOfDaySection = 0;
+	TickProfiler::SectionId showClockStatsSection = 0;
+	TickProfiler::SectionId updateDebugReportSection = 0;
+	TickProfiler::SectionId drawLidarDebugPointsSection = 0;
+	TickProfiler::SectionId drawDistanceSensorDebugPointsSection = 0;
+
+	bool headless_ = false;
+	// frame pacing to restore when headless is turned off again
+	bool saved_smooth_frame_rate_ = false;
+	bool saved_fixed_frame_rate_ = false;
+	float saved_max_fps_ = 0;
+	int32 saved_vsync_ = 0;
 #pragma endregion Debug
 
 #pragma region Singleton
@@ -1,50 +1,210 @@
 #include "SimModeWorldBase.h"
 #include <exception>
+#include <algorithm>
+#include <cstdio>
+#include "HAL/PlatformTime.h"
 #include "AirBlueprintLib.h"
+#include "GameThreadCommandQueue.h"
+
+DECLARE_CYCLE_STAT(TEXT("SyncRenderedState"), STAT_AirSim_SyncRenderedState, STATGROUP_AirSim);
+DECLARE_CYCLE_STAT(TEXT("UpdateRenderedState"), STAT_AirSim_UpdateRenderedState, STATGROUP_AirSim);
+DECLARE_CYCLE_STAT(TEXT("UpdateRendering"), STAT_AirSim_UpdateRendering, STATGROUP_AirSim);
 
 
 void ASimModeWorldBase::BeginPlay()
 {
     Super::BeginPlay();
 
+	//the clock was set up by the base with the regular period
+	lockstep = GetSettings().lockstep;
+	if (lockstep)
+		SetPhysicsLoopPeriod(LockstepLoopPeriod);
+
+	//adaptive clock speed needs a clock it can slow down, which replaces the scalable one
+	if (GetSettings().adaptive_clock_speed && !lockstep) {
+		if (GetSettings().clock_type == "ScalableClock") {
+			const float clock_speed = GetSettings().clock_speed;
+			pacedClock = std::make_shared<PacedClock>(clock_speed, ClockFactory::get()->getStart(), ClockFactory::get()->nowNanos());
+			ClockFactory::get(pacedClock);
+		}
+		else
+			UAirBlueprintLib::LogMessageString("AdaptiveClockSpeed needs ScalableClock, not ", GetSettings().clock_type, LogDebugLevel::Failure);
+	}
+	loopMonitor.reset(new PhysicsLoopMonitor(GetPhysicsLoopPeriod() * 1E-9, pacedClock.get()));
+
+	//vehicles are updated in name order, the order of the API provider changes between runs
+	std::vector<msr::airlib::VehicleSimApiBase*> vehicle_sim_apis = GetApiProvider()->getVehicleSimApis();
+	std::sort(vehicle_sim_apis.begin(), vehicle_sim_apis.end(),
+		[](const msr::airlib::VehicleSimApiBase* a, const msr::airlib::VehicleSimApiBase* b) {
+			return a->getVehicleName() < b->getVehicleName();
+		});
+
+	syncRenderedStateSection = tickProfiler->addSection("SyncRenderedState");
+	vehicleTickSections.clear();
+	for (auto& api : vehicle_sim_apis)
+		GetVehicleTickSections(api);
+
 	std::vector<msr::airlib::UpdatableObject*> vehicles;
-	for (auto& api : GetApiProvider()->getVehicleSimApis())
+	vehicles.push_back(loopMonitor->getStepBegin());
+	for (auto& api : vehicle_sim_apis)
 		vehicles.push_back(api);
 	//TODO: directly accept getVehicleSimApis() using generic container
 
+	//updated after the vehicles so recorded rows see this step's vehicle updates
+	vehicles.push_back(&recordingTrigger);
+	RecordingSteppedByPhysics = true;
+
+	const AirSimSettings::DeterministicSetting& deterministic_setting = GetSettings().deterministic_setting;
+	if (deterministic_setting.enabled)
+		stateHash.reset(new WorldStateHash(vehicle_sim_apis, deterministic_setting.state_hash_file));
+
+	//pauses on the physics thread, the game is paused by the game thread when it gets to it;
+	//in lockstep the game stays paused
+	TWeakObjectPtr<ASimModeWorldBase> self(this);
+	stepSignal.reset(new PhysicsStepSignal([this, self]() {
+		physicsWorld->pause(true);
+		if (lockstep)
+			return;
+		UAirBlueprintLib::RunCommandOnGameThread([self]() {
+			if (self.IsValid())
+				UGameplayStatics::SetGamePaused(self->GetWorld(), true);
+		}, false);
+	}));
+
+	//the engine hashes the state it integrated, then signals the step and ends the monitor's
+	//step, all after the members of the world; without an engine they are the last members
 	std::unique_ptr<PhysicsEngineBase> physics_engine = CreatePhysicsEngine();
 	physicsEngine = physics_engine.get();
+	if (physicsEngine == nullptr) {
+		for (msr::airlib::UpdatableObject* after_step : GetAfterStepObjects())
+			vehicles.push_back(after_step);
+		vehicles.push_back(loopMonitor->getStepEnd());
+	}
+
+	//in lockstep no step may be taken before the first request
 	physicsWorld.reset(new msr::airlib::PhysicsWorld(std::move(physics_engine),
-		vehicles, GetPhysicsLoopPeriod()));
+		vehicles, GetPhysicsLoopPeriod(), false, !lockstep));
+	if (lockstep) {
+		physicsWorld->pause(true);
+		StartAsyncUpdator();
+		UGameplayStatics::SetGamePaused(GetWorld(), true);
+	}
+
+	StartShardCoordinator();
+}
+
+void ASimModeWorldBase::StartShardCoordinator()
+{
+	const AirSimSettings::ShardingSetting& sharding_setting = GetSettings().sharding_setting;
+	if (sharding_setting.shard_count <= 1)
+		return;
+
+	if (!lockstep)
+		UAirBlueprintLib::LogMessageString("Shards only advance together in Lockstep, they now run unsynchronized", "", LogDebugLevel::Failure);
+	UAirBlueprintLib::LogMessageString("Sharded: only the vehicles of this shard are simulated and visible here, shard ",
+		std::to_string(sharding_setting.shard_index), LogDebugLevel::Informational);
+
+	std::vector<std::string> vehicle_names;
+	for (auto& api : GetApiProvider()->getVehicleSimApis())
+		vehicle_names.push_back(api->getVehicleName());
+
+	//steps handed over by the coordinator are taken like any lockstep step of this process
+	shardCoordinator.reset(new ShardCoordinator(sharding_setting, GetSettings().api_port, vehicle_names,
+		[this](uint32_t steps) {
+			if (lockstep)
+				LockstepStep(steps, {});
+		}));
+	if (!shardCoordinator->start())
+		shardCoordinator.reset();
 }
 
 void ASimModeWorldBase::Tick(float DeltaSeconds)
 {
 	Super::Tick(DeltaSeconds);
 
-	//keep this lock as short as possible
-	physicsWorld->lock();
+	stepSignal->setFrameNumber((uint32_t)GFrameNumber);
 
-	physicsWorld->enableStateReport(EnableReport);
-	physicsWorld->updateStateReport();
+	SyncRenderedState(DeltaSeconds);
+
+	//steps are only taken on request in lockstep, there is no rate to keep up
+	if (!lockstep && !IsSimulationPaused()) {
+		const PhysicsLoopMonitor::Stats stats = loopMonitor->getStats();
+		if (stats.paced_period > 0)
+			UAirBlueprintLib::LogMessageString("Physics loop behind, clock slowed to: ", std::to_string(stats.clock_speed), LogDebugLevel::Failure);
+		else if (stats.actual_rate > 0 && stats.actual_rate < 0.9 / stats.target_period)
+			UAirBlueprintLib::LogMessageString("Physics loop behind, clock speed: ", std::to_string(stats.clock_speed), LogDebugLevel::Failure);
+	}
+}
+
+void ASimModeWorldBase::SyncRenderedState(float DeltaSeconds)
+{
+	//includes the wait for the physics lock
+	TickProfiler::Scope sync_scope(tickProfiler.get(), syncRenderedStateSection, GET_STATID(STAT_AirSim_SyncRenderedState));
 
+	//vehicles that publish their state after every physics step are read without the lock;
+	//once physics is paused the last step is published here, while nothing else steps
+	const bool is_paused = physicsWorld->isPaused();
+	bool lock_physics = EnableReport || is_paused;
 	for (auto& api : GetApiProvider()->getVehicleSimApis())
-		api->updateRenderedState(DeltaSeconds);
+		lock_physics |= !static_cast<PawnSimApi*>(api)->isRenderedStatePublished();
+
+	physicsWorld->enableStateReport(EnableReport);
+
+	if (lock_physics) {
+		//keep this lock as short as possible
+		physicsWorld->lock();
+
+		physicsWorld->updateStateReport();
+
+		for (auto& api : GetApiProvider()->getVehicleSimApis()) {
+			TickProfiler::Scope scope(tickProfiler.get(), GetVehicleTickSections(api).update_rendered_state, GET_STATID(STAT_AirSim_UpdateRenderedState));
+			if (is_paused)
+				static_cast<PawnSimApi*>(api)->publishRenderedState();
+			api->updateRenderedState(DeltaSeconds);
+		}
 
-	physicsWorld->unlock();
+		physicsWorld->unlock();
+	}
+	else {
+		for (auto& api : GetApiProvider()->getVehicleSimApis()) {
+			TickProfiler::Scope scope(tickProfiler.get(), GetVehicleTickSections(api).update_rendered_state, GET_STATID(STAT_AirSim_UpdateRenderedState));
+			api->updateRenderedState(DeltaSeconds);
+		}
+	}
 
 	//perform any expensive rendering update outside of lock region
-	for (auto& api : GetApiProvider()->getVehicleSimApis())
+	for (auto& api : GetApiProvider()->getVehicleSimApis()) {
+		TickProfiler::Scope scope(tickProfiler.get(), GetVehicleTickSections(api).update_rendering, GET_STATID(STAT_AirSim_UpdateRendering));
 		api->updateRendering(DeltaSeconds);
+	}
+}
+
+const ASimModeWorldBase::VehicleTickSections& ASimModeWorldBase::GetVehicleTickSections(const msr::airlib::VehicleSimApiBase* api)
+{
+	auto found = vehicleTickSections.find(api);
+	if (found == vehicleTickSections.end()) {
+		VehicleTickSections sections;
+		sections.update_rendered_state = tickProfiler->addSection("UpdateRenderedState " + api->getVehicleName());
+		sections.update_rendering = tickProfiler->addSection("UpdateRendering " + api->getVehicleName());
+		found = vehicleTickSections.emplace(api, sections).first;
+	}
+	return found->second;
 }
 
 void ASimModeWorldBase::EndPlay(const EEndPlayReason::Type EndPlayReason)
 {
+	//no more steps from other shards
+	shardCoordinator.reset();
+
 	//stop physics thread before we dismantle
 	StopAsyncUpdator();
 
     //remove everything that we created in BeginPlay
     physicsWorld.reset();
+    stepSignal.reset();
+    loopMonitor.reset();
+    pacedClock.reset();
+    stateHash.reset();
 
     Super::EndPlay(EndPlayReason);
 }
@@ -77,6 +237,8 @@ void ASimModeWorldBase::StopAsyncUpdator()
 void ASimModeWorldBase::RegisterPhysicsBody(msr::airlib::VehicleSimApiBase *physicsBody)
 {
 	physicsWorld->addBody(physicsBody);
+	if (stateHash)
+		stateHash->addVehicle(physicsBody);
 }
 
 long long ASimModeWorldBase::GetPhysicsLoopPeriod() const //nanoseconds
@@ -88,6 +250,47 @@ void ASimModeWorldBase::SetPhysicsLoopPeriod(long long  period)
     physicsLoopPeriod = period;
 }
 
+PhysicsLoopMonitor::Stats ASimModeWorldBase::GetPhysicsLoopStats() const
+{
+    return loopMonitor->getStats();
+}
+
+WorldStateHash::Result ASimModeWorldBase::GetWorldStateHash() const
+{
+    return stateHash ? stateHash->getLastResult() : WorldStateHash::Result();
+}
+
+int ASimModeWorldBase::GetVehicleApiPort(const std::string& vehicle_name) const
+{
+    const int api_port = Super::GetVehicleApiPort(vehicle_name);
+    if (api_port >= 0 || !shardCoordinator)
+        return api_port;
+
+    return shardCoordinator->getVehicleApiPort(vehicle_name);
+}
+
+std::map<std::string, int> ASimModeWorldBase::GetVehicleApiPorts() const
+{
+    std::map<std::string, int> api_ports = Super::GetVehicleApiPorts();
+    if (shardCoordinator) {
+        for (const ShardCoordinator::ShardInfo& shard : shardCoordinator->getShards()) {
+            for (const std::string& vehicle_name : shard.vehicle_names)
+                api_ports[vehicle_name] = shard.api_port;
+        }
+    }
+    return api_ports;
+}
+
+std::vector<msr::airlib::UpdatableObject*> ASimModeWorldBase::GetAfterStepObjects() const
+{
+    //the hash before the signal, so the step a lockstep step pauses in is hashed too
+    std::vector<msr::airlib::UpdatableObject*> after_step;
+    if (stateHash)
+        after_step.push_back(stateHash.get());
+    after_step.push_back(stepSignal.get());
+    return after_step;
+}
+
 std::unique_ptr<ASimModeWorldBase::PhysicsEngineBase> ASimModeWorldBase::CreatePhysicsEngine()
 {
     std::unique_ptr<PhysicsEngineBase> physics_engine;
@@ -97,10 +300,16 @@ std::unique_ptr<ASimModeWorldBase::PhysicsEngineBase> ASimModeWorldBase::CreateP
     else if (physics_engine_name == "FastPhysicsEngine") {
         msr::airlib::Settings fast_phys_settings;
         if (msr::airlib::Settings::singleton().getChild("FastPhysicsEngine", fast_phys_settings)) {
-            physics_engine.reset(new msr::airlib::FastPhysicsEngine(fast_phys_settings.getBool("EnableGroundLock", true)));
+            const bool enable_ground_lock = fast_phys_settings.getBool("EnableGroundLock", true);
+            if (fast_phys_settings.getBool("ParallelBodyUpdate", false))
+                physics_engine.reset(new MonitoredPhysicsEngine<ParallelPhysicsEngine>(loopMonitor.get(), GetAfterStepObjects(),
+                    enable_ground_lock, GetSettings().wind));
+            else
+                physics_engine.reset(new MonitoredPhysicsEngine<msr::airlib::FastPhysicsEngine>(loopMonitor.get(), GetAfterStepObjects(),
+                    enable_ground_lock));
         }
         else {
-            physics_engine.reset(new msr::airlib::FastPhysicsEngine());
+            physics_engine.reset(new MonitoredPhysicsEngine<msr::airlib::FastPhysicsEngine>(loopMonitor.get(), GetAfterStepObjects()));
         }
 
         physics_engine->setWind(GetSettings().wind);
@@ -119,43 +328,114 @@ void ASimModeWorldBase::PauseSimulation(bool is_paused)
 {
 	Super::PauseSimulation(is_paused);
 
-    physicsWorld->pause(is_paused);
+    //a running playback keeps physics paused until it ends
+    physicsWorld->pause(is_paused || IsPlaybackActive());
+}
+
+void ASimModeWorldBase::PausePhysics(bool is_paused)
+{
+    if (physicsWorld != nullptr)
+        physicsWorld->pause(is_paused);
 }
 
 void ASimModeWorldBase::ContinueForTime(double seconds)
 {
-    if(physicsWorld->isPaused())
-    {
-        physicsWorld->pause(false);
-        UGameplayStatics::SetGamePaused(this->GetWorld(), false);        
-    }
+    WaitForStep(ContinueForTimeAsync(seconds));
+}
 
-	//Wouldn't this halt game thread for seconds!!! thats not good
-    physicsWorld->continueForTime(seconds);
-    while(!physicsWorld->isPaused())
-    {
-        continue; 
-    }
+void ASimModeWorldBase::ContinueForFrames(uint32_t frames)
+{
+    WaitForStep(ContinueForFramesAsync(frames));
+}
+
+std::shared_future<PhysicsStepSignal::Result> ASimModeWorldBase::ContinueForTimeAsync(double seconds)
+{
+    std::shared_future<PhysicsStepSignal::Result> step = stepSignal->continueForTime(seconds);
+    ResumeForStep();
+    return step;
+}
 
-    UGameplayStatics::SetGamePaused(this->GetWorld(), true);
+std::shared_future<PhysicsStepSignal::Result> ASimModeWorldBase::ContinueForFramesAsync(uint32_t frames)
+{
+    stepSignal->setFrameNumber((uint32_t)GFrameNumber);
+    std::shared_future<PhysicsStepSignal::Result> step = stepSignal->continueForFrames(frames);
+    ResumeForStep();
+    return step;
 }
 
-void ASimModeWorldBase::ContinueForFrames(uint32_t frames)
+void ASimModeWorldBase::ResumeForStep()
 {
-    if(physicsWorld->isPaused())
-    {
+    physicsWorld->pause(false);
+
+    //game state is only changed on the game thread, queued behind the pause of any earlier step
+    TWeakObjectPtr<ASimModeWorldBase> self(this);
+    UAirBlueprintLib::RunCommandOnGameThread([self]() {
+        if (self.IsValid())
+            UGameplayStatics::SetGamePaused(self->GetWorld(), false);
+    }, false);
+}
+
+//blocks the calling API thread until the step is done; the game thread never waits
+//since frames could not advance while it does
+void ASimModeWorldBase::WaitForStep(const std::shared_future<PhysicsStepSignal::Result>& step)
+{
+    if (UAirBlueprintLib::IsInGameThread())
+        return;
+
+    step.wait();
+}
+
+LockstepObservation ASimModeWorldBase::LockstepStep(uint32_t steps, const std::map<std::string, std::vector<msr::airlib::ImageCaptureBase::ImageRequest>>& image_requests)
+{
+    if (!lockstep)
+        throw std::domain_error("LockstepStep needs \"Lockstep\": true in settings");
+
+    std::lock_guard<std::mutex> lock(lockstepMutex);
+    const double start_seconds = FPlatformTime::Seconds();
+
+    //other shards take the same steps at the same time
+    const bool step_shards = steps > 0 && shardCoordinator && shardCoordinator->isCoordinator();
+    const uint64_t shard_step = step_shards ? shardCoordinator->beginStep(steps) : 0;
+
+    //the physics thread pauses itself in the update of the last step, the game stays paused
+    LockstepObservation observation;
+    if (steps > 0) {
+        std::shared_future<PhysicsStepSignal::Result> step = stepSignal->continueForSteps(steps);
         physicsWorld->pause(false);
-        UGameplayStatics::SetGamePaused(this->GetWorld(), false);        
+        const PhysicsStepSignal::Result result = step.get();
+        observation.steps = static_cast<uint32_t>(result.steps);
+        observation.sim_seconds = result.sim_seconds;
     }
-    
-    physicsWorld->setFrameNumber((uint32_t)GFrameNumber);
-    physicsWorld->continueForFrames(frames);
-    while(!physicsWorld->isPaused())
-    {
-        physicsWorld->setFrameNumber((uint32_t)GFrameNumber);
+
+    if (step_shards)
+        shardCoordinator->endStep(shard_step);
+    observation.time_stamp = ClockFactory::get()->nowNanos();
+    if (stateHash)
+        observation.state_hash = stateHash->getLastResult().state_hash;
+
+    //one frame with the pawns where physics left them, then the captures render that frame
+    const float sim_seconds = static_cast<float>(observation.sim_seconds);
+    UAirBlueprintLib::RunCommandOnGameThread([this, sim_seconds]() {
+        SyncRenderedState(sim_seconds);
+    }, true);
+
+    for (const auto& vehicle_requests : image_requests) {
+        msr::airlib::VehicleSimApiBase* vehicle_sim_api = GetApiProvider()->getVehicleSimApi(vehicle_requests.first);
+        if (vehicle_sim_api == nullptr) {
+            UAirBlueprintLib::LogMessageString("LockstepStep: no vehicle named ", vehicle_requests.first, LogDebugLevel::Failure);
+            continue;
+        }
+        observation.images[vehicle_requests.first] = vehicle_sim_api->getImages(vehicle_requests.second);
     }
 
-    UGameplayStatics::SetGamePaused(this->GetWorld(), true);
+    observation.wall_seconds = FPlatformTime::Seconds() - start_seconds;
+
+    std::lock_guard<std::mutex> stats_lock(lockstepStatsMutex);
+    ++lockstepCalls;
+    lockstepSteps += observation.steps;
+    lockstepWallSeconds += observation.wall_seconds;
+
+    return observation;
 }
 #pragma endregion Pause Functions
 
@@ -168,6 +448,48 @@ void ASimModeWorldBase::UpdateDebugReport(msr::airlib::StateReporterWrapper& deb
 
 std::string ASimModeWorldBase::GetDebugReport()
 {
-    return physicsWorld->getDebugReport();
+    const PhysicsStepSignal::Result last_step = stepSignal->getLastResult();
+    std::string report = physicsWorld->getDebugReport()
+        + "\nLast ContinueFor step: " + std::to_string(last_step.steps) + " physics steps, "
+        + std::to_string(last_step.sim_seconds) + " s simulated in " + std::to_string(last_step.wall_seconds) + " s\n";
+
+    const PhysicsLoopMonitor::Stats loop = loopMonitor->getStats();
+    report += "Physics loop: " + std::to_string(loop.actual_rate) + " steps/s of " + std::to_string(1 / loop.target_period)
+        + ", update " + std::to_string(loop.update_duration * 1E3) + " ms (max " + std::to_string(loop.max_update_duration * 1E3) + " ms)"
+        + ", clock speed " + std::to_string(loop.clock_speed)
+        + ", " + std::to_string(loop.overruns) + " overruns, " + std::to_string(loop.missed_deadlines) + " missed deadlines\n";
+    if (loop.paced_period > 0)
+        report += "Clock slowed to a " + std::to_string(loop.paced_period * 1E3) + " ms physics loop period\n";
+
+    const GameThreadCommandQueue::Stats commands = GameThreadCommandQueue::getStats();
+    report += "Game thread commands: " + std::to_string(commands.commands_per_second) + " calls/s, "
+        + std::to_string(commands.commands_per_drain) + " per frame, " + std::to_string(commands.commands) + " total\n";
+
+    if (shardCoordinator) {
+        const std::vector<ShardCoordinator::ShardInfo> shards = shardCoordinator->getShards();
+        report += "Shard " + std::to_string(GetSettings().sharding_setting.shard_index) + " of "
+            + std::to_string(GetSettings().sharding_setting.shard_count);
+        if (shardCoordinator->isCoordinator())
+            report += ", " + std::to_string(shards.size()) + " shards connected";
+        report += "\n";
+    }
+
+    if (lockstep) {
+        std::lock_guard<std::mutex> lock(lockstepStatsMutex);
+        const double wall_seconds = lockstepWallSeconds > 0 ? lockstepWallSeconds : 1;
+        report += "Lockstep: " + std::to_string(lockstepCalls) + " calls, " + std::to_string(lockstepSteps) + " physics steps, "
+            + std::to_string(lockstepCalls / wall_seconds) + " calls/s, " + std::to_string(lockstepSteps / wall_seconds) + " steps/s\n";
+    }
+
+    if (stateHash) {
+        const WorldStateHash::Result hash = stateHash->getLastResult();
+        char hashes[48];
+        std::snprintf(hashes, sizeof(hashes), "%016llx, run %016llx", static_cast<unsigned long long>(hash.state_hash),
+            static_cast<unsigned long long>(hash.run_hash));
+        report += "State hash of step " + std::to_string(hash.steps) + ": " + hashes + "\n";
+    }
+
+    report += tickProfiler->getReport();
+    return report;
 }
 #pragma endregion Debug
\ No newline at end of file
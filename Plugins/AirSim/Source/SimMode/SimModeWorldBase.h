@@ -3,6 +3,8 @@
 #include "CoreMinimal.h"
 #include <memory>
 #include <vector>
+#include <mutex>
+#include <unordered_map>
 #include "api/VehicleSimApiBase.hpp"
 #include "physics/FastPhysicsEngine.hpp"
 #include "physics/World.hpp"
@@ -10,6 +12,11 @@
 #include "common/StateReporterWrapper.hpp"
 #include "api/ApiServerBase.hpp"
 #include "SimModeBase.h"
+#include "Recording/RecordingTrigger.h"
+#include "SimMode/PhysicsStepSignal.h"
+#include "SimMode/ParallelPhysicsEngine.h"
+#include "SimMode/PhysicsLoopMonitor.h"
+#include "SimMode/ShardCoordinator.h"
 #include "SimModeWorldBase.generated.h"
 
 extern CORE_API uint32 GFrameNumber;
@@ -38,6 +45,12 @@ protected:
 
 	long long GetPhysicsLoopPeriod() const;
 	void SetPhysicsLoopPeriod(long long  period);
+
+public:
+	virtual PhysicsLoopMonitor::Stats GetPhysicsLoopStats() const override;
+	virtual WorldStateHash::Result GetWorldStateHash() const override;
+	virtual int GetVehicleApiPort(const std::string& vehicle_name) const override;
+	virtual std::map<std::string, int> GetVehicleApiPorts() const override;
 private:
 	typedef msr::airlib::UpdatableObject UpdatableObject;
 	typedef msr::airlib::PhysicsEngineBase PhysicsEngineBase;
@@ -45,11 +58,43 @@ private:
 
 	//create the physics engine as needed from settings
 	std::unique_ptr<PhysicsEngineBase> CreatePhysicsEngine();
+	//updated once the engine has integrated a step: the state hash and the step signal
+	std::vector<msr::airlib::UpdatableObject*> GetAfterStepObjects() const;
+
+	//joins the other processes when Sharding is set up
+	void StartShardCoordinator();
 
 private:
 	std::unique_ptr<msr::airlib::PhysicsWorld> physicsWorld;
 	PhysicsEngineBase* physicsEngine;
 
+	//samples the recorder on physics steps, see Recording.Trigger
+	RecordingTrigger recordingTrigger;
+
+	//ends ContinueForTime and ContinueForFrames on the physics step that completes them
+	std::unique_ptr<PhysicsStepSignal> stepSignal;
+
+	//times every physics step, slows pacedClock to a sustainable period with AdaptiveClockSpeed
+	std::unique_ptr<PhysicsLoopMonitor> loopMonitor;
+	//the clock of the ClockFactory with AdaptiveClockSpeed, null otherwise
+	std::shared_ptr<PacedClock> pacedClock;
+
+	//links the processes of a sharded simulation, null if not sharded
+	std::unique_ptr<ShardCoordinator> shardCoordinator;
+
+	//hashes the world in every physics step when Deterministic, null otherwise
+	std::unique_ptr<WorldStateHash> stateHash;
+
+	//sections of SyncRenderedState in tickProfiler, per vehicle for the vehicle updates
+	struct VehicleTickSections {
+		TickProfiler::SectionId update_rendered_state;
+		TickProfiler::SectionId update_rendering;
+	};
+	TickProfiler::SectionId syncRenderedStateSection = 0;
+	std::unordered_map<const msr::airlib::VehicleSimApiBase*, VehicleTickSections> vehicleTickSections;
+	//added in BeginPlay, or on the first tick of a vehicle spawned later
+	const VehicleTickSections& GetVehicleTickSections(const msr::airlib::VehicleSimApiBase* api);
+
 	/*
 	300Hz seems to be minimum for non-aggressive flights
 	400Hz is needed for moderately aggressive flights (such as
@@ -60,13 +105,42 @@ private:
 	To increase freq with limited CPU power, switch Barometer to constant ref mode.
 	*/
 	long long physicsLoopPeriod = 3000000LL; //3ms
+
+	//physics steps are only taken on request in lockstep, so they are not held back to
+	//wall time; the steppable clock still advances by the regular period per step
+	static constexpr long long LockstepLoopPeriod = 100000LL; //0.1ms
 #pragma endregion Physics
 
 #pragma region Pause Functions
 public:
     virtual void PauseSimulation(bool is_paused) override;
+    virtual void PausePhysics(bool is_paused) override;
     virtual void ContinueForTime(double seconds) override;
     virtual void ContinueForFrames(uint32_t frames) override;
+
+    //same as ContinueForTime and ContinueForFrames without waiting; the future
+    //completes once the simulation is paused again
+    std::shared_future<PhysicsStepSignal::Result> ContinueForTimeAsync(double seconds);
+    std::shared_future<PhysicsStepSignal::Result> ContinueForFramesAsync(uint32_t frames);
+
+    virtual LockstepObservation LockstepStep(uint32_t steps, const std::map<std::string, std::vector<msr::airlib::ImageCaptureBase::ImageRequest>>& image_requests) override;
+
+private:
+    void ResumeForStep();
+    void WaitForStep(const std::shared_future<PhysicsStepSignal::Result>& step);
+
+    //moves the pawns to the state of the last physics step, game thread only
+    void SyncRenderedState(float DeltaSeconds);
+
+private:
+    bool lockstep = false;
+    //one lockstep step at a time
+    std::mutex lockstepMutex;
+    //separate so the debug report on the game thread never waits for a step
+    std::mutex lockstepStatsMutex;
+    uint64_t lockstepCalls = 0;
+    uint64_t lockstepSteps = 0;
+    double lockstepWallSeconds = 0;
 #pragma endregion Pause Functions
 
 #pragma region Debug
@@ -0,0 +1,186 @@
+#include "TickProfiler.h"
+#include "HAL/PlatformTime.h"
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+
+TickProfiler::Scope::Scope(TickProfiler* profiler, SectionId section, TStatId stat_id)
+    : profiler_(profiler), section_(section), cycle_counter_(stat_id), start_cycles_(FPlatformTime::Cycles64())
+{
+}
+
+TickProfiler::Scope::~Scope()
+{
+    profiler_->record(section_, start_cycles_, FPlatformTime::Cycles64());
+}
+
+TickProfiler::~TickProfiler()
+{
+    stopTrace();
+}
+
+TickProfiler::SectionId TickProfiler::addSection(const std::string& name)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto found = section_ids_.find(name);
+    if (found != section_ids_.end())
+        return found->second;
+
+    const SectionId section = sections_.size();
+    sections_.emplace_back();
+    sections_.back().name = name;
+    sections_.back().window.resize(WindowTicks, 0);
+    section_ids_.emplace(name, section);
+    return section;
+}
+
+void TickProfiler::beginTick()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (Section& section : sections_) {
+        section.window[ticks_ % WindowTicks] = section.tick_seconds;
+        section.tick_seconds = 0;
+    }
+    ++ticks_;
+}
+
+std::vector<TickProfiler::SectionStats> TickProfiler::getStats() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    std::vector<SectionStats> stats;
+    const size_t window_size = WindowTicks;
+    const size_t window_ticks = std::min(static_cast<size_t>(ticks_), window_size);
+    for (const auto& section_id : section_ids_) {
+        //added but never run, e.g. the debug drawing when headless
+        const Section& section = sections_[section_id.second];
+        if (section.runs == 0)
+            continue;
+
+        SectionStats section_stats;
+        section_stats.name = section.name;
+        section_stats.runs = section.runs;
+        if (window_ticks > 0) {
+            double sum = 0;
+            for (size_t i = 0; i < window_ticks; ++i) {
+                sum += section.window[i];
+                section_stats.max_ms = std::max(section_stats.max_ms, section.window[i] * 1E3);
+            }
+            section_stats.average_ms = sum * 1E3 / window_ticks;
+            section_stats.last_ms = section.window[(ticks_ - 1) % WindowTicks] * 1E3;
+        }
+        stats.push_back(section_stats);
+    }
+    return stats;
+}
+
+std::string TickProfiler::getReport() const
+{
+    std::string report = "Game thread tick (ms, average / max over " + std::to_string(WindowTicks) + " ticks):\n";
+    for (const SectionStats& section : getStats())
+        report += "  " + section.name + ": " + std::to_string(section.average_ms) + " / " + std::to_string(section.max_ms) + "\n";
+    return report;
+}
+
+bool TickProfiler::startTrace(const std::string& file_path)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (is_tracing_)
+        return false;
+
+    is_tracing_ = true;
+    trace_path_ = file_path;
+    trace_start_cycles_ = FPlatformTime::Cycles64();
+    trace_events_.clear();
+    return true;
+}
+
+bool TickProfiler::stopTrace()
+{
+    std::vector<TraceEvent> events;
+    std::vector<std::string> section_names;
+    std::string file_path;
+    uint64 trace_start_cycles;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!is_tracing_)
+            return false;
+
+        is_tracing_ = false;
+        events.swap(trace_events_);
+        for (const Section& section : sections_)
+            section_names.push_back(section.name);
+        file_path = trace_path_;
+        trace_start_cycles = trace_start_cycles_;
+    }
+
+    if (events.size() >= MaxTraceEvents)
+        UE_LOG(LogTemp, Warning, TEXT("Tick trace was cut at %d events"), static_cast<int>(MaxTraceEvents));
+
+    //writing takes long for a long trace, the game thread keeps ticking meanwhile
+    const std::string csv_extension = ".csv";
+    const bool is_csv = file_path.size() >= csv_extension.size()
+        && file_path.compare(file_path.size() - csv_extension.size(), csv_extension.size(), csv_extension) == 0;
+    const bool written = is_csv ? writeCsv(file_path, section_names, events, trace_start_cycles)
+        : writeChromeTrace(file_path, section_names, events, trace_start_cycles);
+    if (!written)
+        UE_LOG(LogTemp, Error, TEXT("Cannot write tick trace to %s"), UTF8_TO_TCHAR(file_path.c_str()));
+    return written;
+}
+
+void TickProfiler::record(SectionId section, uint64 start_cycles, uint64 end_cycles)
+{
+    const uint64 cycles = end_cycles - start_cycles;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    sections_[section].tick_seconds += FPlatformTime::ToSeconds64(cycles);
+    ++sections_[section].runs;
+
+    //a section running when the trace started is left out
+    if (is_tracing_ && start_cycles >= trace_start_cycles_ && trace_events_.size() < MaxTraceEvents)
+        trace_events_.push_back(TraceEvent{ section, start_cycles, cycles, ticks_ });
+}
+
+bool TickProfiler::writeCsv(const std::string& file_path, const std::vector<std::string>& section_names,
+    const std::vector<TraceEvent>& events, uint64 trace_start_cycles)
+{
+    std::ofstream file(file_path);
+    if (!file)
+        return false;
+
+    file << "tick,section,start_us,duration_us\n" << std::fixed << std::setprecision(3);
+    for (const TraceEvent& event : events) {
+        file << event.tick << ",\"" << section_names[event.section] << "\","
+            << FPlatformTime::ToSeconds64(event.start_cycles - trace_start_cycles) * 1E6 << ","
+            << FPlatformTime::ToSeconds64(event.cycles) * 1E6 << "\n";
+    }
+    return static_cast<bool>(file);
+}
+
+bool TickProfiler::writeChromeTrace(const std::string& file_path, const std::vector<std::string>& section_names,
+    const std::vector<TraceEvent>& events, uint64 trace_start_cycles)
+{
+    std::ofstream file(file_path);
+    if (!file)
+        return false;
+
+    //complete events ("ph": "X") of one thread, times in microseconds
+    file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[" << std::fixed << std::setprecision(3);
+    for (size_t i = 0; i < events.size(); ++i) {
+        const TraceEvent& event = events[i];
+        std::string name;
+        for (char c : section_names[event.section]) {
+            if (c == '"' || c == '\\')
+                name += '\\';
+            name += c;
+        }
+
+        file << (i > 0 ? ",\n" : "\n")
+            << "{\"name\":\"" << name << "\",\"cat\":\"AirSim\",\"ph\":\"X\",\"pid\":1,\"tid\":1"
+            << ",\"ts\":" << FPlatformTime::ToSeconds64(event.start_cycles - trace_start_cycles) * 1E6
+            << ",\"dur\":" << FPlatformTime::ToSeconds64(event.cycles) * 1E6
+            << ",\"args\":{\"tick\":" << event.tick << "}}";
+    }
+    file << "\n]}\n";
+    return static_cast<bool>(file);
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Stats/Stats.h"
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+//"stat AirSim" in the console shows the sections below next to the engine's own
+//counters, and Unreal Insights records them with the rest of the frame
+DECLARE_STATS_GROUP(TEXT("AirSim"), STATGROUP_AirSim, STATCAT_Advanced);
+
+//Where the game thread spends its time in the sim mode Tick. Every subsystem the
+//tick runs is timed in a named section, per vehicle for the vehicle updates, and
+//the times of the last WindowTicks ticks are kept for each section, for the HUD
+//report and the API. A trace of every section run can be written to a file, as CSV
+//or in the Chrome trace event format (chrome://tracing, Perfetto), by its extension.
+//Sections are added once by name and then timed by id, so a tick builds no names;
+//they are timed on the game thread only, stats and traces may be asked for from
+//any thread.
+class TickProfiler {
+public:
+    typedef size_t SectionId;
+
+    struct SectionStats {
+        std::string name;
+        double average_ms = 0;  //per tick over the window, ticks it did not run in count as 0
+        double max_ms = 0;      //in one tick over the window
+        double last_ms = 0;     //in the last tick
+        uint64_t runs = 0;      //since start
+    };
+
+    //times the section from construction to destruction and counts it in the engine stat
+    class Scope {
+    public:
+        Scope(TickProfiler* profiler, SectionId section, TStatId stat_id);
+        ~Scope();
+
+    private:
+        TickProfiler* profiler_;
+        SectionId section_;
+        FScopeCycleCounter cycle_counter_;
+        uint64 start_cycles_;
+    };
+
+public:
+    ~TickProfiler();
+
+    //game thread: the section with the name, added the first time
+    SectionId addSection(const std::string& name);
+
+    //game thread: at the start of every tick, closes the last one
+    void beginTick();
+
+    //sections by name
+    std::vector<SectionStats> getStats() const;
+    //one line per section, for the debug report
+    std::string getReport() const;
+
+    //false if a trace is already being recorded
+    bool startTrace(const std::string& file_path);
+    //writes the trace, false if none was recorded or the file cannot be written
+    bool stopTrace();
+
+private:
+    struct Section {
+        std::string name;
+        std::vector<double> window; //seconds per tick, ring over the last WindowTicks ticks
+        double tick_seconds = 0;
+        uint64_t runs = 0;
+    };
+    struct TraceEvent {
+        SectionId section;
+        uint64 start_cycles;
+        uint64 cycles;
+        uint64_t tick;
+    };
+
+    void record(SectionId section, uint64 start_cycles, uint64 end_cycles);
+    static bool writeCsv(const std::string& file_path, const std::vector<std::string>& section_names,
+        const std::vector<TraceEvent>& events, uint64 trace_start_cycles);
+    static bool writeChromeTrace(const std::string& file_path, const std::vector<std::string>& section_names,
+        const std::vector<TraceEvent>& events, uint64 trace_start_cycles);
+
+private:
+    static constexpr size_t WindowTicks = 120;
+    //a trace stops growing at this many events, 128 MB
+    static constexpr size_t MaxTraceEvents = 1 << 22;
+
+    mutable std::mutex mutex_;
+    //by id, an id indexes sections_
+    std::vector<Section> sections_;
+    std::map<std::string, SectionId> section_ids_;
+    uint64_t ticks_ = 0;
+
+    bool is_tracing_ = false;
+    std::string trace_path_;
+    uint64 trace_start_cycles_ = 0;
+    std::vector<TraceEvent> trace_events_;
+};
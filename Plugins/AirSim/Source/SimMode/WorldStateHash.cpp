@@ -0,0 +1,90 @@
+#include "WorldStateHash.h"
+#include "common/ClockFactory.hpp"
+#include "physics/Kinematics.hpp"
+#include <cinttypes>
+#include <cstdio>
+
+WorldStateHash::WorldStateHash(const std::vector<msr::airlib::VehicleSimApiBase*>& vehicles, const std::string& file_path)
+    : vehicles_(vehicles)
+{
+    if (file_path != "") {
+        file_.open(file_path, std::ios::out | std::ios::trunc);
+        if (file_)
+            file_ << "step,time_stamp,state_hash,run_hash\n";
+        else
+            UE_LOG(LogTemp, Error, TEXT("Cannot write state hashes to %s"), UTF8_TO_TCHAR(file_path.c_str()));
+    }
+}
+
+void WorldStateHash::addVehicle(msr::airlib::VehicleSimApiBase* vehicle)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    vehicles_.push_back(vehicle);
+}
+
+WorldStateHash::Result WorldStateHash::getLastResult() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return result_;
+}
+
+void WorldStateHash::update()
+{
+    UpdatableObject::update();
+
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    const msr::airlib::TTimePoint time_stamp = msr::airlib::ClockFactory::get()->nowNanos();
+    uint64_t state_hash = OffsetBasis;
+    hashBytes(state_hash, &time_stamp, sizeof(time_stamp));
+
+    //the physics engine integrates this step after its members, so this is the
+    //state the step starts from, with the vehicles' own updates of this step
+    for (const msr::airlib::VehicleSimApiBase* vehicle : vehicles_) {
+        const msr::airlib::Kinematics::State* kinematics = vehicle->getGroundTruthKinematics();
+        if (kinematics == nullptr)
+            continue;
+
+        hashBytes(state_hash, kinematics->pose.position.data(), sizeof(msr::airlib::real_T) * 3);
+        hashBytes(state_hash, kinematics->pose.orientation.coeffs().data(), sizeof(msr::airlib::real_T) * 4);
+        hashBytes(state_hash, kinematics->twist.linear.data(), sizeof(msr::airlib::real_T) * 3);
+        hashBytes(state_hash, kinematics->twist.angular.data(), sizeof(msr::airlib::real_T) * 3);
+        hashBytes(state_hash, kinematics->accelerations.linear.data(), sizeof(msr::airlib::real_T) * 3);
+        hashBytes(state_hash, kinematics->accelerations.angular.data(), sizeof(msr::airlib::real_T) * 3);
+    }
+
+    uint64_t run_hash = OffsetBasis;
+    if (result_.steps > 0)
+        run_hash = result_.run_hash;
+    hashBytes(run_hash, &state_hash, sizeof(state_hash));
+
+    ++result_.steps;
+    result_.time_stamp = time_stamp;
+    result_.state_hash = state_hash;
+    result_.run_hash = run_hash;
+
+    if (file_.is_open()) {
+        char line[96];
+        std::snprintf(line, sizeof(line), "%" PRIu64 ",%" PRId64 ",%016" PRIx64 ",%016" PRIx64 "\n",
+            result_.steps, static_cast<int64_t>(time_stamp), state_hash, run_hash);
+        file_ << line;
+    }
+}
+
+void WorldStateHash::resetImplementation()
+{
+    //a reset starts a new run
+    std::lock_guard<std::mutex> lock(mutex_);
+    result_ = Result();
+    if (file_.is_open())
+        file_ << "reset\n";
+}
+
+void WorldStateHash::hashBytes(uint64_t& hash, const void* data, size_t size)
+{
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= bytes[i];
+        hash *= Prime;
+    }
+}
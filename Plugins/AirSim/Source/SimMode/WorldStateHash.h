@@ -0,0 +1,56 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "common/UpdatableObject.hpp"
+#include "api/VehicleSimApiBase.hpp"
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+//Hash of the world state in every physics step, for telling whether two runs of a
+//deterministic simulation are the same. It is updated once the physics engine has
+//integrated the step (see MonitoredPhysicsEngine), or after the vehicles if there is
+//no engine, and hashes the simulated time and the kinematics of every vehicle in the
+//order they are updated in, bit for bit. The run hash chains the hashes of all steps
+//so far, so one number compares whole runs. With a file every step's hash is also
+//appended to it, to find the first step two runs differ in.
+class WorldStateHash : public msr::airlib::UpdatableObject {
+public:
+    struct Result {
+        uint64_t steps = 0;                     //hashed since start
+        msr::airlib::TTimePoint time_stamp = 0; //of the last step
+        uint64_t state_hash = 0;                //of the last step
+        uint64_t run_hash = 0;                  //of all steps
+    };
+
+public:
+    //vehicles in update order; file_path may be empty
+    WorldStateHash(const std::vector<msr::airlib::VehicleSimApiBase*>& vehicles, const std::string& file_path);
+
+    //vehicles spawned at runtime, updated after the others
+    void addVehicle(msr::airlib::VehicleSimApiBase* vehicle);
+
+    Result getLastResult() const;
+
+    virtual void update() override;
+
+protected:
+    virtual void resetImplementation() override;
+
+private:
+    static void hashBytes(uint64_t& hash, const void* data, size_t size);
+
+private:
+    //FNV-1a
+    static constexpr uint64_t OffsetBasis = 14695981039346656037ULL;
+    static constexpr uint64_t Prime = 1099511628211ULL;
+
+    mutable std::mutex mutex_;
+    std::vector<msr::airlib::VehicleSimApiBase*> vehicles_;
+    Result result_;
+
+    //written by update and reset, which the world never runs together
+    std::ofstream file_;
+};
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include <atomic>
+#include <cstdint>
+
+//Lock-free hand over of the latest value from one writer thread to one reader thread.
+//The writer fills its buffer and publishes it, the reader picks up the newest
+//published buffer; neither ever waits for the other. Values published while the
+//reader does not look are overwritten, so this carries state, not events.
+//Buffers are reused, so T holding vectors of a steady size does not allocate.
+template<typename T>
+class TripleBuffer {
+public:
+    TripleBuffer()
+        : write_(0), middle_(1), read_(2)
+    {
+    }
+
+    //writer side: fill, then publish
+    T& getWriteBuffer()
+    {
+        return buffers_[write_];
+    }
+    void publish()
+    {
+        write_ = middle_.exchange(write_ | DirtyBit, std::memory_order_acq_rel) & IndexMask;
+    }
+
+    //reader side: true if a newer value was published since the last call
+    bool update()
+    {
+        if ((middle_.load(std::memory_order_acquire) & DirtyBit) == 0)
+            return false;
+
+        read_ = middle_.exchange(read_, std::memory_order_acq_rel) & IndexMask;
+        return true;
+    }
+    const T& getReadBuffer() const
+    {
+        return buffers_[read_];
+    }
+
+private:
+    static constexpr uint8_t IndexMask = 0x3;
+    static constexpr uint8_t DirtyBit = 0x4; //middle buffer has not been read yet
+
+    T buffers_[3];
+    uint8_t write_;
+    std::atomic<uint8_t> middle_;
+    uint8_t read_;
+};
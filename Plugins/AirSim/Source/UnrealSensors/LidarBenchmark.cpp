@@ -0,0 +1,153 @@
+#include "CoreMinimal.h"
+#include "HAL/IConsoleManager.h"
+#include "HAL/PlatformTime.h"
+#include "common/Common.hpp"
+#include "common/VectorMath.hpp"
+#include <cmath>
+#include <vector>
+
+//Console command measuring how fast UnrealLidarSensor builds the rays of a scan and brings
+//the hits to SensorLocalFrame, with the per ray quaternions it used before the ray tables
+//and with the tables. Line traces are left out, they are the same for both and need a world.
+//  AirSim.Bench.LidarRays [channels] [points per channel] [scans]
+
+namespace {
+    typedef msr::airlib::Vector3r Vector3r;
+    typedef msr::airlib::Pose Pose;
+    typedef msr::airlib::VectorMath VectorMath;
+    typedef Eigen::Matrix<msr::airlib::real_T, 3, 3> Matrix3r;
+
+    const int32 kDefaultChannels = 32;
+    const int32 kDefaultPointsPerChannel = 2000;
+    const int32 kDefaultScans = 100;
+    const float kRange = 100.0f;
+    const float kVerticalFovUpper = 15.0f;
+    const float kVerticalFovLower = -25.0f;
+
+    struct ScanSetup {
+        std::vector<float> laser_angles;
+        std::vector<float> laser_cos;
+        std::vector<float> laser_sin;
+        std::vector<float> horizontal_angles;
+        Pose lidar_pose;
+        Pose vehicle_pose;
+    };
+
+    ScanSetup makeSetup(int32 channels, int32 points_per_channel)
+    {
+        ScanSetup setup;
+        const float delta_angle = channels > 1 ? (kVerticalFovUpper - kVerticalFovLower) / (channels - 1) : 0;
+        for (int32 i = 0; i < channels; ++i) {
+            const float vertical_angle = kVerticalFovUpper - i * delta_angle;
+            setup.laser_angles.push_back(vertical_angle);
+            setup.laser_cos.push_back(std::cos(msr::airlib::Utils::degreesToRadians(vertical_angle)));
+            setup.laser_sin.push_back(std::sin(msr::airlib::Utils::degreesToRadians(vertical_angle)));
+        }
+        for (int32 i = 0; i < points_per_channel; ++i)
+            setup.horizontal_angles.push_back(360.0f * i / points_per_channel);
+
+        setup.lidar_pose = Pose(Vector3r(0.2f, 0, -0.3f), VectorMath::toQuaternion(0.05f, 0, 0.1f));
+        setup.vehicle_pose = Pose(Vector3r(12.0f, -4.0f, -20.0f), VectorMath::toQuaternion(0.02f, -0.03f, 1.2f));
+        return setup;
+    }
+
+    //ray ends as shootLaser computed them before the ray tables, and the hits, taken to be
+    //the ray ends, brought to the lidar frame one by one
+    void scanWithQuaternions(const ScanSetup& setup, std::vector<Vector3r>& ends, std::vector<Vector3r>& local_points)
+    {
+        ends.clear();
+        local_points.clear();
+        for (size_t laser = 0; laser < setup.laser_angles.size(); ++laser) {
+            for (float horizontal_angle : setup.horizontal_angles) {
+                const Vector3r start = VectorMath::add(setup.lidar_pose, setup.vehicle_pose).position;
+                const msr::airlib::Quaternionr ray_q_l = VectorMath::toQuaternion(
+                    msr::airlib::Utils::degreesToRadians(setup.laser_angles[laser]), 0,
+                    msr::airlib::Utils::degreesToRadians(horizontal_angle));
+                const msr::airlib::Quaternionr ray_q_b = VectorMath::coordOrientationAdd(ray_q_l, setup.lidar_pose.orientation);
+                const msr::airlib::Quaternionr ray_q_w = VectorMath::coordOrientationAdd(ray_q_b, setup.vehicle_pose.orientation);
+                ends.push_back(VectorMath::rotateVector(VectorMath::front(), ray_q_w, true) * kRange + start);
+            }
+        }
+        for (const Vector3r& end : ends)
+            local_points.push_back(VectorMath::transformToBodyFrame(end, setup.lidar_pose + setup.vehicle_pose, true));
+    }
+
+    //the same with the tables and one rotation per scan, as getPointCloud does now
+    void scanWithTables(const ScanSetup& setup, std::vector<float>& cos_h, std::vector<float>& sin_h,
+        std::vector<Vector3r>& ends, std::vector<msr::airlib::real_T>& local_points)
+    {
+        cos_h.clear();
+        sin_h.clear();
+        for (float horizontal_angle : setup.horizontal_angles) {
+            const float horizontal_radians = msr::airlib::Utils::degreesToRadians(horizontal_angle);
+            cos_h.push_back(std::cos(horizontal_radians));
+            sin_h.push_back(std::sin(horizontal_radians));
+        }
+
+        const Pose sensor_pose = VectorMath::add(setup.lidar_pose, setup.vehicle_pose);
+        const Matrix3r rotation = sensor_pose.orientation.toRotationMatrix();
+        const Vector3r& start = sensor_pose.position;
+
+        ends.clear();
+        local_points.clear();
+        for (size_t laser = 0; laser < setup.laser_cos.size(); ++laser) {
+            for (size_t column = 0; column < cos_h.size(); ++column) {
+                const Vector3r direction_l(setup.laser_cos[laser] * cos_h[column], setup.laser_cos[laser] * sin_h[column],
+                    -setup.laser_sin[laser]);
+                const Vector3r end = start + rotation * direction_l * kRange;
+                ends.push_back(end);
+                local_points.push_back(end.x());
+                local_points.push_back(end.y());
+                local_points.push_back(end.z());
+            }
+        }
+
+        Eigen::Map<Eigen::Matrix<msr::airlib::real_T, 3, Eigen::Dynamic>> points(local_points.data(), 3, ends.size());
+        points = rotation.transpose() * (points.colwise() - start);
+    }
+
+    void reportRate(const TCHAR* name, int32 scans, size_t points_per_scan, uint64 cycles)
+    {
+        const double seconds = FPlatformTime::ToSeconds64(cycles);
+        UE_LOG(LogTemp, Display, TEXT("AirSim.Bench.LidarRays %s: %d scans of %llu points in %.3f s, %.2f M points/s"),
+            name, scans, static_cast<uint64>(points_per_scan), seconds, seconds > 0 ? scans * points_per_scan / seconds / 1.0E6 : 0.0);
+    }
+
+    void benchLidarRays(const TArray<FString>& args)
+    {
+        const int32 channels = args.Num() > 0 ? FMath::Max(1, FCString::Atoi(*args[0])) : kDefaultChannels;
+        const int32 points_per_channel = args.Num() > 1 ? FMath::Max(1, FCString::Atoi(*args[1])) : kDefaultPointsPerChannel;
+        const int32 scans = args.Num() > 2 ? FMath::Max(1, FCString::Atoi(*args[2])) : kDefaultScans;
+        const ScanSetup setup = makeSetup(channels, points_per_channel);
+
+        std::vector<Vector3r> quaternion_ends, quaternion_points;
+        uint64 start = FPlatformTime::Cycles64();
+        for (int32 scan = 0; scan < scans; ++scan)
+            scanWithQuaternions(setup, quaternion_ends, quaternion_points);
+        reportRate(TEXT("quaternions per ray"), scans, quaternion_ends.size(), FPlatformTime::Cycles64() - start);
+
+        std::vector<float> cos_h, sin_h;
+        std::vector<Vector3r> table_ends;
+        std::vector<msr::airlib::real_T> table_points;
+        start = FPlatformTime::Cycles64();
+        for (int32 scan = 0; scan < scans; ++scan)
+            scanWithTables(setup, cos_h, sin_h, table_ends, table_points);
+        reportRate(TEXT("ray tables"), scans, table_ends.size(), FPlatformTime::Cycles64() - start);
+
+        //both must shoot the same rays, up to float rounding
+        float max_end_error = 0, max_point_error = 0;
+        for (size_t i = 0; i < table_ends.size(); ++i) {
+            max_end_error = FMath::Max(max_end_error, (table_ends[i] - quaternion_ends[i]).norm());
+            const Vector3r table_point(table_points[3 * i], table_points[3 * i + 1], table_points[3 * i + 2]);
+            max_point_error = FMath::Max(max_point_error, (table_point - quaternion_points[i]).norm());
+        }
+        UE_LOG(LogTemp, Display, TEXT("AirSim.Bench.LidarRays largest difference: %g m at the ray ends, %g m in SensorLocalFrame"),
+            max_end_error, max_point_error);
+    }
+
+    FAutoConsoleCommand bench_lidar_rays_command(
+        TEXT("AirSim.Bench.LidarRays"),
+        TEXT("Builds lidar rays and SensorLocalFrame points with per ray quaternions and with ray tables, logging points/s. ")
+        TEXT("Args: [channels] [points per channel] [scans]"),
+        FConsoleCommandWithArgsDelegate::CreateStatic(&benchLidarRays));
+}
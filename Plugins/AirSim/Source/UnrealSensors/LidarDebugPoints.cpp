@@ -0,0 +1,67 @@
+#include "LidarDebugPoints.h"
+#include "Engine/StaticMesh.h"
+#include "Materials/MaterialInterface.h"
+#include "Materials/MaterialInstanceDynamic.h"
+
+// edge of the drawn cubes in Unreal units, the engine cube is 100 across
+static constexpr float DEBUG_POINT_SIZE = 5.0f;
+
+LidarDebugPoints::LidarDebugPoints(AActor* owner)
+{
+    instances_ = NewObject<UInstancedStaticMeshComponent>(owner);
+    instances_->SetStaticMesh(LoadObject<UStaticMesh>(nullptr, TEXT("/Engine/BasicShapes/Cube.Cube")));
+
+    UMaterialInterface* material = LoadObject<UMaterialInterface>(nullptr, TEXT("/Engine/BasicShapes/BasicShapeMaterial.BasicShapeMaterial"));
+    if (material != nullptr) {
+        UMaterialInstanceDynamic* colored_material = UMaterialInstanceDynamic::Create(material, instances_);
+        colored_material->SetVectorParameterValue(TEXT("Color"), FLinearColor::Green);
+        instances_->SetMaterial(0, colored_material);
+    }
+
+    // only for the viewport: no collision for the sensors to hit, no shadows and not in camera images
+    instances_->SetCollisionEnabled(ECollisionEnabled::NoCollision);
+    instances_->SetCastShadow(false);
+    instances_->SetCanEverAffectNavigation(false);
+    instances_->bHiddenInSceneCapture = true;
+    instances_->SetMobility(EComponentMobility::Movable);
+    instances_->SetupAttachment(owner->GetRootComponent());
+    instances_->RegisterComponent();
+}
+
+LidarDebugPoints::~LidarDebugPoints()
+{
+    if (instances_->IsValidLowLevel() && !instances_->IsPendingKill())
+        instances_->DestroyComponent();
+}
+
+bool LidarDebugPoints::beginUpdate(msr::airlib::TTimePoint time_stamp)
+{
+    if (time_stamp == time_stamp_)
+        return false;
+
+    time_stamp_ = time_stamp;
+    point_count_ = 0;
+    return true;
+}
+
+void LidarDebugPoints::addPoint(const FVector& position)
+{
+    const FTransform transform(FQuat::Identity, position, FVector(DEBUG_POINT_SIZE / 100.0f));
+    if (point_count_ < transforms_.Num())
+        transforms_[point_count_] = transform;
+    else
+        transforms_.Add(transform);
+    ++point_count_;
+}
+
+void LidarDebugPoints::endUpdate()
+{
+    // new instances only when a scan has more points than any before, the rest are hidden
+    for (int32 index = point_count_; index < transforms_.Num(); ++index)
+        transforms_[index].SetScale3D(FVector::ZeroVector);
+    for (int32 index = instances_->GetInstanceCount(); index < transforms_.Num(); ++index)
+        instances_->AddInstanceWorldSpace(transforms_[index]);
+
+    if (transforms_.Num() > 0)
+        instances_->BatchUpdateInstancesTransforms(0, transforms_, true, true, true);
+}
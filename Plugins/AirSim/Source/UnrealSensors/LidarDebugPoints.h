@@ -0,0 +1,31 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "GameFramework/Actor.h"
+#include "Components/InstancedStaticMeshComponent.h"
+#include "common/Common.hpp"
+
+// Lidar hits drawn for DrawDebugPoints as instances of a small cube.
+// The instance transforms stay on the GPU and are only uploaded again when a
+// scan with a new time stamp is drawn, instead of one debug point per hit
+// queued every frame.
+class LidarDebugPoints {
+public:
+    // game thread only, the component is attached to owner
+    explicit LidarDebugPoints(AActor* owner);
+    ~LidarDebugPoints();
+
+    // false if the scan with this time stamp is already drawn, otherwise
+    // points of the new scan are added until endUpdate
+    bool beginUpdate(msr::airlib::TTimePoint time_stamp);
+    // position in Unreal world space
+    void addPoint(const FVector& position);
+    void endUpdate();
+
+private:
+    UInstancedStaticMeshComponent* instances_;
+    msr::airlib::TTimePoint time_stamp_ = 0;
+    // instances past the points of the scan are kept at zero scale to be reused
+    TArray<FTransform> transforms_;
+    int32 point_count_ = 0;
+};
@@ -0,0 +1,145 @@
+#include "LidarDepthCapture.h"
+#include "AirBlueprintLib.h"
+#include "TextureResource.h"
+#include "RenderingThread.h"
+#include "RHICommandList.h"
+#include "Engine/World.h"
+#include <cmath>
+#include <algorithm>
+
+// each view covers 360/count degrees and must stay well below 180
+static constexpr int MIN_DEPTH_VIEWS = 3;
+static constexpr int MAX_DEPTH_VIEWS = 16;
+// steepest half vertical field of view of a capture, in degrees
+static constexpr float MAX_HALF_VERTICAL_FOV = 80.0f;
+
+LidarDepthCapture::LidarDepthCapture(AActor* actor, const NedTransform* ned_transform, const Pose& relative_pose,
+    int view_count, int resolution, float vertical_FOV_upper, float vertical_FOV_lower)
+    : actor_(actor), ned_transform_(ned_transform),
+      view_count_(FMath::Clamp(view_count, MIN_DEPTH_VIEWS, MAX_DEPTH_VIEWS)),
+      readback_(std::make_shared<Readback>())
+{
+    UAirBlueprintLib::RunCommandOnGameThread([this, relative_pose, resolution, vertical_FOV_upper, vertical_FOV_lower]() {
+        createCaptures(relative_pose, resolution, vertical_FOV_upper, vertical_FOV_lower);
+    }, true);
+}
+
+LidarDepthCapture::~LidarDepthCapture()
+{
+    UAirBlueprintLib::RunCommandOnGameThread([this]() {
+        FWorldDelegates::OnWorldPostActorTick.Remove(post_actor_tick_handle_);
+
+        // pending readbacks still use the render targets
+        FlushRenderingCommands();
+
+        for (USceneCaptureComponent2D* capture : captures_) {
+            if (capture->IsValidLowLevel() && !capture->IsPendingKill())
+                capture->DestroyComponent();
+        }
+        for (UTextureRenderTarget2D* render_target : render_targets_)
+            render_target->RemoveFromRoot();
+    }, true);
+}
+
+void LidarDepthCapture::createCaptures(const Pose& relative_pose, int resolution, float vertical_FOV_upper, float vertical_FOV_lower)
+{
+    const float view_FOV = 360.0f / view_count_;
+    tan_half_horizontal_ = std::tan(FMath::DegreesToRadians(view_FOV / 2));
+
+    // the lasers must be inside every view up to its left and right edges, where they are furthest from the center
+    const float max_vertical_tan = std::max(std::abs(std::tan(FMath::DegreesToRadians(vertical_FOV_upper))),
+        std::abs(std::tan(FMath::DegreesToRadians(vertical_FOV_lower))));
+    tan_half_vertical_ = std::min(max_vertical_tan / std::cos(FMath::DegreesToRadians(view_FOV / 2)),
+        std::tan(FMath::DegreesToRadians(MAX_HALF_VERTICAL_FOV)));
+
+    width_ = std::max(resolution, 1);
+    height_ = std::max(FMath::CeilToInt(width_ * tan_half_vertical_ / tan_half_horizontal_), 1);
+
+    const FVector position = ned_transform_->fromRelativeNed(relative_pose.position);
+    const FQuat orientation = ned_transform_->fromNed(relative_pose.orientation);
+
+    for (int view = 0; view < view_count_; ++view) {
+        UTextureRenderTarget2D* render_target = NewObject<UTextureRenderTarget2D>();
+        render_target->AddToRoot();
+        render_target->InitCustomFormat(width_, height_, PF_FloatRGBA, true);
+        render_targets_.Add(render_target);
+
+        USceneCaptureComponent2D* capture = NewObject<USceneCaptureComponent2D>(actor_);
+        capture->CaptureSource = ESceneCaptureSource::SCS_SceneDepth;
+        capture->FOVAngle = view_FOV;
+        capture->TextureTarget = render_target;
+        capture->bCaptureEveryFrame = true;
+        capture->bCaptureOnMovement = false;
+        capture->HideActorComponents(actor_);
+        capture->SetupAttachment(actor_->GetRootComponent());
+        capture->SetRelativeLocationAndRotation(position, orientation * FQuat(FRotator(0, view * view_FOV, 0)));
+        capture->RegisterComponent();
+        captures_.Add(capture);
+    }
+
+    post_actor_tick_handle_ = FWorldDelegates::OnWorldPostActorTick.AddRaw(this, &LidarDepthCapture::onPostActorTick);
+}
+
+void LidarDepthCapture::onPostActorTick(UWorld* world, ELevelTick tick_type, float delta_seconds)
+{
+    if (world != actor_->GetWorld() || !readback_->requested.exchange(false))
+        return;
+
+    TArray<FTextureRenderTargetResource*> resources;
+    for (UTextureRenderTarget2D* render_target : render_targets_)
+        resources.Add(render_target->GameThread_GetRenderTargetResource());
+
+    // reads what the captures rendered last frame, without stalling the game thread
+    std::shared_ptr<Readback> readback = readback_;
+    const FIntRect rect(0, 0, width_, height_);
+    ENQUEUE_RENDER_COMMAND(LidarDepthReadback)(
+        [readback, resources, rect](FRHICommandListImmediate& RHICmdList)
+    {
+        auto images = std::make_shared<DepthImages>();
+        images->views.resize(resources.Num());
+        for (int view = 0; view < resources.Num(); ++view)
+            RHICmdList.ReadSurfaceFloatData(resources[view]->GetRenderTargetTexture(), rect, images->views[view], CubeFace_PosX, 0, 0);
+
+        std::lock_guard<std::mutex> lock(readback->mutex);
+        readback->latest = std::move(images);
+    });
+}
+
+std::shared_ptr<const LidarDepthCapture::DepthImages> LidarDepthCapture::getLatestImages()
+{
+    readback_->requested = true;
+
+    std::lock_guard<std::mutex> lock(readback_->mutex);
+    return readback_->latest;
+}
+
+bool LidarDepthCapture::getRange(const DepthImages& images, const Vector3r& direction, float max_range, float& range) const
+{
+    // pick the view the direction falls in, view 0 is centered on the lidar front
+    const float view_FOV = 360.0f / view_count_;
+    float azimuth = FMath::RadiansToDegrees(std::atan2(direction.y(), direction.x()));
+    if (azimuth < 0)
+        azimuth += 360.0f;
+    const int view = static_cast<int>((azimuth + view_FOV / 2) / view_FOV) % view_count_;
+    if (view >= static_cast<int>(images.views.size()))
+        return false;
+
+    // direction in the frame of that view, NED like the lidar: x forward, y right, z down
+    const float view_yaw = FMath::DegreesToRadians(view * view_FOV);
+    const float cos_yaw = std::cos(view_yaw), sin_yaw = std::sin(view_yaw);
+    const float forward = cos_yaw * direction.x() + sin_yaw * direction.y();
+    const float right = -sin_yaw * direction.x() + cos_yaw * direction.y();
+    if (forward <= 0)
+        return false;
+
+    const int x = FMath::Clamp(static_cast<int>((right / forward / tan_half_horizontal_ + 1) * 0.5f * width_), 0, width_ - 1);
+    const int y = FMath::Clamp(static_cast<int>((direction.z() / forward / tan_half_vertical_ + 1) * 0.5f * height_), 0, height_ - 1);
+
+    const TArray<FFloat16Color>& depth = images.views[view];
+    if (depth.Num() != width_ * height_)
+        return false;
+
+    // scene depth is the distance along the view axis, not along the ray
+    range = ned_transform_->toNed(depth[y * width_ + x].R.GetFloat()) / forward;
+    return range < max_range;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "GameFramework/Actor.h"
+#include "Components/SceneCaptureComponent2D.h"
+#include "Engine/TextureRenderTarget2D.h"
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include "common/Common.hpp"
+#include "NedTransform.h"
+
+// Depth images around a lidar, used by the DepthBuffer lidar simulation mode.
+// A ring of scene captures attached at the lidar pose renders scene depth every
+// frame; the depth is read back on the render thread after every frame a scan
+// asked for it, and lidar rays are answered by looking up the pixel they pass
+// through instead of tracing them. Ranges are one frame behind the traced ones
+// and quantized by the depth image resolution.
+class LidarDepthCapture {
+public:
+    typedef msr::airlib::Vector3r Vector3r;
+    typedef msr::airlib::Pose Pose;
+
+    // depth in Unreal units of every view, row major
+    struct DepthImages {
+        std::vector<TArray<FFloat16Color>> views;
+    };
+
+public:
+    LidarDepthCapture(AActor* actor, const NedTransform* ned_transform, const Pose& relative_pose,
+        int view_count, int resolution, float vertical_FOV_upper, float vertical_FOV_lower);
+    ~LidarDepthCapture();
+
+    // latest depth read back, null until the first frame is read
+    std::shared_ptr<const DepthImages> getLatestImages();
+
+    // range in meters along a unit direction in the lidar frame, false if nothing is closer than max_range
+    bool getRange(const DepthImages& images, const Vector3r& direction, float max_range, float& range) const;
+
+private:
+    struct Readback {
+        std::mutex mutex;
+        std::shared_ptr<const DepthImages> latest;
+        // set by scans so frames are only read back while the lidar is in use
+        std::atomic<bool> requested { true };
+    };
+
+    void createCaptures(const Pose& relative_pose, int resolution, float vertical_FOV_upper, float vertical_FOV_lower);
+    void onPostActorTick(UWorld* world, ELevelTick tick_type, float delta_seconds);
+
+private:
+    AActor* actor_;
+    const NedTransform* ned_transform_;
+
+    int view_count_;
+    int width_ = 0, height_ = 0;
+    // tangents of half the field of view of every capture
+    float tan_half_horizontal_ = 0, tan_half_vertical_ = 0;
+
+    TArray<USceneCaptureComponent2D*> captures_;
+    TArray<UTextureRenderTarget2D*> render_targets_;
+    std::shared_ptr<Readback> readback_;
+    FDelegateHandle post_actor_tick_handle_;
+};
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include <vector>
+#include <string>
+#include "common/Common.hpp"
+
+// Packed lidar point cloud, sent in addition to the xyz float list and separate
+// segmentation list of LidarData. Every point carries its channel (ring) and its
+// time relative to the start of the scan so clients can motion compensate.
+// Selected with the PointFormat lidar setting.
+
+#pragma pack(push, 1)
+struct LidarPackedPoint {
+    float x, y, z;              // meters, in the frame given by LidarPackedCloud::data_frame
+    float intensity;            // 0..1
+    int32 segmentation;         // custom stencil ID of the hit object, -1 if unknown
+    uint16 ring;                // laser/channel index, 0 is the uppermost
+    uint8 return_index;         // 0 for the first return
+    uint8 return_count;         // number of returns of the ray this point belongs to
+    float time_offset;          // seconds since LidarPackedCloud::time_stamp
+};
+
+// same as LidarPackedPoint with positions and times scaled to 16 bits,
+// see LidarPackedCloud::position_resolution and time_resolution
+struct LidarQuantizedPoint {
+    int16 x, y, z;
+    uint16 intensity;           // intensity * 65535
+    int16 segmentation;
+    uint16 ring;
+    uint8 return_index;
+    uint8 return_count;
+    uint16 time_offset;
+};
+#pragma pack(pop)
+
+static_assert(sizeof(LidarPackedPoint) == 28, "LidarPackedPoint is sent as is, keep it packed");
+static_assert(sizeof(LidarQuantizedPoint) == 18, "LidarQuantizedPoint is sent as is, keep it packed");
+
+struct LidarPackedCloud {
+    // start of the scan, point time offsets are relative to it
+    msr::airlib::TTimePoint time_stamp = 0;
+    float scan_duration = 0;
+    // lidar pose in vehicle inertial frame at the end of the scan, time_stamp + scan_duration
+    msr::airlib::Pose pose;
+    std::string data_frame;
+
+    // only one of these is filled, depending on the PointFormat setting
+    std::vector<LidarPackedPoint> points;
+    std::vector<LidarQuantizedPoint> quantized_points;
+
+    // meters and seconds per unit of LidarQuantizedPoint
+    float position_resolution = 0;
+    float time_resolution = 0;
+
+    size_t size() const
+    {
+        return points.size() + quantized_points.size();
+    }
+
+    void clear()
+    {
+        points.clear();
+        quantized_points.clear();
+    }
+};
@@ -29,6 +29,16 @@ std::unique_ptr<AirSimSettings::SensorSetting> FSensorSetting::CreateAirLibSenso
 
 			distanceSetting->min_distance = Distance_MinDistance;
 			distanceSetting->max_distance = Distance_MaxDistance;
+
+			for (const FRotator& beamRotation : Distance_Beams)
+			{
+				AirSimSettings::DistanceSetting::Beam beam;
+				beam.yaw = beamRotation.Yaw;
+				beam.pitch = beamRotation.Pitch;
+				distanceSetting->beams.push_back(beam);
+			}
+			distanceSetting->cone_angle = Distance_ConeAngle;
+			distanceSetting->cone_samples = FMath::Max(Distance_ConeSamples, 1);
 		}
 
 		break;
@@ -43,6 +53,7 @@ std::unique_ptr<AirSimSettings::SensorSetting> FSensorSetting::CreateAirLibSenso
 			lidarSetting->rotation = msr::airlib::AirSimSettings::Rotation(Rotation.Yaw, Rotation.Pitch, Rotation.Roll);
 
 			lidarSetting->draw_debug_points = DrawDebugPoints;
+			lidarSetting->draw_debug_points_decimation = DrawDebugPointsDecimation;
 
 			lidarSetting->number_of_channels = Lidar_NumberOfChannels;
 			lidarSetting->range = Lidar_Range;
@@ -52,6 +63,17 @@ std::unique_ptr<AirSimSettings::SensorSetting> FSensorSetting::CreateAirLibSenso
 			lidarSetting->horizontal_FOV_end = Lidar_HorizontalFOVEnd;
 			lidarSetting->vertical_FOV_upper = Lidar_VerticalFOVUpper;
 			lidarSetting->vertical_FOV_lower = Lidar_VerticalFOVLower;
+			lidarSetting->point_format = std::string(TCHAR_TO_UTF8(*Lidar_PointFormat));
+			lidarSetting->quantization_resolution = Lidar_QuantizationResolution;
+			lidarSetting->simulation_mode = std::string(TCHAR_TO_UTF8(*Lidar_SimulationMode));
+			lidarSetting->depth_views = Lidar_DepthViews;
+			lidarSetting->depth_resolution = Lidar_DepthResolution;
+			lidarSetting->max_returns = Lidar_MaxReturns;
+			lidarSetting->continuous_sweep = Lidar_ContinuousSweep;
+			lidarSetting->default_reflectivity = Lidar_DefaultReflectivity;
+			lidarSetting->atmospheric_attenuation = Lidar_AtmosphericAttenuation;
+			for (const auto& material : Lidar_MaterialReflectivity)
+				lidarSetting->material_reflectivity[std::string(TCHAR_TO_UTF8(*material.Key))] = material.Value;
 		}
 
 		break;
@@ -55,6 +55,10 @@ struct AIRSIM_API FSensorSetting
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Debug", Meta = (EditCondition = "SensorType == ESensorType::Distance_Sensor || SensorType == ESensorType::Lidar"))
 	bool DrawDebugPoints = false;
 
+	//Draw every Nth point of a lidar scan
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Debug", Meta = (EditCondition = "SensorType == ESensorType::Lidar", ClampMin = "1"))
+	int32 DrawDebugPointsDecimation = 1;
+
 	/* Distance Sensor Settings */
 
 	//The Min Distance that the sensor can sense in meters
@@ -65,6 +69,18 @@ struct AIRSIM_API FSensorSetting
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Distance Sensor", Meta = (EditCondition = "SensorType == ESensorType::Distance_Sensor", DisplayName = "Max Distance"))
 	float Distance_MaxDistance = 40.0f;
 
+	//Beams of a rangefinder array relative to the sensor rotation, only Yaw and Pitch are used. Empty for a single beam.
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Distance Sensor", Meta = (EditCondition = "SensorType == ESensorType::Distance_Sensor", DisplayName = "Beams"))
+	TArray<FRotator> Distance_Beams;
+
+	//Full cone width of each beam in degrees
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Distance Sensor", Meta = (EditCondition = "SensorType == ESensorType::Distance_Sensor", DisplayName = "Cone Angle"))
+	float Distance_ConeAngle = 0.0f;
+
+	//Rays traced per beam, the beam axis and the rest on the cone edge
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Distance Sensor", Meta = (EditCondition = "SensorType == ESensorType::Distance_Sensor", DisplayName = "Cone Samples", ClampMin = "1"))
+	int32 Distance_ConeSamples = 1;
+
 	/* Lidar Sensor Settings */
 
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Lidar Sensor", Meta = (EditCondition = "SensorType == ESensorType::Lidar", DisplayName = "Number Of Channels"))
@@ -89,4 +105,34 @@ struct AIRSIM_API FSensorSetting
 	//Lower FOV in degrees (Default for Drones = -45, Default for Car = -10)
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Lidar Sensor | FOV", Meta = (EditCondition = "SensorType == ESensorType::Lidar", DisplayName = "Vertical FOV Lower"))
 	float Lidar_VerticalFOVLower = -45.0f;
+	//XYZ, Packed or PackedQuantized, see LidarPackedCloud
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Lidar Sensor | Output", Meta = (EditCondition = "SensorType == ESensorType::Lidar", DisplayName = "Point Format"))
+	FString Lidar_PointFormat = TEXT("XYZ");
+	//Meters per unit of PackedQuantized points
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Lidar Sensor | Output", Meta = (EditCondition = "SensorType == ESensorType::Lidar", DisplayName = "Quantization Resolution"))
+	float Lidar_QuantizationResolution = 0.005f;
+	//RayTrace or DepthBuffer
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Lidar Sensor | Simulation", Meta = (EditCondition = "SensorType == ESensorType::Lidar", DisplayName = "Simulation Mode"))
+	FString Lidar_SimulationMode = TEXT("RayTrace");
+	//Number of depth captures around the lidar in DepthBuffer mode
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Lidar Sensor | Simulation", Meta = (EditCondition = "SensorType == ESensorType::Lidar", DisplayName = "Depth Views"))
+	int32 Lidar_DepthViews = 4;
+	//Width in pixels of each depth capture in DepthBuffer mode
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Lidar Sensor | Simulation", Meta = (EditCondition = "SensorType == ESensorType::Lidar", DisplayName = "Depth Resolution"))
+	int32 Lidar_DepthResolution = 1024;
+	//Shoot every azimuth from the pose the lidar had when it was scanned
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Lidar Sensor | Simulation", Meta = (EditCondition = "SensorType == ESensorType::Lidar", DisplayName = "Continuous Sweep"))
+	bool Lidar_ContinuousSweep = false;
+	//Returns per laser, more than 1 also reports overlapping geometry such as foliage
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Lidar Sensor | Returns", Meta = (EditCondition = "SensorType == ESensorType::Lidar", DisplayName = "Max Returns"))
+	int32 Lidar_MaxReturns = 1;
+	//Reflectivity of physical materials not listed in Material Reflectivity
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Lidar Sensor | Returns", Meta = (EditCondition = "SensorType == ESensorType::Lidar", DisplayName = "Default Reflectivity"))
+	float Lidar_DefaultReflectivity = 0.5f;
+	//Intensity falls off as exp(-attenuation * range in meters)
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Lidar Sensor | Returns", Meta = (EditCondition = "SensorType == ESensorType::Lidar", DisplayName = "Atmospheric Attenuation"))
+	float Lidar_AtmosphericAttenuation = 0.001f;
+	//Physical material name to reflectivity
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Lidar Sensor | Returns", Meta = (EditCondition = "SensorType == ESensorType::Lidar", DisplayName = "Material Reflectivity"))
+	TMap<FString, float> Lidar_MaterialReflectivity;
 };
\ No newline at end of file
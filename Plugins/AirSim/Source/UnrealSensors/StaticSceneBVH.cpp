@@ -0,0 +1,456 @@
+#include "StaticSceneBVH.h"
+#include "AirBlueprintLib.h"
+#include "Engine/World.h"
+#include "Engine/StaticMesh.h"
+#include "Components/InstancedStaticMeshComponent.h"
+#include "Materials/MaterialInterface.h"
+#include "PhysicalMaterials/PhysicalMaterial.h"
+#include "UObject/UObjectIterator.h"
+#include <algorithm>
+#include <string>
+
+// a leaf of a few items is cheaper to test than two more boxes
+static constexpr int32 MAX_LEAF_ITEMS = 4;
+// deeper than any median split tree of up to 2^60 items
+static constexpr int32 MAX_TRAVERSAL_DEPTH = 64;
+
+std::mutex StaticSceneBVH::instance_mutex_;
+std::shared_ptr<const StaticSceneBVH> StaticSceneBVH::instance_;
+bool StaticSceneBVH::is_built_ = false;
+std::map<uint32, std::vector<std::shared_ptr<const StaticSceneBVH::Mesh>>> StaticSceneBVH::actor_meshes_;
+std::vector<uint32> StaticSceneBVH::added_actor_ids_;
+std::vector<TWeakObjectPtr<UPrimitiveComponent>> StaticSceneBVH::built_stationary_components_;
+
+StaticSceneBVH::StaticSceneBVH(std::vector<std::shared_ptr<const Mesh>> meshes, std::vector<uint32> runtime_actor_ids,
+    std::vector<TWeakObjectPtr<UPrimitiveComponent>> stationary_components)
+    : runtime_actor_ids_(std::move(runtime_actor_ids)), stationary_components_(std::move(stationary_components))
+{
+    // only the tree over the meshes is built here, the tree of every mesh is shared with the previous one
+    std::vector<FBox> boxes;
+    boxes.reserve(meshes.size());
+    for (const auto& mesh : meshes)
+        boxes.push_back(mesh->bounds);
+
+    std::vector<int32> order;
+    buildNodes(boxes, order, nodes_);
+
+    meshes_.reserve(meshes.size());
+    for (int32 index : order)
+        meshes_.push_back(std::move(meshes[index]));
+}
+
+void StaticSceneBVH::build(UWorld* world)
+{
+    clear();
+
+    int32 uncovered_count = 0;
+    for (TObjectIterator<UPrimitiveComponent> component; component; ++component) {
+        if (component->GetWorld() != world || !component->IsRegistered()
+            || component->Mobility == EComponentMobility::Movable || !blocksSensorTraces(*component))
+            continue;
+
+        UStaticMeshComponent* mesh_component = Cast<UStaticMeshComponent>(*component);
+        AActor* owner = component->GetOwner();
+        if (mesh_component == nullptr || owner == nullptr
+            || !addComponentMeshes(mesh_component, actor_meshes_[owner->GetUniqueID()]))
+            ++uncovered_count;
+        else if (component->Mobility == EComponentMobility::Stationary)
+            built_stationary_components_.push_back(*component);
+    }
+
+    // static colliders without triangles, such as landscapes, would be skipped by the dynamic traces
+    if (uncovered_count > 0) {
+        UAirBlueprintLib::LogMessageString("SensorStaticBVH is off, non-movable colliders that are not static meshes: ",
+            std::to_string(uncovered_count), LogDebugLevel::Failure);
+        actor_meshes_.clear();
+        built_stationary_components_.clear();
+        return;
+    }
+
+    is_built_ = true;
+    publish();
+
+    size_t triangle_count = 0;
+    for (const auto& actor_mesh : actor_meshes_)
+        for (const auto& mesh : actor_mesh.second)
+            triangle_count += mesh->vertices.size() / 3;
+    UAirBlueprintLib::LogMessageString("SensorStaticBVH triangles: ", std::to_string(triangle_count), LogDebugLevel::Informational);
+}
+
+void StaticSceneBVH::clear()
+{
+    is_built_ = false;
+    actor_meshes_.clear();
+    added_actor_ids_.clear();
+    built_stationary_components_.clear();
+
+    std::lock_guard<std::mutex> lock(instance_mutex_);
+    instance_.reset();
+}
+
+std::shared_ptr<const StaticSceneBVH> StaticSceneBVH::get()
+{
+    std::lock_guard<std::mutex> lock(instance_mutex_);
+    return instance_;
+}
+
+void StaticSceneBVH::addActor(AActor* actor)
+{
+    if (!is_built_ || actor == nullptr)
+        return;
+
+    const uint32 actor_id = actor->GetUniqueID();
+    std::vector<std::shared_ptr<const Mesh>>& meshes = actor_meshes_[actor_id];
+    meshes.clear();
+
+    TInlineComponentArray<UStaticMeshComponent*> components(actor);
+    for (UStaticMeshComponent* component : components) {
+        if (blocksSensorTraces(component))
+            addComponentMeshes(component, meshes);
+    }
+
+    if (std::find(added_actor_ids_.begin(), added_actor_ids_.end(), actor_id) == added_actor_ids_.end())
+        added_actor_ids_.push_back(actor_id);
+    publish();
+}
+
+void StaticSceneBVH::removeActor(AActor* actor)
+{
+    if (!is_built_ || actor == nullptr)
+        return;
+
+    const uint32 actor_id = actor->GetUniqueID();
+    if (actor_meshes_.erase(actor_id) == 0)
+        return;
+
+    added_actor_ids_.erase(std::remove(added_actor_ids_.begin(), added_actor_ids_.end(), actor_id), added_actor_ids_.end());
+    publish();
+}
+
+// the triangles are in world space, moving or scaling an actor needs them again
+void StaticSceneBVH::updateActor(AActor* actor)
+{
+    if (!is_built_ || actor == nullptr || actor_meshes_.count(actor->GetUniqueID()) == 0)
+        return;
+
+    addActor(actor);
+}
+
+void StaticSceneBVH::publish()
+{
+    std::vector<std::shared_ptr<const Mesh>> meshes;
+    for (const auto& actor_mesh : actor_meshes_)
+        meshes.insert(meshes.end(), actor_mesh.second.begin(), actor_mesh.second.end());
+
+    std::shared_ptr<const StaticSceneBVH> bvh(new StaticSceneBVH(std::move(meshes), added_actor_ids_, built_stationary_components_));
+
+    std::lock_guard<std::mutex> lock(instance_mutex_);
+    instance_ = std::move(bvh);
+}
+
+bool StaticSceneBVH::blocksSensorTraces(const UPrimitiveComponent* component)
+{
+    // same channel the lidar and distance sensors trace on
+    return component->IsQueryCollisionEnabled()
+        && component->GetCollisionResponseToChannel(ECC_Visibility) == ECR_Block;
+}
+
+bool StaticSceneBVH::addComponentMeshes(UStaticMeshComponent* component, std::vector<std::shared_ptr<const Mesh>>& meshes)
+{
+    // the buffers are read once, every instance of an instanced mesh is a mesh of its own
+    UInstancedStaticMeshComponent* instanced = Cast<UInstancedStaticMeshComponent>(component);
+
+    msr::airlib::MeshPositionVertexBuffersResponse buffers;
+    if (!UAirBlueprintLib::GetStaticMeshComponentBuffers(component,
+        instanced != nullptr ? FTransform::Identity : component->GetComponentTransform(), buffers))
+        return false;
+
+    if (instanced == nullptr) {
+        meshes.push_back(createMesh(component, buffers, FTransform::Identity));
+        return true;
+    }
+
+    for (int32 instance = 0; instance < instanced->GetInstanceCount(); ++instance) {
+        FTransform instance_transform;
+        if (instanced->GetInstanceTransform(instance, instance_transform, true))
+            meshes.push_back(createMesh(component, buffers, instance_transform));
+    }
+    return true;
+}
+
+std::shared_ptr<const StaticSceneBVH::Mesh> StaticSceneBVH::createMesh(UStaticMeshComponent* component,
+    const msr::airlib::MeshPositionVertexBuffersResponse& buffers, const FTransform& transform)
+{
+    auto mesh = std::make_shared<Mesh>();
+    mesh->component = component;
+    mesh->actor = component->GetOwner();
+    UMaterialInterface* material = component->GetMaterial(0);
+    if (material != nullptr)
+        mesh->physical_material = material->GetPhysicalMaterial();
+
+    const size_t triangle_count = buffers.indices.size() / 3;
+    std::vector<FVector> vertices(triangle_count * 3);
+    std::vector<FBox> boxes(triangle_count, FBox(ForceInit));
+    for (size_t triangle = 0; triangle < triangle_count; ++triangle) {
+        for (size_t corner = 0; corner < 3; ++corner) {
+            const size_t vertex = buffers.indices[triangle * 3 + corner] * 3;
+            const FVector position = transform.TransformPosition(FVector(buffers.vertices[vertex],
+                buffers.vertices[vertex + 1], buffers.vertices[vertex + 2]));
+            vertices[triangle * 3 + corner] = position;
+            boxes[triangle] += position;
+        }
+    }
+
+    std::vector<int32> order;
+    buildNodes(boxes, order, mesh->nodes);
+
+    // leaves refer to consecutive triangles
+    mesh->vertices.reserve(vertices.size());
+    for (int32 triangle : order)
+        mesh->vertices.insert(mesh->vertices.end(), &vertices[triangle * 3], &vertices[triangle * 3] + 3);
+
+    mesh->bounds = mesh->nodes.size() > 0 ? FBox(mesh->nodes[0].min, mesh->nodes[0].max) : FBox(ForceInit);
+    return mesh;
+}
+
+void StaticSceneBVH::buildNodes(const std::vector<FBox>& boxes, std::vector<int32>& order, std::vector<Node>& nodes)
+{
+    order.resize(boxes.size());
+    for (int32 index = 0; index < static_cast<int32>(boxes.size()); ++index)
+        order[index] = index;
+
+    nodes.clear();
+    if (boxes.size() == 0)
+        return;
+
+    nodes.reserve(boxes.size() * 2);
+    nodes.emplace_back();
+    buildNode(boxes, order, nodes, 0, 0, static_cast<int32>(boxes.size()));
+}
+
+// splits at the median of the box centers along the axis they spread the most on
+void StaticSceneBVH::buildNode(const std::vector<FBox>& boxes, std::vector<int32>& order, std::vector<Node>& nodes,
+    int32 node_index, int32 first, int32 count)
+{
+    FBox bounds(ForceInit), centers(ForceInit);
+    for (int32 index = first; index < first + count; ++index) {
+        bounds += boxes[order[index]];
+        centers += boxes[order[index]].GetCenter();
+    }
+    nodes[node_index].min = bounds.Min;
+    nodes[node_index].max = bounds.Max;
+
+    if (count <= MAX_LEAF_ITEMS) {
+        nodes[node_index].first = first;
+        nodes[node_index].count = count;
+        return;
+    }
+
+    const FVector spread = centers.GetSize();
+    const int32 axis = spread.X >= spread.Y && spread.X >= spread.Z ? 0 : (spread.Y >= spread.Z ? 1 : 2);
+    const int32 half = count / 2;
+    std::nth_element(order.begin() + first, order.begin() + first + half, order.begin() + first + count,
+        [&boxes, axis](int32 a, int32 b) { return boxes[a].GetCenter()[axis] < boxes[b].GetCenter()[axis]; });
+
+    const int32 children = static_cast<int32>(nodes.size());
+    nodes.emplace_back();
+    nodes.emplace_back();
+    nodes[node_index].first = children;
+    nodes[node_index].count = 0;
+
+    buildNode(boxes, order, nodes, children, first, half);
+    buildNode(boxes, order, nodes, children + 1, first + half, count - half);
+}
+
+void StaticSceneBVH::setDynamicQueryParams(FCollisionQueryParams& params) const
+{
+    params.MobilityType = EQueryMobilityType::Dynamic;
+    for (uint32 actor_id : runtime_actor_ids_)
+        params.AddIgnoredActor(actor_id);
+    for (const TWeakObjectPtr<UPrimitiveComponent>& component : stationary_components_)
+        if (component.IsValid())
+            params.AddIgnoredComponent(component.Get());
+}
+
+bool StaticSceneBVH::lineTrace(UWorld* world, const FVector& start, const FVector& end,
+    ECollisionChannel channel, const FCollisionQueryParams& dynamic_params, FHitResult& hit) const
+{
+    bool is_hit;
+    tracePacket(world, &start, &end, 1, channel, dynamic_params, &hit, &is_hit);
+    return is_hit;
+}
+
+void StaticSceneBVH::tracePacket(UWorld* world, const FVector* starts, const FVector* ends, int32 count,
+    ECollisionChannel channel, const FCollisionQueryParams& dynamic_params, FHitResult* hits, bool* is_hit) const
+{
+    traceStaticPacket(starts, ends, count, hits, is_hit);
+
+    for (int32 ray = 0; ray < count; ++ray) {
+        // anything dynamic only matters if it is closer than the static hit
+        FHitResult dynamic_hit(ForceInit);
+        if (world->LineTraceSingleByChannel(dynamic_hit, starts[ray], is_hit[ray] ? hits[ray].ImpactPoint : ends[ray],
+            channel, dynamic_params)) {
+            hits[ray] = dynamic_hit;
+            is_hit[ray] = true;
+        }
+    }
+}
+
+void StaticSceneBVH::traceStaticPacket(const FVector* starts, const FVector* ends, int32 count, FHitResult* hits, bool* is_hit) const
+{
+    check(count <= kPacketSize);
+
+    RayPacket packet;
+    int32 lanes = 0;
+    for (int32 lane = 0; lane < kPacketSize; ++lane) {
+        FVector direction(1, 0, 0);
+        float length = -1; // unused lanes never pass a box test
+        if (lane < count) {
+            FVector segment = ends[lane] - starts[lane];
+            length = segment.Size();
+            if (length > 0)
+                direction = segment / length;
+            lanes |= 1 << lane;
+        }
+
+        for (int32 axis = 0; axis < 3; ++axis) {
+            packet.origin[axis][lane] = lane < count ? starts[lane][axis] : 0;
+            packet.direction[axis][lane] = direction[axis];
+            packet.inv_direction[axis][lane] = FMath::Abs(direction[axis]) > SMALL_NUMBER ? 1.0f / direction[axis] : BIG_NUMBER;
+        }
+        packet.t_max[lane] = length;
+        packet.mesh[lane] = -1;
+        packet.triangle[lane] = -1;
+    }
+
+    if (nodes_.size() > 0) {
+        int32 stack[MAX_TRAVERSAL_DEPTH];
+        int32 stack_size = 0;
+        stack[stack_size++] = 0;
+        while (stack_size > 0) {
+            const Node& node = nodes_[stack[--stack_size]];
+            const int32 active = intersectBox(packet, node, lanes);
+            if (active == 0)
+                continue;
+
+            if (node.count > 0) {
+                for (int32 mesh = node.first; mesh < node.first + node.count; ++mesh)
+                    intersectMesh(packet, mesh, active);
+            }
+            else {
+                stack[stack_size++] = node.first + 1;
+                stack[stack_size++] = node.first;
+            }
+        }
+    }
+
+    for (int32 lane = 0; lane < count; ++lane) {
+        is_hit[lane] = packet.mesh[lane] >= 0;
+        if (is_hit[lane])
+            setHit(packet, lane, starts[lane], ends[lane], hits[lane]);
+    }
+}
+
+void StaticSceneBVH::intersectMesh(RayPacket& packet, int32 mesh_index, int32 lanes) const
+{
+    const Mesh& mesh = *meshes_[mesh_index];
+    if (mesh.nodes.size() == 0)
+        return;
+
+    int32 stack[MAX_TRAVERSAL_DEPTH];
+    int32 stack_size = 0;
+    stack[stack_size++] = 0;
+    while (stack_size > 0) {
+        const Node& node = mesh.nodes[stack[--stack_size]];
+        const int32 active = intersectBox(packet, node, lanes);
+        if (active == 0)
+            continue;
+
+        if (node.count == 0) {
+            stack[stack_size++] = node.first + 1;
+            stack[stack_size++] = node.first;
+            continue;
+        }
+
+        for (int32 triangle = node.first; triangle < node.first + node.count; ++triangle) {
+            for (int32 lane = 0; lane < kPacketSize; ++lane) {
+                float t;
+                if ((active & (1 << lane)) != 0 && intersectTriangle(packet, lane, &mesh.vertices[triangle * 3], t)
+                    && t < packet.t_max[lane]) {
+                    packet.t_max[lane] = t;
+                    packet.mesh[lane] = mesh_index;
+                    packet.triangle[lane] = triangle;
+                }
+            }
+        }
+    }
+}
+
+// slab test of all the rays at once, returns the lanes that enter the box before their closest hit
+int32 StaticSceneBVH::intersectBox(const RayPacket& packet, const Node& node, int32 lanes)
+{
+    VectorRegister t_near = VectorZero();
+    VectorRegister t_far = VectorLoadAligned(packet.t_max);
+    for (int32 axis = 0; axis < 3; ++axis) {
+        const VectorRegister origin = VectorLoadAligned(packet.origin[axis]);
+        const VectorRegister inv_direction = VectorLoadAligned(packet.inv_direction[axis]);
+        const VectorRegister t0 = VectorMultiply(VectorSubtract(VectorSetFloat1(node.min[axis]), origin), inv_direction);
+        const VectorRegister t1 = VectorMultiply(VectorSubtract(VectorSetFloat1(node.max[axis]), origin), inv_direction);
+        t_near = VectorMax(t_near, VectorMin(t0, t1));
+        t_far = VectorMin(t_far, VectorMax(t0, t1));
+    }
+    return VectorMaskBits(VectorCompareGE(t_far, t_near)) & lanes;
+}
+
+// Moller-Trumbore, both sides of the triangle are hit
+bool StaticSceneBVH::intersectTriangle(const RayPacket& packet, int32 lane, const FVector* triangle, float& t)
+{
+    const FVector origin(packet.origin[0][lane], packet.origin[1][lane], packet.origin[2][lane]);
+    const FVector direction(packet.direction[0][lane], packet.direction[1][lane], packet.direction[2][lane]);
+
+    const FVector edge1 = triangle[1] - triangle[0];
+    const FVector edge2 = triangle[2] - triangle[0];
+    const FVector p = FVector::CrossProduct(direction, edge2);
+    const float determinant = FVector::DotProduct(edge1, p);
+    if (FMath::Abs(determinant) < SMALL_NUMBER)
+        return false;
+
+    const float inv_determinant = 1.0f / determinant;
+    const FVector s = origin - triangle[0];
+    const float u = FVector::DotProduct(s, p) * inv_determinant;
+    if (u < 0 || u > 1)
+        return false;
+
+    const FVector q = FVector::CrossProduct(s, edge1);
+    const float v = FVector::DotProduct(direction, q) * inv_determinant;
+    if (v < 0 || u + v > 1)
+        return false;
+
+    t = FVector::DotProduct(edge2, q) * inv_determinant;
+    return t >= 0;
+}
+
+// fills the fields of the hit the sensors use, as a PhysX trace would
+void StaticSceneBVH::setHit(const RayPacket& packet, int32 lane, const FVector& start, const FVector& end, FHitResult& hit) const
+{
+    const Mesh& mesh = *meshes_[packet.mesh[lane]];
+    const FVector* triangle = &mesh.vertices[packet.triangle[lane] * 3];
+    const FVector direction(packet.direction[0][lane], packet.direction[1][lane], packet.direction[2][lane]);
+
+    // facing the ray, hits are on either side
+    FVector normal = FVector::CrossProduct(triangle[1] - triangle[0], triangle[2] - triangle[0]).GetSafeNormal();
+    if (FVector::DotProduct(normal, direction) > 0)
+        normal = -normal;
+
+    hit = FHitResult(ForceInit);
+    hit.bBlockingHit = true;
+    hit.Distance = packet.t_max[lane];
+    hit.Time = hit.Distance / FMath::Max((end - start).Size(), SMALL_NUMBER);
+    hit.Location = hit.ImpactPoint = start + direction * hit.Distance;
+    hit.Normal = hit.ImpactNormal = normal;
+    hit.TraceStart = start;
+    hit.TraceEnd = end;
+    hit.Component = mesh.component;
+    hit.Actor = mesh.actor;
+    hit.PhysMaterial = mesh.physical_material;
+}
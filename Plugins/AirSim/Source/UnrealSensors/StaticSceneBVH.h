@@ -0,0 +1,116 @@
+#pragma once
+
+#include "CoreMinimal.h"
+#include "GameFramework/Actor.h"
+#include "Components/StaticMeshComponent.h"
+#include "CollisionQueryParams.h"
+#include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
+#include "common/CommonStructs.hpp"
+
+class UPhysicalMaterial;
+
+// Bounding volume hierarchy over the static and stationary meshes of the level, used by the
+// lidar and distance sensors when the SensorStaticBVH setting is on.
+// Static geometry is traced in packets of rays on this tree, four rays tested
+// against every node at once with vector instructions, and PhysX is only asked
+// about what is not in the tree. Every mesh has its own tree under a tree of meshes,
+// so objects spawned, moved or destroyed through WorldSimApi only rebuild the
+// top level. Sensors hold the tree returned by get() for one update; updates
+// publish a new tree instead of changing the one in use.
+// Triangles come from the render mesh (LOD 0), so hits follow the visible
+// geometry rather than the simple collision PhysX traces by default.
+class StaticSceneBVH {
+public:
+    // rays traced together by tracePacket
+    static constexpr int32 kPacketSize = 4;
+
+public:
+    // game thread only; the tree stays off when static or stationary colliders other
+    // than static meshes block sensor traces, since they could not be seen
+    static void build(UWorld* world);
+    static void clear();
+    // null when the tree is not built
+    static std::shared_ptr<const StaticSceneBVH> get();
+
+    // game thread only: objects changed at runtime, a no-op when the tree is not built
+    static void addActor(AActor* actor);
+    static void removeActor(AActor* actor);
+    static void updateActor(AActor* actor);
+
+    // restricts a query to what the tree does not contain
+    void setDynamicQueryParams(FCollisionQueryParams& params) const;
+
+    // closest hit of up to kPacketSize segments on the tree and, with dynamic_params, on the rest of the scene
+    void tracePacket(UWorld* world, const FVector* starts, const FVector* ends, int32 count,
+        ECollisionChannel channel, const FCollisionQueryParams& dynamic_params, FHitResult* hits, bool* is_hit) const;
+    bool lineTrace(UWorld* world, const FVector& start, const FVector& end,
+        ECollisionChannel channel, const FCollisionQueryParams& dynamic_params, FHitResult& hit) const;
+
+private:
+    // children of inner nodes are at first and first + 1, leaves hold count items from first
+    struct Node {
+        FVector min;
+        int32 first;
+        FVector max;
+        int32 count;
+    };
+
+    // world space triangles of one mesh, three vertices each in the order of its leaves
+    struct Mesh {
+        TWeakObjectPtr<UPrimitiveComponent> component;
+        TWeakObjectPtr<AActor> actor;
+        TWeakObjectPtr<UPhysicalMaterial> physical_material;
+        std::vector<FVector> vertices;
+        std::vector<Node> nodes;
+        FBox bounds;
+    };
+
+    // rays in structure of arrays layout so one vector register holds a coordinate of every ray
+    struct alignas(16) RayPacket {
+        float origin[3][kPacketSize];
+        float direction[3][kPacketSize];
+        float inv_direction[3][kPacketSize];
+        // closest hit so far, in Unreal units along the direction
+        float t_max[kPacketSize];
+        int32 mesh[kPacketSize];
+        int32 triangle[kPacketSize];
+    };
+
+    StaticSceneBVH(std::vector<std::shared_ptr<const Mesh>> meshes, std::vector<uint32> runtime_actor_ids,
+        std::vector<TWeakObjectPtr<UPrimitiveComponent>> stationary_components);
+
+    void traceStaticPacket(const FVector* starts, const FVector* ends, int32 count, FHitResult* hits, bool* is_hit) const;
+    void intersectMesh(RayPacket& packet, int32 mesh_index, int32 lanes) const;
+    void setHit(const RayPacket& packet, int32 lane, const FVector& start, const FVector& end, FHitResult& hit) const;
+    static int32 intersectBox(const RayPacket& packet, const Node& node, int32 lanes);
+    static bool intersectTriangle(const RayPacket& packet, int32 lane, const FVector* triangle, float& t);
+
+    static void buildNodes(const std::vector<FBox>& boxes, std::vector<int32>& order, std::vector<Node>& nodes);
+    static void buildNode(const std::vector<FBox>& boxes, std::vector<int32>& order, std::vector<Node>& nodes,
+        int32 node_index, int32 first, int32 count);
+    static bool blocksSensorTraces(const UPrimitiveComponent* component);
+    static bool addComponentMeshes(UStaticMeshComponent* component, std::vector<std::shared_ptr<const Mesh>>& meshes);
+    static std::shared_ptr<const Mesh> createMesh(UStaticMeshComponent* component,
+        const msr::airlib::MeshPositionVertexBuffersResponse& buffers, const FTransform& transform);
+    static void publish();
+
+private:
+    std::vector<std::shared_ptr<const Mesh>> meshes_;
+    std::vector<Node> nodes_;
+    // actors added at runtime are not static, dynamic traces must skip them
+    std::vector<uint32> runtime_actor_ids_;
+    // PhysX may count stationary components as dynamic, dynamic traces must skip them too
+    std::vector<TWeakObjectPtr<UPrimitiveComponent>> stationary_components_;
+
+    static std::mutex instance_mutex_;
+    static std::shared_ptr<const StaticSceneBVH> instance_;
+
+    // game thread state the published trees are made from
+    static bool is_built_;
+    static std::map<uint32, std::vector<std::shared_ptr<const Mesh>>> actor_meshes_;
+    static std::vector<uint32> added_actor_ids_;
+    static std::vector<TWeakObjectPtr<UPrimitiveComponent>> built_stationary_components_;
+};
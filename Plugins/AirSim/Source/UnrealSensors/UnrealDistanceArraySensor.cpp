@@ -0,0 +1,116 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include "UnrealDistanceArraySensor.h"
+#include "AirBlueprintLib.h"
+#include "common/Common.hpp"
+#include "NedTransform.h"
+#include "UnrealSensors/StaticSceneBVH.h"
+#include <algorithm>
+#include <cmath>
+
+std::unordered_set<const msr::airlib::SensorBase*> UnrealDistanceArraySensor::arrays_;
+std::mutex UnrealDistanceArraySensor::arrays_mutex_;
+
+UnrealDistanceArraySensor::UnrealDistanceArraySensor(const AirSimSettings::DistanceSetting& setting,
+    AActor* actor, const NedTransform* ned_transform)
+    : DistanceSimple(setting), actor_(actor), ned_transform_(ned_transform)
+{
+    createRays(setting);
+
+    std::lock_guard<std::mutex> lock(arrays_mutex_);
+    arrays_.insert(this);
+}
+
+UnrealDistanceArraySensor::~UnrealDistanceArraySensor()
+{
+    std::lock_guard<std::mutex> lock(arrays_mutex_);
+    arrays_.erase(this);
+}
+
+const UnrealDistanceArraySensor* UnrealDistanceArraySensor::fromSensor(const msr::airlib::SensorBase* sensor)
+{
+    std::lock_guard<std::mutex> lock(arrays_mutex_);
+    return arrays_.count(sensor) > 0 ? static_cast<const UnrealDistanceArraySensor*>(sensor) : nullptr;
+}
+
+// the beam directions never change, compute them once
+void UnrealDistanceArraySensor::createRays(const AirSimSettings::DistanceSetting& setting)
+{
+    cone_samples_ = std::max(setting.cone_samples, 1u);
+    const float cone_half_angle = msr::airlib::Utils::degreesToRadians(setting.cone_angle / 2);
+
+    ray_directions_.clear();
+    for (const auto& beam : setting.beams) {
+        const msr::airlib::Quaternionr beam_q = VectorMath::toQuaternion(
+            msr::airlib::Utils::degreesToRadians(beam.pitch), 0, msr::airlib::Utils::degreesToRadians(beam.yaw));
+
+        // the beam axis first, then the rest of the samples evenly on the edge of the cone
+        for (msr::airlib::uint sample = 0; sample < cone_samples_; ++sample) {
+            Vector3r direction = VectorMath::front();
+            if (sample > 0) {
+                const float around = 2 * M_PIf * (sample - 1) / (cone_samples_ - 1);
+                direction = Vector3r(std::cos(cone_half_angle), std::sin(cone_half_angle) * std::cos(around),
+                    std::sin(cone_half_angle) * std::sin(around));
+            }
+            ray_directions_.push_back(VectorMath::rotateVector(direction, beam_q, true));
+        }
+    }
+
+    beam_distances_.assign(setting.beams.size(), getParams().max_distance);
+}
+
+std::vector<msr::airlib::real_T> UnrealDistanceArraySensor::getBeamDistances() const
+{
+    std::lock_guard<std::mutex> lock(beam_distances_mutex_);
+    return beam_distances_;
+}
+
+msr::airlib::real_T UnrealDistanceArraySensor::getRayLength(const msr::airlib::Pose& pose)
+{
+    const msr::airlib::real_T max_distance = getParams().max_distance;
+    const FVector start = ned_transform_->fromLocalNed(pose.position);
+    const auto rotation = pose.orientation.toRotationMatrix();
+
+    // shared by all the traces of the array
+    FCollisionQueryParams trace_params(SCENE_QUERY_STAT(UnrealDistanceArraySensor), false, actor_);
+
+    // with SensorStaticBVH the rays go through the tree in packets, PhysX only traces what is not static
+    const std::shared_ptr<const StaticSceneBVH> static_bvh = StaticSceneBVH::get();
+    if (static_bvh != nullptr)
+        static_bvh->setDynamicQueryParams(trace_params);
+    const size_t packet_size = static_bvh != nullptr ? StaticSceneBVH::kPacketSize : 1;
+
+    std::vector<msr::airlib::real_T> beam_distances(beam_distances_.size(), max_distance);
+    for (size_t first = 0; first < ray_directions_.size(); first += packet_size) {
+        const int32 count = static_cast<int32>(std::min(packet_size, ray_directions_.size() - first));
+
+        FVector starts[StaticSceneBVH::kPacketSize], ends[StaticSceneBVH::kPacketSize];
+        FHitResult hits[StaticSceneBVH::kPacketSize];
+        bool is_hit[StaticSceneBVH::kPacketSize];
+        for (int32 lane = 0; lane < count; ++lane) {
+            starts[lane] = start;
+            ends[lane] = ned_transform_->fromLocalNed(pose.position + rotation * ray_directions_[first + lane] * max_distance);
+        }
+
+        if (static_bvh != nullptr)
+            static_bvh->tracePacket(actor_->GetWorld(), starts, ends, count, ECC_Visibility, trace_params, hits, is_hit);
+        else
+            is_hit[0] = actor_->GetWorld()->LineTraceSingleByChannel(hits[0], starts[0], ends[0], ECC_Visibility, trace_params);
+
+        for (int32 lane = 0; lane < count; ++lane) {
+            if (is_hit[lane]) {
+                // a beam measures the closest of its cone samples
+                msr::airlib::real_T& beam_distance = beam_distances[(first + lane) / cone_samples_];
+                beam_distance = std::min(beam_distance, ned_transform_->toNed(hits[lane].Distance));
+            }
+        }
+    }
+
+    const msr::airlib::real_T distance = beam_distances.size() > 0
+        ? *std::min_element(beam_distances.begin(), beam_distances.end()) : max_distance;
+
+    std::lock_guard<std::mutex> lock(beam_distances_mutex_);
+    beam_distances_ = std::move(beam_distances);
+    return distance;
+}
@@ -0,0 +1,58 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#pragma once
+
+#include "common/Common.hpp"
+#include "GameFramework/Actor.h"
+#include "CollisionQueryParams.h"
+#include "sensors/distance/DistanceSimple.hpp"
+#include "NedTransform.h"
+#include <mutex>
+#include <vector>
+#include <unordered_set>
+
+// Rangefinder array, for distance settings that list Beams.
+// All beams of the array, and the samples of their cones, are traced together in
+// one update with shared query params. The distance reported through
+// DistanceSensorData is the closest of all beams, and the distance of every beam
+// is available from getBeamDistances().
+class UnrealDistanceArraySensor : public msr::airlib::DistanceSimple {
+public:
+    typedef msr::airlib::AirSimSettings AirSimSettings;
+
+public:
+    UnrealDistanceArraySensor(const AirSimSettings::DistanceSetting& setting,
+        AActor* actor, const NedTransform* ned_transform);
+    virtual ~UnrealDistanceArraySensor();
+
+    // the array if sensor is one, null for any other distance sensor; arrays register
+    // themselves while they exist since there is no RTTI to ask the sensor
+    static const UnrealDistanceArraySensor* fromSensor(const msr::airlib::SensorBase* sensor);
+
+    // distance in meters along every beam, in the order of the Beams setting
+    std::vector<msr::airlib::real_T> getBeamDistances() const;
+
+protected:
+    virtual msr::airlib::real_T getRayLength(const msr::airlib::Pose& pose) override;
+
+private:
+    using Vector3r = msr::airlib::Vector3r;
+    using VectorMath = msr::airlib::VectorMath;
+
+    void createRays(const AirSimSettings::DistanceSetting& setting);
+
+private:
+    AActor* actor_;
+    const NedTransform* ned_transform_;
+
+    // unit directions in the sensor frame, cone_samples_ per beam
+    std::vector<Vector3r> ray_directions_;
+    msr::airlib::uint cone_samples_ = 1;
+
+    std::vector<msr::airlib::real_T> beam_distances_;
+    mutable std::mutex beam_distances_mutex_;
+
+    static std::unordered_set<const msr::airlib::SensorBase*> arrays_;
+    static std::mutex arrays_mutex_;
+};
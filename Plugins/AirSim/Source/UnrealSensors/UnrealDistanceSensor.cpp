@@ -5,6 +5,7 @@
 #include "AirBlueprintLib.h"
 #include "common/Common.hpp"
 #include "NedTransform.h"
+#include "UnrealSensors/StaticSceneBVH.h"
 
 UnrealDistanceSensor::UnrealDistanceSensor(const AirSimSettings::DistanceSetting& setting,
     AActor* actor, const NedTransform* ned_transform)
@@ -19,7 +20,17 @@ msr::airlib::real_T UnrealDistanceSensor::getRayLength(const msr::airlib::Pose&
     Vector3r end = start + VectorMath::rotateVector(VectorMath::front(), pose.orientation, true) * getParams().max_distance;
 
     FHitResult dist_hit = FHitResult(ForceInit);
-    bool is_hit = UAirBlueprintLib::GetObstacle(actor_, ned_transform_->fromLocalNed(start), ned_transform_->fromLocalNed(end), dist_hit);
+    bool is_hit;
+    const std::shared_ptr<const StaticSceneBVH> static_bvh = StaticSceneBVH::get();
+    if (static_bvh != nullptr) {
+        // static geometry from the SensorStaticBVH tree, PhysX only for the rest
+        FCollisionQueryParams dynamic_params(SCENE_QUERY_STAT(UnrealDistanceSensor), false, actor_);
+        static_bvh->setDynamicQueryParams(dynamic_params);
+        is_hit = static_bvh->lineTrace(actor_->GetWorld(), ned_transform_->fromLocalNed(start), ned_transform_->fromLocalNed(end),
+            ECC_Visibility, dynamic_params, dist_hit);
+    }
+    else
+        is_hit = UAirBlueprintLib::GetObstacle(actor_, ned_transform_->fromLocalNed(start), ned_transform_->fromLocalNed(end), dist_hit);
     float distance = is_hit? dist_hit.Distance / 100.0f : getParams().max_distance;
 
     //FString hit_name = FString("None");
@@ -6,13 +6,61 @@
 #include "common/Common.hpp"
 #include "NedTransform.h"
 #include "DrawDebugHelpers.h"
+#include "Async/ParallelFor.h"
+#include "Misc/ScopeRWLock.h"
+#include "Components/PrimitiveComponent.h"
+#include "common/ClockFactory.hpp"
+#include "PhysicalMaterials/PhysicalMaterial.h"
+#include "UnrealSensors/StaticSceneBVH.h"
+#include <cmath>
+
+// below this many rays the traces are cheaper to do on the calling thread
+static constexpr int32 MIN_RAYS_FOR_PARALLEL_TRACE = 256;
+// actors that went away stay in the stencil ID cache until it is cleared, bound its size
+static constexpr int32 MAX_CACHED_ACTOR_STENCIL_IDS = 4096;
+// time offsets of quantized points are stored as a fraction of the scan time
+static constexpr float MAX_QUANTIZED_TIME_OFFSET = 65535.0f;
+// returns kept per ray in multi-return mode
+static constexpr int MAX_LIDAR_RETURNS = 8;
+
+// rounds and clamps to the range of the quantized type
+template<typename T>
+static T quantize(float value)
+{
+    const float rounded = FMath::RoundHalfFromZero(value);
+    return static_cast<T>(FMath::Clamp(rounded, static_cast<float>(TNumericLimits<T>::Min()), static_cast<float>(TNumericLimits<T>::Max())));
+}
 
 // ctor
 UnrealLidarSensor::UnrealLidarSensor(const AirSimSettings::LidarSetting& setting,
     AActor* actor, const NedTransform* ned_transform)
     : LidarSimple(setting), actor_(actor), ned_transform_(ned_transform)
 {
+    packed_output_ = setting.point_format == AirSimSettings::kLidarPointFormatPacked
+        || setting.point_format == AirSimSettings::kLidarPointFormatPackedQuantized;
+    quantized_output_ = setting.point_format == AirSimSettings::kLidarPointFormatPackedQuantized;
+    quantization_resolution_ = setting.quantization_resolution;
+    if (quantization_resolution_ <= 0)
+        quantization_resolution_ = AirSimSettings::LidarSetting().quantization_resolution;
+
+    // intensities only go to the packed cloud, LidarData has no room for them
+    compute_intensity_ = packed_output_;
+    max_returns_ = static_cast<uint8>(FMath::Clamp(setting.max_returns, 1, MAX_LIDAR_RETURNS));
+    default_reflectivity_ = setting.default_reflectivity;
+    atmospheric_attenuation_ = setting.atmospheric_attenuation;
+    material_reflectivity_ = setting.material_reflectivity;
+    continuous_sweep_ = setting.continuous_sweep;
+    draw_debug_points_decimation_ = FMath::Max(setting.draw_debug_points_decimation, 1);
+    draw_debug_points_ = setting.draw_debug_points;
+
     createLasers();
+
+    if (setting.simulation_mode == AirSimSettings::kLidarSimulationModeDepthBuffer)
+    {
+        const msr::airlib::LidarSimpleParams& params = getParams();
+        depth_capture_.reset(new LidarDepthCapture(actor_, ned_transform_, params.relative_pose,
+            setting.depth_views, setting.depth_resolution, params.vertical_FOV_upper, params.vertical_FOV_lower));
+    }
 }
 
 // initializes information based on lidar configuration
@@ -31,12 +79,18 @@ void UnrealLidarSensor::createLasers()
         delta_angle = (params.vertical_FOV_upper - (params.vertical_FOV_lower)) /
             static_cast<float>(number_of_lasers - 1);
 
-    // store vertical angles for each laser
+    // store vertical angles for each laser, the ray directions only need their cos/sin
     laser_angles_.clear();
+    laser_cos_.clear();
+    laser_sin_.clear();
     for (auto i = 0u; i < number_of_lasers; ++i)
     {
         const float vertical_angle = params.vertical_FOV_upper - static_cast<float>(i) * delta_angle;
         laser_angles_.emplace_back(vertical_angle);
+
+        const float vertical_radians = msr::airlib::Utils::degreesToRadians(vertical_angle);
+        laser_cos_.emplace_back(std::cos(vertical_radians));
+        laser_sin_.emplace_back(std::sin(vertical_radians));
     }
 }
 
@@ -52,7 +106,7 @@ void UnrealLidarSensor::getPointCloud(const msr::airlib::Pose& lidar_pose, const
 
     // cap the points to scan via ray-tracing; this is currently needed for car/Unreal tick scenarios
     // since SensorBase mechanism uses the elapsed clock time instead of the tick delta-time.
-    constexpr float MAX_POINTS_IN_SCAN = 1e+5f;
+    constexpr float MAX_POINTS_IN_SCAN = 5e+5f;
     uint32 total_points_to_scan = FMath::RoundHalfFromZero(params.points_per_second * delta_time);
     if (total_points_to_scan > MAX_POINTS_IN_SCAN)
     {
@@ -76,126 +130,455 @@ void UnrealLidarSensor::getPointCloud(const msr::airlib::Pose& lidar_pose, const
     const float laser_start = std::fmod(360.0f + params.horizontal_FOV_start, 360.0f);
     const float laser_end = std::fmod(360.0f + params.horizontal_FOV_end, 360.0f);
 
-    // shoot lasers
+    // stencil IDs were changed since the last scan, drop the cached ones
+    const uint32 stencil_id_generation = UAirBlueprintLib::GetStencilIDGeneration();
+    if (stencil_id_generation != stencil_id_generation_)
+    {
+        FRWScopeLock lock(actor_stencil_ids_lock_, SLT_Write);
+        actor_stencil_ids_.Reset();
+        stencil_id_generation_ = stencil_id_generation;
+    }
+
+    // azimuths of this scan, shared by all the lasers so their cos/sin are only computed once
+    columns_.clear();
+    for (auto i = 0u; i < points_to_scan_with_one_laser; ++i)
+    {
+        const float horizontal_angle = std::fmod(current_horizontal_angle_ + angle_distance_of_laser_measure * i, 360.0f);
+
+        // check if the laser is outside the requested horizontal FOV
+        if (!VectorMath::isAngleBetweenAngles(horizontal_angle, laser_start, laser_end))
+            continue;
+
+        const float horizontal_radians = msr::airlib::Utils::degreesToRadians(horizontal_angle);
+        const float time_offset = static_cast<float>(delta_time * i / points_to_scan_with_one_laser);
+        columns_.push_back(ScanColumn{ std::cos(horizontal_radians), std::sin(horizontal_radians), time_offset });
+    }
+
+    // build all the rays of this scan first so they can be traced as one batch
+    shots_.clear();
     for (auto laser = 0u; laser < number_of_lasers; ++laser)
     {
-        const float vertical_angle = laser_angles_[laser];
+        for (auto column = 0u; column < columns_.size(); ++column)
+        {
+            LaserShot shot;
+            shot.laser = laser;
+            shot.column = column;
+            shot.return_count = 0;
+            shots_.push_back(shot);
+        }
+    }
+    returns_.resize(shots_.size() * max_returns_);
+
+    // one rotation and translation takes the rays from the lidar frame to the world;
+    // this is the same as composing the ray, lidar and vehicle quaternions for every ray
+    const msr::airlib::Pose sensor_pose = VectorMath::add(lidar_pose, vehicle_pose);
+    const Matrix3r rotation = sensor_pose.orientation.toRotationMatrix();
+    const Vector3r& start = sensor_pose.position;
+
+    // the pose is the one at the end of the scan; in a continuous sweep every column
+    // is shot from the pose the lidar had when it was scanned instead
+    const msr::airlib::Kinematics::State* kinematics = getGroundTruth().kinematics;
+    for (ScanColumn& column : columns_)
+    {
+        if (continuous_sweep_ && kinematics != nullptr)
+        {
+            const msr::airlib::Pose column_sensor_pose = VectorMath::add(lidar_pose,
+                getVehiclePoseAt(vehicle_pose, *kinematics, column.time_offset - static_cast<float>(delta_time)));
+            column.rotation = column_sensor_pose.orientation.toRotationMatrix();
+            column.start = column_sensor_pose.position;
+        }
+        else
+        {
+            column.rotation = rotation;
+            column.start = start;
+        }
+        column.start_ue = ned_transform_->fromLocalNed(column.start);
+    }
+
+    // in DepthBuffer mode rays are looked up in the depth images instead of traced
+    std::shared_ptr<const LidarDepthCapture::DepthImages> depth_images;
+    if (depth_capture_ != nullptr)
+        depth_images = depth_capture_->getLatestImages();
+
+    // the query params are shared by all the traces, building them per ray showed up in profiles
+    FCollisionQueryParams trace_params(SCENE_QUERY_STAT(UnrealLidarSensor), false, actor_);
+    trace_params.bReturnPhysicalMaterial = compute_intensity_;
+
+    // pitch by the laser angle then yaw by the azimuth, applied to the front vector
+    const auto get_direction = [this](const LaserShot& shot, const ScanColumn& column) {
+        return Vector3r(laser_cos_[shot.laser] * column.cos_h, laser_cos_[shot.laser] * column.sin_h, -laser_sin_[shot.laser]);
+    };
+
+    const int32 shot_count = static_cast<int32>(shots_.size());
+
+    // with SensorStaticBVH the static part of the scene is traced in packets of rays on the
+    // tree and PhysX only traces the rest; the tree keeps only the closest return of a ray
+    const std::shared_ptr<const StaticSceneBVH> static_bvh = depth_capture_ == nullptr && max_returns_ == 1
+        ? StaticSceneBVH::get() : nullptr;
+    if (static_bvh != nullptr)
+    {
+        FCollisionQueryParams dynamic_params = trace_params;
+        static_bvh->setDynamicQueryParams(dynamic_params);
+
+        // consecutive shots are neighbouring rays of one laser, close enough to share the tree nodes they visit
+        const int32 packet_count = (shot_count + StaticSceneBVH::kPacketSize - 1) / StaticSceneBVH::kPacketSize;
+        ParallelFor(packet_count, [&](int32 packet) {
+            const int32 first = packet * StaticSceneBVH::kPacketSize;
+            const int32 count = FMath::Min(StaticSceneBVH::kPacketSize, shot_count - first);
+
+            FVector starts[StaticSceneBVH::kPacketSize], ends[StaticSceneBVH::kPacketSize];
+            for (int32 lane = 0; lane < count; ++lane)
+            {
+                const LaserShot& shot = shots_[first + lane];
+                const ScanColumn& column = columns_[shot.column];
+                starts[lane] = column.start_ue;
+                ends[lane] = ned_transform_->fromLocalNed(column.start + column.rotation * get_direction(shot, column) * params.range);
+            }
 
-        for (auto i = 0u; i < points_to_scan_with_one_laser; ++i)
+            FHitResult hits[StaticSceneBVH::kPacketSize];
+            bool is_hit[StaticSceneBVH::kPacketSize];
+            static_bvh->tracePacket(actor_->GetWorld(), starts, ends, count, ECC_Visibility, dynamic_params, hits, is_hit);
+
+            for (int32 lane = 0; lane < count; ++lane)
+            {
+                shots_[first + lane].return_count = is_hit[lane] ? 1 : 0;
+                if (is_hit[lane])
+                    setReturn(hits[lane], (ends[lane] - starts[lane]).GetSafeNormal(), returns_[(first + lane) * max_returns_]);
+            }
+        }, shot_count < MIN_RAYS_FOR_PARALLEL_TRACE);
+    }
+    else
+    {
+        // shoot lasers; traces are read-only scene queries so they can run on the task graph workers
+        ParallelFor(shot_count, [&](int32 index) {
+            LaserShot& shot = shots_[index];
+            const ScanColumn& column = columns_[shot.column];
+            const Vector3r direction_l = get_direction(shot, column);
+            LaserReturn* returns = &returns_[index * max_returns_];
+
+            if (depth_capture_ != nullptr)
+            {
+                // single return without segmentation or incidence angle from depth;
+                // nothing is hit until the first depth images are read back
+                float range;
+                if (depth_images != nullptr && depth_capture_->getRange(*depth_images, direction_l, params.range, range))
+                {
+                    returns[0].point = column.start + column.rotation * direction_l * range;
+                    returns[0].segmentationID = -1;
+                    returns[0].intensity = getIntensity(default_reflectivity_, 1, range);
+                    shot.return_count = 1;
+                }
+                return;
+            }
+
+            const Vector3r end = column.start + column.rotation * direction_l * params.range;
+            shot.return_count = shootLaser(column.start_ue, ned_transform_->fromLocalNed(end), trace_params, returns);
+        }, shot_count < MIN_RAYS_FOR_PARALLEL_TRACE);
+    }
+
+    // keep the hits in scan order; LidarData is filled with every format, the packed
+    // cloud is built from the same points in addition
+    msr::airlib::vector<msr::airlib::real_T>& hit_points = point_cloud;
+    hit_points.reserve(shots_.size() * 3);
+    segmentation_cloud.reserve(shots_.size());
+    for (size_t index = 0; index < shots_.size(); ++index)
+    {
+        const LaserReturn* returns = &returns_[index * max_returns_];
+        for (uint8 return_index = 0; return_index < shots_[index].return_count; ++return_index)
+        {
+            const LaserReturn& laser_return = returns[return_index];
+            hit_points.emplace_back(laser_return.point.x());
+            hit_points.emplace_back(laser_return.point.y());
+            hit_points.emplace_back(laser_return.point.z());
+            segmentation_cloud.emplace_back(laser_return.segmentationID);
+        }
+    }
+
+    // drawn in the vehicle inertial frame, copied before the points are taken to the sensor
+    // frame since with a continuous sweep every column has its own sensor pose
+    if (draw_debug_points_)
+    {
+        // same time stamp and pose LidarSimple gives the output
+        std::shared_ptr<msr::airlib::LidarData> debug_output = std::make_shared<msr::airlib::LidarData>();
+        debug_output->point_cloud = hit_points;
+        debug_output->time_stamp = msr::airlib::ClockFactory::get()->nowNanos();
+        debug_output->pose = sensor_pose;
+
+        std::lock_guard<std::mutex> lock(debug_output_mutex_);
+        debug_output_ = std::move(debug_output);
+    }
+
+    // decide the frame for the point-cloud
+    if (params.data_frame == AirSimSettings::kVehicleInertialFrame) {
+        // current detault behavior; though it is probably not very useful.
+        // not changing the default for now to maintain backwards-compat.
+    }
+    else if (params.data_frame == AirSimSettings::kSensorLocalFrame) {
+        // tranform the whole cloud to lidar frame at once, this is the same as
+        //    point = VectorMath::transformToBodyFrame(point_v_i, lidar_pose + vehicle_pose, true);
+        // for every point.
+
+        // On the client side, if it is needed to transform this data back to the world frame,
+        // then do the equivalent of following,
+        //     Vector3r point_w = VectorMath::transformToWorldFrame(point, lidar_pose + vehicle_pose, true);
+        if (!continuous_sweep_)
+        {
+            Eigen::Map<Eigen::Matrix<msr::airlib::real_T, 3, Eigen::Dynamic>> points(hit_points.data(), 3, hit_points.size() / 3);
+            points = rotation.transpose() * (points.colwise() - start);
+        }
+        else
         {
-            const float horizontal_angle = std::fmod(current_horizontal_angle_ + angle_distance_of_laser_measure * i, 360.0f);
-
-            // check if the laser is outside the requested horizontal FOV
-            if (!VectorMath::isAngleBetweenAngles(horizontal_angle, laser_start, laser_end))
-                continue;
-       
-            Vector3r point;
-            int segmentationID = -1;
-            // shoot laser and get the impact point, if any
-            if (shootLaser(lidar_pose, vehicle_pose, laser, horizontal_angle, vertical_angle, params, point, segmentationID))
+            // every point relative to the lidar at the time it was scanned, as a real sweeping lidar reports them
+            msr::airlib::real_T* point = hit_points.data();
+            for (size_t index = 0; index < shots_.size(); ++index)
             {
-                point_cloud.emplace_back(point.x());
-                point_cloud.emplace_back(point.y());
-                point_cloud.emplace_back(point.z());
-                segmentation_cloud.emplace_back(segmentationID);
+                const ScanColumn& column = columns_[shots_[index].column];
+                for (uint8 return_index = 0; return_index < shots_[index].return_count; ++return_index)
+                {
+                    Eigen::Map<Vector3r> point_l(point);
+                    point_l = column.rotation.transpose() * (point_l - column.start);
+                    point += 3;
+                }
             }
         }
     }
+    else 
+        throw std::runtime_error("Unknown requested data frame");
+
+    if (packed_output_)
+        publishPackedCloud(point_cloud, sensor_pose, params.data_frame, delta_time);
 
     current_horizontal_angle_ = std::fmod(current_horizontal_angle_ + angle_distance_of_tick, 360.0f);
 
     return;
 }
 
-// simulate shooting a laser via Unreal ray-tracing.
-bool UnrealLidarSensor::shootLaser(const msr::airlib::Pose& lidar_pose, const msr::airlib::Pose& vehicle_pose,
-    const uint32 laser, const float horizontal_angle, const float vertical_angle, 
-    const msr::airlib::LidarSimpleParams params, Vector3r &point, int &segmentationID)
+// vehicle pose time_delta seconds from now (negative for the past), extrapolated with its current twist
+msr::airlib::Pose UnrealLidarSensor::getVehiclePoseAt(const msr::airlib::Pose& vehicle_pose,
+    const msr::airlib::Kinematics::State& kinematics, float time_delta)
 {
-    // start position
-    Vector3r start = VectorMath::add(lidar_pose, vehicle_pose).position;
+    msr::airlib::Pose pose = vehicle_pose;
 
-    // We need to compose rotations here rather than rotate a vector by a quaternion
-    // Hence using coordOrientationAdd(..) rather than rotateQuaternion(..)
+    // linear velocity is in world frame
+    pose.position += kinematics.twist.linear * time_delta;
 
-    // get ray quaternion in lidar frame (angles must be in radians)
-    msr::airlib::Quaternionr ray_q_l = msr::airlib::VectorMath::toQuaternion(
-        msr::airlib::Utils::degreesToRadians(vertical_angle),   //pitch - rotation around Y axis
-        0,                                                      //roll  - rotation around X axis
-        msr::airlib::Utils::degreesToRadians(horizontal_angle));//yaw   - rotation around Z axis
+    // angular velocity is in body frame
+    const msr::airlib::real_T angle = kinematics.twist.angular.norm() * time_delta;
+    if (angle != 0)
+    {
+        const Vector3r axis = kinematics.twist.angular.normalized();
+        pose.orientation = (pose.orientation * msr::airlib::Quaternionr(Eigen::AngleAxis<msr::airlib::real_T>(angle, axis))).normalized();
+    }
+
+    return pose;
+}
 
-    // get ray quaternion in body frame
-    msr::airlib::Quaternionr ray_q_b = VectorMath::coordOrientationAdd(ray_q_l, lidar_pose.orientation);
+std::shared_ptr<const LidarPackedCloud> UnrealLidarSensor::getPackedOutput() const
+{
+    std::lock_guard<std::mutex> lock(packed_cloud_mutex_);
+    return packed_cloud_;
+}
 
-    // get ray quaternion in world frame
-    msr::airlib::Quaternionr ray_q_w = VectorMath::coordOrientationAdd(ray_q_b, vehicle_pose.orientation);
+std::shared_ptr<const msr::airlib::LidarData> UnrealLidarSensor::getDebugOutput() const
+{
+    std::lock_guard<std::mutex> lock(debug_output_mutex_);
+    return debug_output_;
+}
 
-    // get ray vector (end position)
-    Vector3r end = VectorMath::rotateVector(VectorMath::front(), ray_q_w, true) * params.range + start;
-   
-    FHitResult hit_result = FHitResult(ForceInit);
-    bool is_hit = UAirBlueprintLib::GetObstacle(actor_, ned_transform_->fromLocalNed(start), ned_transform_->fromLocalNed(end), hit_result, actor_, ECC_Visibility);
+int UnrealLidarSensor::getDrawDebugPointsDecimation() const
+{
+    return draw_debug_points_decimation_;
+}
 
-    if (is_hit)
+// fills the packed cloud from the hit points of LidarData and the scan that produced them
+void UnrealLidarSensor::publishPackedCloud(const msr::airlib::vector<msr::airlib::real_T>& hit_points,
+    const msr::airlib::Pose& sensor_pose, const std::string& data_frame, msr::airlib::TTimeDelta delta_time)
+{
+    // reuse the cloud published before the last one unless a client still holds it
+    std::shared_ptr<LidarPackedCloud> cloud = std::move(spare_packed_cloud_);
+    if (cloud == nullptr || cloud.use_count() != 1)
+        cloud = std::make_shared<LidarPackedCloud>();
+
+    cloud->clear();
+    // time offsets are from the start of the scan, the pose is the one at its end
+    cloud->scan_duration = static_cast<float>(delta_time);
+    cloud->time_stamp = msr::airlib::ClockFactory::get()->nowNanos() - static_cast<msr::airlib::TTimePoint>(delta_time * 1.0E9);
+    cloud->pose = sensor_pose;
+    cloud->data_frame = data_frame;
+    cloud->position_resolution = quantized_output_ ? quantization_resolution_ : 0;
+    cloud->time_resolution = quantized_output_ ? static_cast<float>(delta_time) / MAX_QUANTIZED_TIME_OFFSET : 0;
+
+    const size_t hit_count = hit_points.size() / 3;
+    if (quantized_output_)
+        cloud->quantized_points.reserve(hit_count);
+    else
+        cloud->points.reserve(hit_count);
+
+    const float* hit_point = hit_points.data();
+    for (size_t index = 0; index < shots_.size(); ++index)
     {
-        //Store the segmentation id of the hit object.
-        auto hitActor = hit_result.GetActor();
-        if (hitActor != nullptr)
+        const LaserShot& shot = shots_[index];
+        const LaserReturn* returns = &returns_[index * max_returns_];
+        const float time_offset = columns_[shot.column].time_offset;
+
+        for (uint8 return_index = 0; return_index < shot.return_count; ++return_index)
         {
-            TArray<UMeshComponent*> meshComponents;
-            hitActor->GetComponents<UMeshComponent>(meshComponents);
-            for (int i = 0; i < meshComponents.Num(); i++)
+            const LaserReturn& laser_return = returns[return_index];
+            if (quantized_output_)
+            {
+                LidarQuantizedPoint point;
+                point.x = quantize<int16>(hit_point[0] / quantization_resolution_);
+                point.y = quantize<int16>(hit_point[1] / quantization_resolution_);
+                point.z = quantize<int16>(hit_point[2] / quantization_resolution_);
+                point.intensity = quantize<uint16>(laser_return.intensity * 65535.0f);
+                point.segmentation = quantize<int16>(static_cast<float>(laser_return.segmentationID));
+                point.ring = static_cast<uint16>(shot.laser);
+                point.return_index = return_index;
+                point.return_count = shot.return_count;
+                point.time_offset = cloud->time_resolution > 0 ? quantize<uint16>(time_offset / cloud->time_resolution) : 0;
+                cloud->quantized_points.push_back(point);
+            }
+            else
             {
-                segmentationID = segmentationID == -1 ? meshComponents[i]->CustomDepthStencilValue : segmentationID;
+                LidarPackedPoint point;
+                point.x = hit_point[0];
+                point.y = hit_point[1];
+                point.z = hit_point[2];
+                point.intensity = laser_return.intensity;
+                point.segmentation = laser_return.segmentationID;
+                point.ring = static_cast<uint16>(shot.laser);
+                point.return_index = return_index;
+                point.return_count = shot.return_count;
+                point.time_offset = time_offset;
+                cloud->points.push_back(point);
             }
+            hit_point += 3;
         }
+    }
 
-        if (false && UAirBlueprintLib::IsInGameThread())
-        {
-            // Debug code for very specific cases.
-            // Mostly shouldn't be needed. Use SimModeBase::drawLidarDebugPoints()
-            DrawDebugPoint(
-                actor_->GetWorld(),
-                hit_result.ImpactPoint,
-                5,                       //size
-                FColor::Red,
-                true,                    //persistent (never goes away)
-                0.1                      //point leaves a trail on moving object
-            );
-        }
+    std::lock_guard<std::mutex> lock(packed_cloud_mutex_);
+    spare_packed_cloud_ = std::const_pointer_cast<LidarPackedCloud>(packed_cloud_);
+    packed_cloud_ = std::move(cloud);
+}
 
-        // decide the frame for the point-cloud
-        if (params.data_frame == AirSimSettings::kVehicleInertialFrame) {
-            // current detault behavior; though it is probably not very useful.
-            // not changing the default for now to maintain backwards-compat.
-            point = ned_transform_->toLocalNed(hit_result.ImpactPoint);
-        }
-        else if (params.data_frame == AirSimSettings::kSensorLocalFrame) {
-            // point in vehicle intertial frame
-            Vector3r point_v_i = ned_transform_->toLocalNed(hit_result.ImpactPoint);
+// simulate shooting a laser via Unreal ray-tracing, points are returned in vehicle inertial frame.
+// Returns the number of returns written, at most max_returns_.
+uint8 UnrealLidarSensor::shootLaser(const FVector& start, const FVector& end, const FCollisionQueryParams& trace_params,
+    LaserReturn* returns)
+{
+    const FVector direction = (end - start).GetSafeNormal();
 
-            // tranform to lidar frame
-            point = VectorMath::transformToBodyFrame(point_v_i, lidar_pose + vehicle_pose, true);
+    if (max_returns_ == 1)
+    {
+        FHitResult hit_result = FHitResult(ForceInit);
+        if (!actor_->GetWorld()->LineTraceSingleByChannel(hit_result, start, end, ECC_Visibility, trace_params))
+            return 0;
 
-            // The above should be same as first transforming to vehicle-body frame and then to lidar frame
-            //    Vector3r point_v_b = VectorMath::transformToBodyFrame(point_v_i, vehicle_pose, true);
-            //    point = VectorMath::transformToBodyFrame(point_v_b, lidar_pose, true);
+        setReturn(hit_result, direction, returns[0]);
+        return 1;
+    }
 
-            // On the client side, if it is needed to transform this data back to the world frame,
-            // then do the equivalent of following,
-            //     Vector3r point_w = VectorMath::transformToWorldFrame(point, lidar_pose + vehicle_pose, true);
-            // See SimModeBase::drawLidarDebugPoints()
+    // overlapping geometry such as foliage gives the earlier returns, the blocking hit is the last one
+    TArray<FHitResult, TInlineAllocator<MAX_LIDAR_RETURNS>> hits;
+    actor_->GetWorld()->LineTraceMultiByChannel(hits, start, end, ECC_Visibility, trace_params);
 
-            // TODO: Optimization -- instead of doing this for every point, it should be possible to do this
-            // for the point-cloud together? Need to look into matrix operations to do this together for all points.
-        }
-        else 
-            throw std::runtime_error("Unknown requested data frame");
+    // when capped keep the nearest returns and the last one
+    const int32 return_count = FMath::Min(hits.Num(), static_cast<int32>(max_returns_));
+    for (int32 return_index = 0; return_index < return_count; ++return_index)
+    {
+        const int32 hit_index = return_index == return_count - 1 ? hits.Num() - 1 : return_index;
+        setReturn(hits[hit_index], direction, returns[return_index]);
+    }
+    return static_cast<uint8>(return_count);
+}
+
+void UnrealLidarSensor::setReturn(const FHitResult& hit_result, const FVector& direction, LaserReturn& laser_return)
+{
+    //Store the segmentation id of the hit object.
+    laser_return.segmentationID = getSegmentationID(hit_result);
 
-        return true;
+    if (false && UAirBlueprintLib::IsInGameThread())
+    {
+        // Debug code for very specific cases.
+        // Mostly shouldn't be needed. Use SimModeBase::drawLidarDebugPoints()
+        DrawDebugPoint(
+            actor_->GetWorld(),
+            hit_result.ImpactPoint,
+            5,                       //size
+            FColor::Red,
+            true,                    //persistent (never goes away)
+            0.1                      //point leaves a trail on moving object
+        );
     }
-    else 
+
+    laser_return.point = ned_transform_->toLocalNed(hit_result.ImpactPoint);
+
+    if (compute_intensity_)
     {
-        return false;
+        const float cos_incidence = -FVector::DotProduct(direction, hit_result.ImpactNormal);
+        laser_return.intensity = getIntensity(getReflectivity(hit_result.PhysMaterial), cos_incidence,
+            ned_transform_->toNed(hit_result.Distance));
     }
+    else
+        laser_return.intensity = 0;
+}
+
+// Lambertian return of the surface attenuated by the atmosphere, clamped to 0..1
+float UnrealLidarSensor::getIntensity(float reflectivity, float cos_incidence, float range) const
+{
+    const float intensity = reflectivity * FMath::Max(cos_incidence, 0.0f) * std::exp(-atmospheric_attenuation_ * range);
+    return FMath::Clamp(intensity, 0.0f, 1.0f);
+}
+
+// reflectivity of a physical material from the MaterialReflectivity setting, looked up by name once per material
+float UnrealLidarSensor::getReflectivity(const TWeakObjectPtr<UPhysicalMaterial>& material)
+{
+    if (!material.IsValid() || material_reflectivity_.size() == 0)
+        return default_reflectivity_;
+
+    {
+        FRWScopeLock lock(material_reflectivity_lock_, SLT_ReadOnly);
+        const float* cached = material_reflectivity_cache_.Find(material);
+        if (cached != nullptr)
+            return *cached;
+    }
+
+    const auto found = material_reflectivity_.find(std::string(TCHAR_TO_UTF8(*material->GetName())));
+    const float reflectivity = found != material_reflectivity_.end() ? found->second : default_reflectivity_;
+
+    FRWScopeLock lock(material_reflectivity_lock_, SLT_Write);
+    material_reflectivity_cache_.Add(material, reflectivity);
+    return reflectivity;
+}
+
+// segmentation ID of the hit, as the custom stencil value shown in the segmentation view
+int UnrealLidarSensor::getSegmentationID(const FHitResult& hit_result)
+{
+    // the hit component is what was rendered with the stencil value, so use it when there is one
+    const UPrimitiveComponent* hit_component = hit_result.GetComponent();
+    if (hit_component != nullptr)
+        return hit_component->CustomDepthStencilValue;
+
+    const TWeakObjectPtr<AActor> hit_actor = hit_result.Actor;
+    if (!hit_actor.IsValid())
+        return -1;
+
+    {
+        FRWScopeLock lock(actor_stencil_ids_lock_, SLT_ReadOnly);
+        const int* cached_id = actor_stencil_ids_.Find(hit_actor);
+        if (cached_id != nullptr)
+            return *cached_id;
+    }
+
+    // otherwise the first mesh of the actor decides, as before
+    int segmentationID = -1;
+    TInlineComponentArray<UMeshComponent*> meshComponents(hit_actor.Get());
+    if (meshComponents.Num() > 0)
+        segmentationID = meshComponents[0]->CustomDepthStencilValue;
+
+    FRWScopeLock lock(actor_stencil_ids_lock_, SLT_Write);
+    if (actor_stencil_ids_.Num() >= MAX_CACHED_ACTOR_STENCIL_IDS)
+        actor_stencil_ids_.Reset();
+    actor_stencil_ids_.Add(hit_actor, segmentationID);
+    return segmentationID;
 }
@@ -5,8 +5,16 @@
 
 #include "common/Common.hpp"
 #include "GameFramework/Actor.h"
+#include "CollisionQueryParams.h"
 #include "sensors/lidar/LidarSimple.hpp"
 #include "NedTransform.h"
+#include "UnrealSensors/LidarPackedCloud.h"
+#include "UnrealSensors/LidarDepthCapture.h"
+#include <memory>
+#include <mutex>
+#include <map>
+
+class UPhysicalMaterial;
 
 // UnrealLidarSensor implementation that uses Ray Tracing in Unreal.
 // The implementation uses a model similar to CARLA Lidar implementation.
@@ -19,6 +27,18 @@ public:
     UnrealLidarSensor(const AirSimSettings::LidarSetting& setting,
         AActor* actor, const NedTransform* ned_transform);
 
+    // last scan in the packed format, null unless PointFormat is Packed or PackedQuantized.
+    // The cloud is never modified after it is returned so it can be sent without copying.
+    std::shared_ptr<const LidarPackedCloud> getPackedOutput() const;
+
+    // copy of the last XYZ scan in the vehicle inertial frame, whatever the DataFrame, for drawing
+    // it on the game thread; null unless DrawDebugPoints is on. getOutput() is reassigned by the
+    // physics thread, this one is never modified.
+    std::shared_ptr<const msr::airlib::LidarData> getDebugOutput() const;
+
+    // DrawDebugPointsDecimation setting, at least 1
+    int getDrawDebugPointsDecimation() const;
+
 protected:
     virtual void getPointCloud(const msr::airlib::Pose& lidar_pose, const msr::airlib::Pose& vehicle_pose,
         msr::airlib::TTimeDelta delta_time, msr::airlib::vector<msr::airlib::real_T>& point_cloud, msr::airlib::vector<int>& segmentation_cloud) override;
@@ -26,16 +46,86 @@ protected:
 private:
     using Vector3r = msr::airlib::Vector3r;
     using VectorMath = msr::airlib::VectorMath;
+    using Matrix3r = Eigen::Matrix<msr::airlib::real_T, 3, 3>;
+
+    // azimuth of one column of the scan and the lidar pose it is shot from
+    struct ScanColumn {
+        float cos_h;
+        float sin_h;
+        // seconds since the start of the scan
+        float time_offset;
+        Matrix3r rotation;
+        Vector3r start;
+        FVector start_ue;
+    };
+
+    // one ray of a scan, filled by the trace workers with the number of returns it got
+    struct LaserShot {
+        uint32 laser;
+        uint32 column;
+        uint8 return_count;
+    };
+
+    // one return of a ray
+    struct LaserReturn {
+        Vector3r point;
+        int segmentationID;
+        float intensity;
+    };
 
     void createLasers();
-    bool shootLaser(const msr::airlib::Pose& lidar_pose, const msr::airlib::Pose& vehicle_pose,
-        const uint32 channel, const float horizontal_angle, const float vertical_angle, 
-        const msr::airlib::LidarSimpleParams params, Vector3r &point, int &segmentationID);
+    uint8 shootLaser(const FVector& start, const FVector& end, const FCollisionQueryParams& trace_params,
+        LaserReturn* returns);
+    void setReturn(const FHitResult& hit_result, const FVector& direction, LaserReturn& laser_return);
+    float getIntensity(float reflectivity, float cos_incidence, float range) const;
+    float getReflectivity(const TWeakObjectPtr<UPhysicalMaterial>& material);
+    int getSegmentationID(const FHitResult& hit_result);
+    static msr::airlib::Pose getVehiclePoseAt(const msr::airlib::Pose& vehicle_pose,
+        const msr::airlib::Kinematics::State& kinematics, float time_delta);
+    void publishPackedCloud(const msr::airlib::vector<msr::airlib::real_T>& hit_points,
+        const msr::airlib::Pose& sensor_pose, const std::string& data_frame, msr::airlib::TTimeDelta delta_time);
 
 private:
     AActor* actor_;
     const NedTransform* ned_transform_;
 
     msr::airlib::vector<msr::airlib::real_T> laser_angles_;
+    // cos/sin of laser_angles_, see createLasers
+    std::vector<float> laser_cos_;
+    std::vector<float> laser_sin_;
+    // reused between scans to avoid reallocating for every tick
+    std::vector<ScanColumn> columns_;
+    std::vector<LaserShot> shots_;
+    // max_returns_ entries per shot
+    std::vector<LaserReturn> returns_;
+    uint8 max_returns_ = 1;
+
+    bool continuous_sweep_ = false;
+    int draw_debug_points_decimation_ = 1;
+    bool compute_intensity_ = false;
+    float default_reflectivity_ = 0;
+    float atmospheric_attenuation_ = 0;
+    std::map<std::string, float> material_reflectivity_;
+    TMap<TWeakObjectPtr<UPhysicalMaterial>, float> material_reflectivity_cache_;
+    FRWLock material_reflectivity_lock_;
     float current_horizontal_angle_ = 0.0f;
+
+    // stencil IDs of hit actors, for hits that don't report a component
+    TMap<TWeakObjectPtr<AActor>, int> actor_stencil_ids_;
+    FRWLock actor_stencil_ids_lock_;
+    uint32 stencil_id_generation_ = 0;
+
+    // set in DepthBuffer simulation mode
+    std::unique_ptr<LidarDepthCapture> depth_capture_;
+
+    bool packed_output_ = false;
+    bool quantized_output_ = false;
+    float quantization_resolution_ = 0;
+    std::shared_ptr<const LidarPackedCloud> packed_cloud_;
+    std::shared_ptr<LidarPackedCloud> spare_packed_cloud_;
+    mutable std::mutex packed_cloud_mutex_;
+
+    bool draw_debug_points_ = false;
+    std::shared_ptr<const msr::airlib::LidarData> debug_output_;
+    mutable std::mutex debug_output_mutex_;
 };
\ No newline at end of file
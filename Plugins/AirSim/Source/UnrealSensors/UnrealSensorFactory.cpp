@@ -2,6 +2,7 @@
 // Licensed under the MIT License.
 #include "UnrealSensorFactory.h"
 #include "UnrealSensors/UnrealDistanceSensor.h"
+#include "UnrealSensors/UnrealDistanceArraySensor.h"
 #include "UnrealSensors/UnrealLidarSensor.h"
 
 UnrealSensorFactory::UnrealSensorFactory(AActor* actor, const NedTransform* ned_transform)
@@ -16,8 +17,14 @@ std::unique_ptr<msr::airlib::SensorBase> UnrealSensorFactory::createSensorFromSe
 
     switch (sensor_setting->sensor_type) {
     case SensorBase::SensorType::Distance:
+    {
+        const auto& distance_setting = *static_cast<const AirSimSettings::DistanceSetting*>(sensor_setting);
+        if (distance_setting.beams.size() > 0)
+            return std::unique_ptr<UnrealDistanceArraySensor>(new UnrealDistanceArraySensor(
+                distance_setting, actor_, ned_transform_));
         return std::unique_ptr<UnrealDistanceSensor>(new UnrealDistanceSensor(
-            *static_cast<const AirSimSettings::DistanceSetting*>(sensor_setting), actor_, ned_transform_));
+            distance_setting, actor_, ned_transform_));
+    }
     case SensorBase::SensorType::Lidar:
         return std::unique_ptr<UnrealLidarSensor>(new UnrealLidarSensor(
             *static_cast<const AirSimSettings::LidarSetting*>(sensor_setting), actor_, ned_transform_));
@@ -41,14 +41,22 @@ std::string CarPawnSimApi::getRecordFileLine(bool is_header_line) const
                "Throttle\tSteering\tBrake\tGear\tHandbrake\tRPM\tSpeed\t";
     }
 
-    const auto& state = pawn_api_->getCarState();
+    return common_line;
+}
 
-    std::ostringstream ss;
-    ss << common_line;
-    ss << current_controls_.throttle << "\t" << current_controls_.steering << "\t" << current_controls_.brake << "\t";
-    ss << state.gear << "\t" << state.handbrake << "\t" << state.rpm << "\t" << state.speed << "\t";
+void CarPawnSimApi::appendRecordFileLine(RecordLineBuffer& buffer) const
+{
+    PawnSimApi::appendRecordFileLine(buffer);
+
+    const auto& state = pawn_api_->getCarState();
 
-    return ss.str();
+    buffer.appendColumn(current_controls_.throttle);
+    buffer.appendColumn(current_controls_.steering);
+    buffer.appendColumn(current_controls_.brake);
+    buffer.appendColumn(static_cast<int32_t>(state.gear));
+    buffer.appendColumn(state.handbrake);
+    buffer.appendColumn(state.rpm);
+    buffer.appendColumn(state.speed);
 }
 
 //these are called on render ticks
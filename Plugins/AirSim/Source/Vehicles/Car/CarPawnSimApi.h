@@ -33,6 +33,7 @@ public:
     virtual void update() override;
 
     virtual std::string getRecordFileLine(bool is_header_line) const override;
+    virtual void appendRecordFileLine(RecordLineBuffer& buffer) const override;
 
     virtual void updateRenderedState(float dt) override;
     virtual void updateRendering(float dt) override;
@@ -8,6 +8,7 @@
 #include "common/Common.hpp"
 #include "common/EarthUtils.hpp"
 #include "vehicles/car/api/CarRpcLibServer.hpp"
+#include "SimMode/ShardRpcServer.h"
 
 extern CORE_API uint32 GFrameNumber;
 
@@ -93,8 +94,8 @@ std::unique_ptr<msr::airlib::ApiServerBase> ASimModeCar::CreateApiServer() const
 #ifdef AIRLIB_NO_RPC
     return ASimModeBase::CreateApiServer();
 #else
-    return std::unique_ptr<msr::airlib::ApiServerBase>(new msr::airlib::CarRpcLibServer(
-        GetApiProvider(), GetSettings().api_server_address, GetSettings().api_port));
+    return std::unique_ptr<msr::airlib::ApiServerBase>(new ShardRpcServer<msr::airlib::CarRpcLibServer>(
+        this, GetApiProvider(), GetSettings().api_server_address, GetSettings().api_port));
 #endif
 }
 
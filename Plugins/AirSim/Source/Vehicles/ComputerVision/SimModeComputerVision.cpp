@@ -15,6 +15,7 @@
 #include "common/AirSimSettings.hpp"
 #include "physics/Kinematics.hpp"
 #include "api/RpcLibServerBase.hpp"
+#include "SimMode/ShardRpcServer.h"
 
 
 std::unique_ptr<msr::airlib::ApiServerBase> ASimModeComputerVision::CreateApiServer() const
@@ -22,8 +23,8 @@ std::unique_ptr<msr::airlib::ApiServerBase> ASimModeComputerVision::CreateApiSer
 #ifdef AIRLIB_NO_RPC
     return ASimModeBase::CreateApiServer();
 #else
-    return std::unique_ptr<msr::airlib::ApiServerBase>(new msr::airlib::RpcLibServerBase(
-        GetApiProvider(), GetSettings().api_server_address, GetSettings().api_port));
+    return std::unique_ptr<msr::airlib::ApiServerBase>(new ShardRpcServer<msr::airlib::RpcLibServerBase>(
+        this, GetApiProvider(), GetSettings().api_server_address, GetSettings().api_port));
 #endif
 }
 
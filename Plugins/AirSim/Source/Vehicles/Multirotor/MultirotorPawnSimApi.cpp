@@ -60,32 +60,50 @@ void MultirotorPawnSimApi::updateRenderedState(float dt)
         return;
     }
 
-    //move collision info from rendering engine to vehicle
-    const CollisionInfo& collision_info = getCollisionInfo();
-    multirotor_physics_body_->setCollisionInfo(collision_info);
-        
-    last_phys_pose_ = multirotor_physics_body_->getPose();
-    
-    collision_response = multirotor_physics_body_->getCollisionResponseInfo();
+    //collision info from rendering engine and RC for the next physics step
+    GameInput& input = game_input_.getWriteBuffer();
+    input.collision_info = getCollisionInfo();
+    input.has_rc_data = getRemoteControlID() >= 0;
+    if (input.has_rc_data)
+        input.rc_data = getRCData();
+    game_input_.publish();
+
+    //state of the last physics step, physics is not locked for this
+    if (rendered_state_.update()) {
+        const RenderedState& state = rendered_state_.getReadBuffer();
+        last_phys_pose_ = state.pose;
+        collision_response = state.collision_response;
+        rotor_actuator_info_ = state.rotor_actuator_info;
+    }
 
-    //update rotor poses
+    std::lock_guard<std::mutex> lock(status_messages_mutex_);
+    vehicle_api_messages_.insert(vehicle_api_messages_.end(), pending_status_messages_.begin(), pending_status_messages_.end());
+    pending_status_messages_.clear();
+}
+
+bool MultirotorPawnSimApi::isRenderedStatePublished() const
+{
+    //reset runs on the game thread and needs physics locked
+    return !reset_pending_;
+}
+
+void MultirotorPawnSimApi::publishRenderedState()
+{
+    RenderedState& state = rendered_state_.getWriteBuffer();
+    state.pose = multirotor_physics_body_->getPose();
+    state.collision_response = multirotor_physics_body_->getCollisionResponseInfo();
+
+    state.rotor_actuator_info.resize(rotor_count_);
     for (unsigned int i = 0; i < rotor_count_; ++i) {
         const auto& rotor_output = multirotor_physics_body_->getRotorOutput(i);
-        // update private rotor variable
-        rotor_states_.rotors[i].update(rotor_output.thrust, rotor_output.torque_scaler, rotor_output.speed);
-        RotorActuatorInfo* info = &rotor_actuator_info_[i];
+        RotorActuatorInfo* info = &state.rotor_actuator_info[i];
         info->rotor_speed = rotor_output.speed;
         info->rotor_direction = static_cast<int>(rotor_output.turning_direction);
         info->rotor_thrust = rotor_output.thrust;
         info->rotor_control_filtered = rotor_output.control_signal_filtered;
     }
 
-    vehicle_api_->getStatusMessages(vehicle_api_messages_);
-
-    if (getRemoteControlID() >= 0)
-        vehicle_api_->setRCData(getRCData());
-    rotor_states_.timestamp = clock()->nowNanos();
-    vehicle_api_->setRotorStates(rotor_states_);
+    rendered_state_.publish();
 }
 
 void MultirotorPawnSimApi::updateRendering(float dt)
@@ -148,6 +166,9 @@ void MultirotorPawnSimApi::resetImplementation()
     vehicle_api_->reset();
     multirotor_physics_body_->reset();
     vehicle_api_messages_.clear();
+
+    //physics may stay paused after the reset, the game thread must not render the old pose
+    publishRenderedState();
 }
 
 //this is high frequency physics tick, flier gets ticked at rendering frame rate
@@ -156,10 +177,33 @@ void MultirotorPawnSimApi::update()
     //environment update for current position
     PawnSimApi::update();
 
+    //latest collision info and RC posted by the game thread, kept until it posts again
+    if (game_input_.update()) {
+        const GameInput& input = game_input_.getReadBuffer();
+        multirotor_physics_body_->setCollisionInfo(input.collision_info);
+        if (input.has_rc_data)
+            vehicle_api_->setRCData(input.rc_data);
+    }
+
     //update forces on vertices
     multirotor_physics_body_->update();
 
     //update to controller must be done after kinematics have been updated by physics engine
+
+    //update rotor poses
+    for (unsigned int i = 0; i < rotor_count_; ++i) {
+        const auto& rotor_output = multirotor_physics_body_->getRotorOutput(i);
+        rotor_states_.rotors[i].update(rotor_output.thrust, rotor_output.torque_scaler, rotor_output.speed);
+    }
+    rotor_states_.timestamp = clock()->nowNanos();
+    vehicle_api_->setRotorStates(rotor_states_);
+
+    {
+        std::lock_guard<std::mutex> lock(status_messages_mutex_);
+        vehicle_api_->getStatusMessages(pending_status_messages_);
+    }
+
+    publishRenderedState();
 }
 
 void MultirotorPawnSimApi::reportState(StateReporter& reporter)
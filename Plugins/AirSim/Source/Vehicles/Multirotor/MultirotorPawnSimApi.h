@@ -10,7 +10,9 @@
 #include "common/CommonStructs.hpp"
 #include "common/common_utils/UniqueValueMap.hpp" 
 #include "MultirotorPawnEvents.h"
+#include "TripleBuffer.h"
 #include <future>
+#include <mutex>
 
 
 class MultirotorPawnSimApi : public PawnSimApi
@@ -35,6 +37,8 @@ public:
     MultirotorPawnSimApi(const Params& params);
     virtual void updateRenderedState(float dt) override;
     virtual void updateRendering(float dt) override;
+    virtual bool isRenderedStatePublished() const override;
+    virtual void publishRenderedState() override;
 
     //PhysicsBody interface
     //this just wrapped around MultiRotor physics body
@@ -79,4 +83,24 @@ private:
     Pose last_phys_pose_; //for trace lines showing vehicle path
     std::vector<std::string> vehicle_api_messages_;
     RotorStates rotor_states_;
+
+    //published by the physics thread after every step, read by the game thread
+    struct RenderedState {
+        Pose pose = Pose::nanPose();
+        CollisionResponse collision_response;
+        std::vector<RotorActuatorInfo> rotor_actuator_info;
+    };
+    TripleBuffer<RenderedState> rendered_state_;
+
+    //posted by the game thread every tick, taken by the next physics step
+    struct GameInput {
+        CollisionInfo collision_info;
+        bool has_rc_data = false;
+        msr::airlib::RCData rc_data;
+    };
+    TripleBuffer<GameInput> game_input_;
+
+    //status messages are events and must not be overwritten, so they are queued
+    std::mutex status_messages_mutex_;
+    std::vector<std::string> pending_status_messages_;
 };
@@ -14,6 +14,7 @@
 #include "common/ClockFactory.hpp"
 #include <memory>
 #include "vehicles/multirotor/api/MultirotorRpcLibServer.hpp"
+#include "SimMode/ShardRpcServer.h"
 
 
 void ASimModeWorldMultiRotor::BeginPlay()
@@ -74,8 +75,8 @@ std::unique_ptr<msr::airlib::ApiServerBase> ASimModeWorldMultiRotor::CreateApiSe
 #ifdef AIRLIB_NO_RPC
     return ASimModeBase::CreateApiServer();
 #else
-    return std::unique_ptr<msr::airlib::ApiServerBase>(new msr::airlib::MultirotorRpcLibServer(
-        GetApiProvider(), GetSettings().api_server_address, GetSettings().api_port));
+    return std::unique_ptr<msr::airlib::ApiServerBase>(new ShardRpcServer<msr::airlib::MultirotorRpcLibServer>(
+        this, GetApiProvider(), GetSettings().api_server_address, GetSettings().api_port));
 #endif
 }
 
@@ -5,6 +5,8 @@
 #include "common/common_utils/Utils.hpp"
 #include "Weather/WeatherLib.h"
 #include "DrawDebugHelpers.h"
+#include "UnrealSensors/StaticSceneBVH.h"
+#include "GameThreadCommandQueue.h"
 #include "Runtime/Engine/Classes/Engine/Engine.h"
 #include <cstdlib>
 #include <ctime>
@@ -21,6 +23,10 @@ bool WorldSimApi::loadLevel(const std::string& level_name)
     UAirBlueprintLib::RunCommandOnGameThread([this, level_name]() {
         
         this->current_level_ = UAirBlueprintLib::loadLevel(this->simmode_->GetWorld(), FString(level_name.c_str()));
+
+        //the static geometry changed with the level
+        if (this->current_level_ && msr::airlib::AirSimSettings::singleton().sensor_static_bvh)
+            StaticSceneBVH::build(this->simmode_->GetWorld());
     }, true);
 
     if (current_level_)
@@ -63,6 +69,7 @@ bool WorldSimApi::destroyObject(const std::string& object_name)
         AActor* actor = UAirBlueprintLib::FindActor<AActor>(simmode_, FString(object_name.c_str()));
         if (actor)
         {
+            StaticSceneBVH::removeActor(actor);
             actor->Destroy();
             result = actor->IsPendingKill();
         }
@@ -115,6 +122,10 @@ std::string WorldSimApi::spawnObject(std::string& object_name, const std::string
                 }
 
                 UAirBlueprintLib::setSimulatePhysics(NewActor, physics_enabled);
+
+                //objects that don't simulate physics only move through setObjectPose, which updates the BVH
+                if (NewActor && !physics_enabled)
+                    StaticSceneBVH::addActor(NewActor);
             }
             else
             {
@@ -253,6 +264,41 @@ void WorldSimApi::continueForFrames(uint32_t frames)
     simmode_->ContinueForFrames(frames);
 }
 
+LockstepObservation WorldSimApi::lockstepStep(uint32_t steps, const std::map<std::string, std::vector<msr::airlib::ImageCaptureBase::ImageRequest>>& image_requests)
+{
+    return simmode_->LockstepStep(steps, image_requests);
+}
+
+PhysicsLoopMonitor::Stats WorldSimApi::getPhysicsLoopStats() const
+{
+    return simmode_->GetPhysicsLoopStats();
+}
+
+int WorldSimApi::getVehicleApiPort(const std::string& vehicle_name) const
+{
+    return simmode_->GetVehicleApiPort(vehicle_name);
+}
+
+WorldStateHash::Result WorldSimApi::getWorldStateHash() const
+{
+    return simmode_->GetWorldStateHash();
+}
+
+std::vector<TickProfiler::SectionStats> WorldSimApi::getTickProfile() const
+{
+    return simmode_->GetTickProfile();
+}
+
+bool WorldSimApi::startTickTrace(const std::string& file_path)
+{
+    return simmode_->StartTickTrace(file_path);
+}
+
+bool WorldSimApi::stopTickTrace()
+{
+    return simmode_->StopTickTrace();
+}
+
 void WorldSimApi::setTimeOfDay(bool is_enabled, const std::string& start_datetime, bool is_start_datetime_dst,
     float celestial_clock_speed, float update_interval_secs, bool move_sun)
 {
@@ -273,12 +319,25 @@ bool WorldSimApi::addVehicle(const std::string& vehicle_name, const std::string&
 bool WorldSimApi::setSegmentationObjectID(const std::string& mesh_name, int object_id, bool is_name_regex)
 {
     bool success;
-    UAirBlueprintLib::RunCommandOnGameThread([mesh_name, object_id, is_name_regex, &success]() {
+    GameThreadCommandQueue::run([&mesh_name, object_id, is_name_regex, &success]() {
         success = UAirBlueprintLib::SetMeshStencilID(mesh_name, object_id, is_name_regex);
-    }, true);
+    });
     return success;
 }
 
+std::vector<bool> WorldSimApi::setSegmentationObjectIDs(const std::vector<std::string>& mesh_names, const std::vector<int>& object_ids, bool is_name_regex)
+{
+    if (mesh_names.size() != object_ids.size())
+        throw std::invalid_argument("setSegmentationObjectIDs needs one ID for every mesh");
+
+    std::vector<bool> results(mesh_names.size());
+    GameThreadCommandQueue::run([&mesh_names, &object_ids, is_name_regex, &results]() {
+        for (size_t i = 0; i < mesh_names.size(); ++i)
+            results[i] = UAirBlueprintLib::SetMeshStencilID(mesh_names[i], object_ids[i], is_name_regex);
+    });
+    return results;
+}
+
 int WorldSimApi::getSegmentationObjectID(const std::string& mesh_name) const
 {
     int result;
@@ -341,38 +400,99 @@ WorldSimApi::Vector3r WorldSimApi::getObjectScale(const std::string& object_name
 bool WorldSimApi::setObjectPose(const std::string& object_name, const WorldSimApi::Pose& pose, bool teleport)
 {
     bool result;
-    UAirBlueprintLib::RunCommandOnGameThread([this, &object_name, &pose, teleport, &result]() {
-        FTransform actor_transform = simmode_->GetGlobalNedTransform().fromGlobalNed(pose);
-        // AActor* actor = UAirBlueprintLib::FindActor<AActor>(simmode_, FString(object_name.c_str()));
-        AActor* actor = simmode_->SceneObjectMap.FindRef(FString(object_name.c_str()));
-        if (actor) {
-            if (teleport) 
-                result = actor->SetActorLocationAndRotation(actor_transform.GetLocation(), actor_transform.GetRotation(), false, nullptr, ETeleportType::TeleportPhysics);
-            else
-                result = actor->SetActorLocationAndRotation(actor_transform.GetLocation(), actor_transform.GetRotation(), true);
-        }
-        else
-            result = false;
-    }, true);
+    GameThreadCommandQueue::run([this, &object_name, &pose, teleport, &result]() {
+        result = setObjectPoseInternal(object_name, pose, teleport);
+    });
+    return result;
+}
+
+std::vector<bool> WorldSimApi::setObjectPoses(const std::vector<std::string>& object_names, const std::vector<Pose>& poses, bool teleport)
+{
+    if (object_names.size() != poses.size())
+        throw std::invalid_argument("setObjectPoses needs one pose for every object");
+
+    std::vector<bool> results(object_names.size());
+    GameThreadCommandQueue::run([this, &object_names, &poses, teleport, &results]() {
+        for (size_t i = 0; i < object_names.size(); ++i)
+            results[i] = setObjectPoseInternal(object_names[i], poses[i], teleport);
+    });
+    return results;
+}
+
+bool WorldSimApi::setObjectPoseInternal(const std::string& object_name, const Pose& pose, bool teleport)
+{
+    FTransform actor_transform = simmode_->GetGlobalNedTransform().fromGlobalNed(pose);
+    // AActor* actor = UAirBlueprintLib::FindActor<AActor>(simmode_, FString(object_name.c_str()));
+    AActor* actor = simmode_->SceneObjectMap.FindRef(FString(object_name.c_str()));
+    if (!actor)
+        return false;
+
+    bool result;
+    if (teleport) 
+        result = actor->SetActorLocationAndRotation(actor_transform.GetLocation(), actor_transform.GetRotation(), false, nullptr, ETeleportType::TeleportPhysics);
+    else
+        result = actor->SetActorLocationAndRotation(actor_transform.GetLocation(), actor_transform.GetRotation(), true);
+    StaticSceneBVH::updateActor(actor);
     return result;
 }
 
 bool WorldSimApi::setObjectScale(const std::string& object_name, const Vector3r& scale)
 {
     bool result;
-    UAirBlueprintLib::RunCommandOnGameThread([this, &object_name, &scale, &result]() {
-        // AActor* actor = UAirBlueprintLib::FindActor<AActor>(simmode_, FString(object_name.c_str()));
-        AActor* actor = simmode_->SceneObjectMap.FindRef(FString(object_name.c_str()));
-        if (actor) {
-            actor->SetActorScale3D(FVector(scale[0], scale[1], scale[2]));
-            result = true;
-        }
-        else
-            result = false;
-    }, true);
+    GameThreadCommandQueue::run([this, &object_name, &scale, &result]() {
+        result = setObjectScaleInternal(object_name, scale);
+    });
     return result;
 }
 
+std::vector<bool> WorldSimApi::setObjectScales(const std::vector<std::string>& object_names, const std::vector<Vector3r>& scales)
+{
+    if (object_names.size() != scales.size())
+        throw std::invalid_argument("setObjectScales needs one scale for every object");
+
+    std::vector<bool> results(object_names.size());
+    GameThreadCommandQueue::run([this, &object_names, &scales, &results]() {
+        for (size_t i = 0; i < object_names.size(); ++i)
+            results[i] = setObjectScaleInternal(object_names[i], scales[i]);
+    });
+    return results;
+}
+
+bool WorldSimApi::setObjectScaleInternal(const std::string& object_name, const Vector3r& scale)
+{
+    // AActor* actor = UAirBlueprintLib::FindActor<AActor>(simmode_, FString(object_name.c_str()));
+    AActor* actor = simmode_->SceneObjectMap.FindRef(FString(object_name.c_str()));
+    if (!actor)
+        return false;
+
+    actor->SetActorScale3D(FVector(scale[0], scale[1], scale[2]));
+    StaticSceneBVH::updateActor(actor);
+    return true;
+}
+
+std::vector<bool> WorldSimApi::setVehiclePoses(const std::vector<std::string>& vehicle_names, const std::vector<Pose>& poses, bool ignore_collision)
+{
+    if (vehicle_names.size() != poses.size())
+        throw std::invalid_argument("setVehiclePoses needs one pose for every vehicle");
+
+    std::vector<bool> results(vehicle_names.size());
+    GameThreadCommandQueue::run([this, &vehicle_names, &poses, ignore_collision, &results]() {
+        for (size_t i = 0; i < vehicle_names.size(); ++i) {
+            //setPose runs right away on the game thread
+            PawnSimApi* vehicle_sim_api = simmode_->GetVehicleSimApi(vehicle_names[i]);
+            results[i] = vehicle_sim_api != nullptr;
+            if (vehicle_sim_api)
+                vehicle_sim_api->setPose(poses[i], ignore_collision);
+        }
+    });
+    return results;
+}
+
+GameThreadCommandQueue::Stats WorldSimApi::getGameThreadCommandStats() const
+{
+    return GameThreadCommandQueue::getStats();
+}
+
 void WorldSimApi::enableWeather(bool enable)
 {
     UWeatherLib::setWeatherEnabled(simmode_->GetWorld(), enable);
@@ -560,6 +680,36 @@ bool WorldSimApi::isRecording() const
     return simmode_->IsRecording();
 }
 
+void WorldSimApi::triggerBlackBoxRecording()
+{
+    simmode_->TriggerBlackBoxRecording();
+}
+
+void WorldSimApi::startPlayback(const std::string& file_path, float time_scale, bool regenerate_images)
+{
+    simmode_->StartPlayback(FString(file_path.c_str()), time_scale, regenerate_images);
+}
+
+void WorldSimApi::stopPlayback()
+{
+    simmode_->StopPlayback();
+}
+
+bool WorldSimApi::isPlaybackActive() const
+{
+    return simmode_->IsPlaybackActive();
+}
+
+std::shared_ptr<const LidarPackedCloud> WorldSimApi::getLidarPackedCloud(const std::string& vehicle_name, const std::string& lidar_name) const
+{
+    return simmode_->GetLidarPackedCloud(vehicle_name, lidar_name);
+}
+
+std::vector<msr::airlib::real_T> WorldSimApi::getDistanceArray(const std::string& vehicle_name, const std::string& sensor_name) const
+{
+    return simmode_->GetDistanceArray(vehicle_name, sensor_name);
+}
+
 void WorldSimApi::setWind(const Vector3r& wind) const
 {
     simmode_->SetWind(wind);
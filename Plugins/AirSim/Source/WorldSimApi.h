@@ -4,6 +4,7 @@
 #include "common/CommonStructs.hpp"
 #include "api/WorldSimApiBase.hpp"
 #include "SimMode/SimModeBase.h"
+#include "GameThreadCommandQueue.h"
 #include "Components/StaticMeshComponent.h"
 #include "Runtime/Engine/Classes/Engine/StaticMesh.h"
 #include "Engine/LevelStreamingDynamic.h" 
@@ -28,6 +29,19 @@ public:
     virtual void pause(bool is_paused) override;
     virtual void continueForTime(double seconds) override;
     virtual void continueForFrames(uint32_t frames) override;
+    // physics steps, one rendered frame and the images in it, see "Lockstep" in settings
+    LockstepObservation lockstepStep(uint32_t steps, const std::map<std::string, std::vector<msr::airlib::ImageCaptureBase::ImageRequest>>& image_requests);
+    // timing of the physics thread, see PhysicsLoopMonitor
+    PhysicsLoopMonitor::Stats getPhysicsLoopStats() const;
+    // API port of the process simulating the vehicle when sharded, -1 if not known
+    int getVehicleApiPort(const std::string& vehicle_name) const;
+    // hashes of the world state in the last physics step, see "Deterministic" in settings
+    WorldStateHash::Result getWorldStateHash() const;
+    // game thread time per section of the sim mode tick, see TickProfiler
+    std::vector<TickProfiler::SectionStats> getTickProfile() const;
+    // trace of the tick sections, CSV if the path ends in .csv, Chrome trace event JSON otherwise
+    bool startTickTrace(const std::string& file_path);
+    bool stopTickTrace();
 
     virtual void setTimeOfDay(bool is_enabled, const std::string& start_datetime, bool is_start_datetime_dst,
         float celestial_clock_speed, float update_interval_secs, bool move_sun);
@@ -37,6 +51,12 @@ public:
 
     virtual bool setSegmentationObjectID(const std::string& mesh_name, int object_id, bool is_name_regex = false) override;
     virtual int getSegmentationObjectID(const std::string& mesh_name) const override;
+    // batch setters: one round trip to the game thread for all objects, see GameThreadCommandQueue
+    std::vector<bool> setSegmentationObjectIDs(const std::vector<std::string>& mesh_names, const std::vector<int>& object_ids, bool is_name_regex = false);
+    std::vector<bool> setObjectPoses(const std::vector<std::string>& object_names, const std::vector<Pose>& poses, bool teleport);
+    std::vector<bool> setObjectScales(const std::vector<std::string>& object_names, const std::vector<Vector3r>& scales);
+    std::vector<bool> setVehiclePoses(const std::vector<std::string>& vehicle_names, const std::vector<Pose>& poses, bool ignore_collision);
+    GameThreadCommandQueue::Stats getGameThreadCommandStats() const;
 
     virtual bool addVehicle(const std::string& vehicle_name, const std::string& vehicle_type, const Pose& pose, const std::string& pawn_path = "") override;
 
@@ -66,6 +86,15 @@ public:
     virtual void startRecording() override;
     virtual void stopRecording() override;
     virtual bool isRecording() const override;
+    void triggerBlackBoxRecording();
+    void startPlayback(const std::string& file_path, float time_scale, bool regenerate_images);
+    void stopPlayback();
+    bool isPlaybackActive() const;
+
+    // packed lidar output, see LidarPackedCloud
+    std::shared_ptr<const LidarPackedCloud> getLidarPackedCloud(const std::string& vehicle_name, const std::string& lidar_name) const;
+    // distances of every beam of a rangefinder array, see UnrealDistanceArraySensor
+    std::vector<msr::airlib::real_T> getDistanceArray(const std::string& vehicle_name, const std::string& sensor_name) const;
 
     virtual void setWind(const Vector3r& wind) const override;
     virtual bool createVoxelGrid(const Vector3r& position, const int& x_size, const int& y_size, const int& z_size, const float& res, const std::string& output_file) override;
@@ -75,6 +104,9 @@ public:
 private:
     AActor* createNewActor(const FActorSpawnParameters& spawn_params, const FTransform& actor_transform, const Vector3r& scale, UStaticMesh* static_mesh);
     void spawnPlayer();
+    // game thread only
+    bool setObjectPoseInternal(const std::string& object_name, const Pose& pose, bool teleport);
+    bool setObjectScaleInternal(const std::string& object_name, const Vector3r& scale);
 
 private:
     ASimModeBase* simmode_;